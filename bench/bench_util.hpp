@@ -0,0 +1,105 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <nlohmann/json.hpp>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Utilitários comuns aos benchmarks: relógio monotônico e percentis
+
+inline uint64_t now_ns() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// Impede que o compilador elimine o valor medido
+template <typename T> inline void do_not_optimize(T const &v) {
+  asm volatile("" : : "r,m"(v) : "memory");
+}
+
+struct LatencyStats {
+  std::string name;
+  size_t samples = 0;
+  double p50 = 0, p90 = 0, p99 = 0, max = 0, mean = 0;
+  double ops_per_sec = 0;
+};
+
+// `ns` é ordenado in-place
+inline LatencyStats summarize(const std::string &name, std::vector<double> &ns) {
+  LatencyStats s;
+  s.name = name;
+  s.samples = ns.size();
+  if (ns.empty())
+    return s;
+  std::sort(ns.begin(), ns.end());
+  auto pct = [&](double p) {
+    size_t i = static_cast<size_t>(p * (ns.size() - 1));
+    return ns[i];
+  };
+  double sum = 0;
+  for (double v : ns)
+    sum += v;
+  s.p50 = pct(0.50);
+  s.p90 = pct(0.90);
+  s.p99 = pct(0.99);
+  s.max = ns.back();
+  s.mean = sum / ns.size();
+  s.ops_per_sec = s.mean > 0 ? 1e9 / s.mean : 0;
+  return s;
+}
+
+inline void print_stats(const LatencyStats &s) {
+  std::printf("%-40s p50=%8.1fns p90=%8.1fns p99=%8.1fns max=%10.1fns "
+              "%12.0f ops/s\n",
+              s.name.c_str(), s.p50, s.p90, s.p99, s.max, s.ops_per_sec);
+}
+
+// Mede `fn` em lotes de `batch` chamadas; cada amostra é ns/op do lote, o
+// que dilui o custo do próprio relógio em operações de poucos ns.
+template <typename Fn>
+inline std::vector<double> sample_batches(size_t samples, size_t batch, Fn fn) {
+  std::vector<double> out;
+  out.reserve(samples);
+  for (size_t s = 0; s < samples; ++s) {
+    uint64_t t0 = now_ns();
+    for (size_t i = 0; i < batch; ++i)
+      fn(i);
+    uint64_t t1 = now_ns();
+    out.push_back(static_cast<double>(t1 - t0) / batch);
+  }
+  return out;
+}
+
+// Resultados acumulados para saída JSON (acompanhamento de regressões em CI)
+class BenchReport {
+public:
+  void add(const LatencyStats &s, const nlohmann::json &params = {}) {
+    print_stats(s);
+    results_.push_back({{"name", s.name},
+                        {"params", params.is_null() ? nlohmann::json::object()
+                                                    : params},
+                        {"samples", s.samples},
+                        {"p50_ns", s.p50},
+                        {"p90_ns", s.p90},
+                        {"p99_ns", s.p99},
+                        {"max_ns", s.max},
+                        {"mean_ns", s.mean},
+                        {"ops_per_sec", s.ops_per_sec}});
+  }
+
+  void write(const std::string &path) const {
+    std::ofstream out(path);
+    if (!out)
+      throw std::runtime_error("Não foi possível abrir " + path);
+    out << nlohmann::json{{"benchmarks", results_}}.dump(2) << "\n";
+  }
+
+private:
+  nlohmann::json results_ = nlohmann::json::array();
+};
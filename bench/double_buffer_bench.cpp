@@ -0,0 +1,157 @@
+// Benchmark do modo A/B: latência do flip (publish) e overhead do leitor
+// (pin/unpin de época), com e sem um escritor concorrente.
+#include "bench_util.hpp"
+#include "layout_engine.hpp"
+
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+static nlohmann::json book_layout(size_t levels) {
+  return nlohmann::json::parse(R"({
+    "seq":  { "type": "int64" },
+    "book": { "type": "object[]", "max_items": )" +
+                               std::to_string(levels) + R"(,
+              "schema": { "price": "float64", "amount": "float64" } }
+  })");
+}
+
+// Escreve um book inteiro em que todos os preços são iguais a `seq`
+static void fill_book(LayoutEngine &e, int64_t seq, size_t levels) {
+  e.set("seq", &seq);
+  auto const &book =
+      e.get_layout().fields[e.get_layout().field_index.at("book")];
+  char *base = static_cast<char *>(e.mmap_base());
+  *reinterpret_cast<uint32_t *>(base + book.count_offset) =
+      static_cast<uint32_t>(levels);
+  for (size_t i = 0; i < levels; ++i) {
+    char *slot = base + book.offset + 4 + i * book.item_stride;
+    slot[0] = 1;
+    double px = static_cast<double>(seq);
+    memcpy(slot + 1, &px, sizeof(px));
+  }
+}
+
+// Verifica que o book visto pelo leitor é coerente (nenhum estado parcial)
+static bool book_consistent(LayoutEngine &e, size_t levels) {
+  int64_t seq = *static_cast<int64_t *>(e.get("seq"));
+  for (size_t i = 0; i < levels; ++i) {
+    auto *item = static_cast<char *>(e.get("book", i));
+    double px;
+    memcpy(&px, item, sizeof(px));
+    if (px != static_cast<double>(seq))
+      return false;
+  }
+  return true;
+}
+
+int main(int argc, char *argv[]) {
+  std::string json_out;
+  std::string dir = "/dev/shm";
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--json" && i + 1 < argc) {
+      json_out = argv[++i];
+    } else if (arg == "--dir" && i + 1 < argc) {
+      dir = argv[++i];
+    } else {
+      std::cerr << "Uso: " << argv[0]
+                << " [--json <saida.json>] [--dir <diretorio>]\n";
+      return 1;
+    }
+  }
+  std::string path = dir + "/ramlane_bench_ab.buf";
+  BenchReport rep;
+
+  for (size_t levels : {16, 256, 4096}) {
+    std::remove(path.c_str());
+    LayoutEngine writer;
+    writer.build_layout(book_layout(levels));
+    MapOptions opts;
+    opts.double_buffered = true;
+    writer.allocate_memory_from_file(path, opts);
+    writer.begin_write(false);
+    fill_book(writer, 0, levels);
+    writer.publish();
+
+    LayoutEngine reader;
+    reader.build_layout(book_layout(levels));
+    reader.allocate_memory_from_file(path, opts);
+
+    std::printf("\n== levels=%zu (%zu bytes por cópia)\n", levels,
+                writer.mmap_size());
+    nlohmann::json params = {{"levels", levels},
+                             {"bytes_per_copy", writer.mmap_size()}};
+
+    // 1) flip isolado
+    auto flip = sample_batches(20000, 1, [&](size_t) {
+      writer.begin_write(false);
+      writer.publish();
+    });
+    rep.add(summarize("begin_write(no copy)+publish", flip), params);
+
+    auto flip_only = std::vector<double>();
+    for (size_t i = 0; i < 20000; ++i) {
+      writer.begin_write(false);
+      uint64_t t0 = now_ns();
+      writer.publish();
+      flip_only.push_back(static_cast<double>(now_ns() - t0));
+    }
+    rep.add(summarize("publish (flip)", flip_only), params);
+
+    // 2) ciclo completo: copia a frente, escreve o book e publica
+    int64_t seq = 1;
+    auto cycle = sample_batches(2000, 1, [&](size_t) {
+      writer.begin_write(true);
+      fill_book(writer, seq++, levels);
+      writer.publish();
+    });
+    rep.add(summarize("begin_write(copy)+fill+publish", cycle), params);
+
+    // 3) overhead do leitor sem concorrência
+    auto plain = sample_batches(2000, 256, [&](size_t) {
+      do_not_optimize(*static_cast<int64_t *>(reader.get("seq")));
+    });
+    rep.add(summarize("reader get(seq) sem pin", plain), params);
+
+    auto pinned = sample_batches(2000, 256, [&](size_t) {
+      reader.pin_epoch();
+      do_not_optimize(*static_cast<int64_t *>(reader.get("seq")));
+      reader.unpin_epoch();
+    });
+    rep.add(summarize("reader pin+get(seq)+unpin", pinned), params);
+
+    // 4) leitor com escritor publicando continuamente
+    std::atomic<bool> stop{false};
+    std::thread w([&] {
+      int64_t s = seq;
+      while (!stop.load(std::memory_order_relaxed)) {
+        writer.begin_write(false);
+        fill_book(writer, s++, levels);
+        writer.publish();
+      }
+    });
+    size_t torn = 0;
+    auto contended = sample_batches(2000, 16, [&](size_t) {
+      reader.pin_epoch();
+      if (!book_consistent(reader, levels))
+        ++torn;
+      reader.unpin_epoch();
+    });
+    stop = true;
+    w.join();
+    rep.add(summarize("reader pin+scan+unpin (escritor ativo)", contended),
+            params);
+    std::printf("%-40s %zu\n", "leituras inconsistentes", torn);
+    if (torn)
+      throw std::runtime_error("leitor observou estado parcial");
+  }
+  std::remove(path.c_str());
+  if (!json_out.empty())
+    rep.write(json_out);
+  return 0;
+}
@@ -0,0 +1,601 @@
+// Suite de latência da engine e do FFI gerado.
+//
+//   ramlane_bench [--json <saida.json>] [--dir <diretorio de trabalho>]
+//
+// Cobre LayoutEngine::get/insert/pop, acessores gerados (escalares e array),
+// cópias de itens em lote, tempo de attach (load_map_flatbuf +
+// allocate_memory_from_file, ou só allocate sobre um LayoutMap
+// compartilhado), tempo de geração de código, snapshot cru x comprimido
+// (gravação, restore e tamanho) e instâncias copy-on-write (criação x cópia
+// da base, commit das páginas privadas), para vários tamanhos de layout,
+// além da escala de parallel_reduce de 1 a N threads e do custo de compilar
+// o FFI gerado (modo padrão x compacto: tempo e .text). O FFI gerado vem de
+// bench/bench_layout.json.
+#include "bench_util.hpp"
+#include "layout_engine.hpp"
+#include "layout_ffi.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <elf.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+struct LayoutSize {
+  const char *label;
+  size_t scalar_fields;
+  size_t max_items;
+};
+
+static const LayoutSize kSizes[] = {
+    {"small", 8, 64},
+    {"medium", 64, 4096},
+    {"large", 512, 65536},
+};
+
+// Layout sintético: N campos escalares + um array `orders`
+static nlohmann::json synthetic_layout(const LayoutSize &sz) {
+  nlohmann::json layout = nlohmann::json::object();
+  for (size_t i = 0; i < sz.scalar_fields; ++i)
+    layout["f" + std::to_string(i)] = {{"type", i % 2 ? "float64" : "int32"}};
+  layout["orders"] = {{"type", "object[]"},
+                      {"max_items", sz.max_items},
+                      {"schema",
+                       {{"price", "float64"},
+                        {"amount", "float32"},
+                        {"side", "int32"}}}};
+  return layout;
+}
+
+static void reset_count(LayoutEngine &e, const std::string &field) {
+  auto const &fld = e.get_layout().fields[e.get_layout().field_index.at(field)];
+  *reinterpret_cast<uint32_t *>(static_cast<char *>(e.mmap_base()) +
+                                fld.count_offset) = 0;
+}
+
+// -------------------------------
+// ENGINE: get / insert / pop
+// -------------------------------
+static void bench_engine(BenchReport &rep, const LayoutSize &sz,
+                         const std::string &dir) {
+  std::string buf = dir + "/ramlane_bench_engine.buf";
+  std::remove(buf.c_str());
+  LayoutEngine e;
+  e.build_layout(synthetic_layout(sz));
+  e.allocate_memory_from_file(buf);
+  nlohmann::json params = {{"layout", sz.label},
+                           {"fields", sz.scalar_fields + 1},
+                           {"max_items", sz.max_items},
+                           {"bytes", e.mmap_size()}};
+
+  struct orders item{1.5f, 100.25, 1};
+  size_t n = sz.max_items;
+
+  auto ins = sample_batches(2000, 64, [&](size_t) {
+    auto const &fld =
+        e.get_layout().fields[e.get_layout().field_index.at("orders")];
+    if (*reinterpret_cast<uint32_t *>(static_cast<char *>(e.mmap_base()) +
+                                      fld.count_offset) >= n)
+      reset_count(e, "orders");
+    e.insert("orders", &item);
+  });
+  rep.add(summarize("engine.insert", ins), params);
+
+  // array cheio para get/pop
+  reset_count(e, "orders");
+  for (size_t i = 0; i < n; ++i)
+    e.insert("orders", &item);
+
+  auto get_scalar = sample_batches(2000, 256, [&](size_t i) {
+    do_not_optimize(e.get(i & 1 ? "f1" : "f0"));
+  });
+  rep.add(summarize("engine.get(scalar)", get_scalar), params);
+
+  auto get_item = sample_batches(2000, 256, [&](size_t i) {
+    do_not_optimize(e.get("orders", i % n));
+  });
+  rep.add(summarize("engine.get(orders, i)", get_item), params);
+
+  auto pop = sample_batches(2000, 256, [&](size_t i) {
+    e.pop("orders", i % n);
+  });
+  rep.add(summarize("engine.pop", pop), params);
+
+  std::remove(buf.c_str());
+}
+
+// -------------------------------
+// ATTACH: load_map_flatbuf + allocate_memory_from_file
+// -------------------------------
+static void bench_attach(BenchReport &rep, const LayoutSize &sz,
+                         const std::string &dir) {
+  std::string ram = dir + "/ramlane_bench_attach.ram";
+  std::string buf = dir + "/ramlane_bench_attach.buf";
+  std::remove(buf.c_str());
+  {
+    LayoutEngine e;
+    e.build_layout(synthetic_layout(sz));
+    e.save_map_flatbuf(ram);
+    e.allocate_memory_from_file(buf);
+  }
+  nlohmann::json params = {{"layout", sz.label},
+                           {"fields", sz.scalar_fields + 1},
+                           {"max_items", sz.max_items}};
+
+  auto attach = sample_batches(200, 1, [&](size_t) {
+    LayoutEngine e;
+    e.load_map_flatbuf(ram);
+    e.allocate_memory_from_file(buf);
+    do_not_optimize(e.mmap_base());
+  });
+  rep.add(summarize("attach(load_map_flatbuf+allocate)", attach), params);
+
+  // instâncias extras do mesmo layout: só o mmap é por instância
+  LayoutEngine proto;
+  proto.load_map_flatbuf(ram);
+  auto shared = proto.shared_layout();
+  auto attach_shared = sample_batches(200, 1, [&](size_t) {
+    LayoutEngine e(shared);
+    e.allocate_memory_from_file(buf);
+    do_not_optimize(e.mmap_base());
+  });
+  rep.add(summarize("attach(LayoutMap compartilhado+allocate)", attach_shared),
+          params);
+
+  std::remove(ram.c_str());
+  std::remove(buf.c_str());
+}
+
+// -------------------------------
+// CODEGEN: generate_ffi_header + generate_ffi_cpp
+// -------------------------------
+static void bench_codegen(BenchReport &rep, const LayoutSize &sz,
+                          const std::string &dir) {
+  LayoutEngine e;
+  e.build_layout(synthetic_layout(sz));
+  std::string hpp = dir + "/ramlane_bench_ffi.hpp";
+  std::string cpp = dir + "/ramlane_bench_ffi.cpp";
+  nlohmann::json params = {{"layout", sz.label},
+                           {"fields", sz.scalar_fields + 1}};
+
+  auto gen = sample_batches(sz.scalar_fields > 100 ? 5 : 20, 1, [&](size_t) {
+    e.generate_ffi_header(hpp);
+    e.generate_ffi_cpp(cpp);
+  });
+  rep.add(summarize("codegen(header+cpp)", gen), params);
+
+  std::remove(hpp.c_str());
+  std::remove(cpp.c_str());
+}
+
+// -------------------------------
+// CODEGEN: compilação do FFI gerado, modo padrão x compacto
+// -------------------------------
+// Soma das seções .text* de um objeto ELF64 (inline instanciado em COMDAT
+// entra como .text.<símbolo>)
+static size_t elf_text_bytes(const std::string &path) {
+  std::ifstream in(path, std::ios::binary);
+  std::string img((std::istreambuf_iterator<char>(in)),
+                  std::istreambuf_iterator<char>());
+  if (img.size() < sizeof(Elf64_Ehdr))
+    throw std::runtime_error("objeto inválido: " + path);
+  auto *eh = reinterpret_cast<const Elf64_Ehdr *>(img.data());
+  auto *sh = reinterpret_cast<const Elf64_Shdr *>(img.data() + eh->e_shoff);
+  const char *names = img.data() + sh[eh->e_shstrndx].sh_offset;
+  size_t total = 0;
+  for (size_t i = 0; i < eh->e_shnum; ++i)
+    if (std::strncmp(names + sh[i].sh_name, ".text", 5) == 0)
+      total += sh[i].sh_size;
+  return total;
+}
+
+// Layout de ~1000 campos: gera o FFI em cada modo, escreve um consumidor
+// que lê e escreve todos os campos e compila os dois arquivos (-O2 -c)
+static void bench_codegen_modes(BenchReport &rep, const std::string &dir) {
+  LayoutSize sz{"huge", 1000, 64};
+  LayoutEngine e;
+  e.build_layout(synthetic_layout(sz));
+  std::string gen = dir + "/ramlane_bench_codegen";
+  mkdir(gen.c_str(), 0700);
+
+  struct Mode {
+    const char *label;
+    CodegenOptions opts;
+  };
+  CodegenOptions compact, named;
+  compact.compact = true;
+  named.compact = named.named_wrappers = true;
+  for (Mode m : {Mode{"default", {}}, Mode{"compact", compact},
+                 Mode{"compact+named", named}}) {
+    e.set_codegen_options(m.opts);
+    e.generate_ffi_header(gen + "/layout_ffi.hpp");
+    e.generate_ffi_cpp(gen + "/layout_ffi.cpp");
+    {
+      std::ofstream use(gen + "/use.cpp");
+      use << "#include \"layout_ffi.hpp\"\n"
+             "double touch_all(double v) {\n"
+             "  double s = 0;\n";
+      for (size_t i = 0; i < sz.scalar_fields; ++i) {
+        std::string f = "f" + std::to_string(i);
+        const char *tp = i % 2 ? "double" : "int";
+        if (m.opts.compact && !m.opts.named_wrappers)
+          use << "  s += layout::get<layout::FieldId::" << f << ">();\n"
+              << "  layout::set<layout::FieldId::" << f << ">(static_cast<"
+              << tp << ">(v));\n";
+        else
+          use << "  s += get_" << f << "();\n"
+              << "  set_" << f << "(static_cast<" << tp << ">(v));\n";
+      }
+      use << "  return s;\n}\n";
+    }
+
+    std::string cmd = std::string(RAMLANE_BENCH_CXX) +
+                      " -std=c++17 -O2 -DNDEBUG -c " + gen + "/layout_ffi.cpp -o " +
+                      gen + "/ffi.o && " + RAMLANE_BENCH_CXX +
+                      " -std=c++17 -O2 -DNDEBUG -c " + gen + "/use.cpp -I" + gen +
+                      " -o " + gen + "/use.o";
+    bool ok = true;
+    auto build = sample_batches(3, 1, [&](size_t) {
+      ok = ok && std::system(cmd.c_str()) == 0;
+    });
+    if (!ok) {
+      std::printf("compile(%s): compilador indisponível, pulado\n", m.label);
+      continue;
+    }
+    size_t ffi_text = elf_text_bytes(gen + "/ffi.o");
+    size_t use_text = elf_text_bytes(gen + "/use.o");
+    struct stat hs{};
+    stat((gen + "/layout_ffi.hpp").c_str(), &hs);
+    rep.add(summarize(std::string("compile(") + m.label + ")", build),
+            {{"layout", sz.label},
+             {"fields", sz.scalar_fields + 1},
+             {"mode", m.label},
+             {"header_bytes", hs.st_size},
+             {"ffi_text_bytes", ffi_text},
+             {"use_text_bytes", use_text}});
+    std::printf("  .text: layout_ffi.o %zu bytes, consumidor %zu bytes\n",
+                ffi_text, use_text);
+  }
+  for (const char *f : {"layout_ffi.hpp", "layout_ffi.cpp", "use.cpp", "ffi.o",
+                        "use.o"})
+    std::remove((gen + "/" + f).c_str());
+  rmdir(gen.c_str());
+}
+
+// -------------------------------
+// SNAPSHOT: cru x comprimido (skip_unused + LZ), gravação e restore
+// -------------------------------
+static void bench_snapshot(BenchReport &rep, const LayoutSize &sz,
+                           const std::string &dir) {
+  std::string buf = dir + "/ramlane_bench_snapshot.buf";
+  std::string snap = dir + "/ramlane_bench.snap";
+  std::remove(buf.c_str());
+  LayoutEngine e;
+  e.build_layout(synthetic_layout(sz));
+  e.allocate_memory_from_file(buf);
+
+  // região fria: 10% dos slots ocupados, um terço deles já removido
+  struct orders item{1.5f, 100.25, 1};
+  size_t n = sz.max_items / 10;
+  for (size_t i = 0; i < n; ++i) {
+    item.price = 100.0 + i;
+    e.insert("orders", &item);
+  }
+  for (size_t i = 0; i < n; i += 3)
+    e.pop("orders", i);
+
+  struct Mode {
+    const char *label;
+    bool compress;
+  };
+  for (Mode m : {Mode{"raw", false}, Mode{"compressed", true}}) {
+    SnapshotOptions opts;
+    opts.compress = opts.skip_unused = m.compress;
+    e.set_snapshot_options(opts);
+    auto write = sample_batches(10, 1, [&](size_t) { e.checkpoint(snap); });
+    struct stat st{};
+    stat(snap.c_str(), &st);
+    nlohmann::json params = {{"layout", sz.label},
+                             {"mode", m.label},
+                             {"image_bytes", e.mmap_size()},
+                             {"file_bytes", st.st_size},
+                             {"ratio", double(e.mmap_size()) / st.st_size}};
+    rep.add(summarize(std::string("snapshot.write(") + m.label + ")", write),
+            params);
+    auto restore = sample_batches(10, 1, [&](size_t) {
+      e.restore_snapshot(snap);
+    });
+    rep.add(summarize(std::string("snapshot.restore(") + m.label + ")", restore),
+            params);
+  }
+
+  std::remove(snap.c_str());
+  std::remove(buf.c_str());
+}
+
+// -------------------------------
+// COPY-ON-WRITE: rascunho sobre a base x cópia da base, commit
+// -------------------------------
+static void bench_cow(BenchReport &rep, const LayoutSize &sz,
+                      const std::string &dir) {
+  std::string base = dir + "/ramlane_bench_cow.buf";
+  std::string copy = dir + "/ramlane_bench_cow_copy.buf";
+  std::remove(base.c_str());
+  LayoutEngine proto;
+  proto.build_layout(synthetic_layout(sz));
+  proto.allocate_memory_from_file(base);
+  struct orders item{1.5f, 100.25, 1};
+  size_t n = sz.max_items / 2;
+  for (size_t i = 0; i < n; ++i)
+    proto.insert("orders", &item);
+  auto shared = proto.shared_layout();
+  auto write_copy = [&] {
+    std::remove(copy.c_str());
+    std::ofstream(copy, std::ios::binary)
+        .write(static_cast<const char *>(proto.mmap_base()),
+               static_cast<std::streamsize>(proto.mmap_size()));
+  };
+  nlohmann::json params = {{"layout", sz.label},
+                           {"image_bytes", proto.mmap_size()}};
+
+  MapOptions cow;
+  cow.copy_on_write = true;
+  auto scratch_cow = sample_batches(100, 1, [&](size_t) {
+    LayoutEngine e(shared);
+    e.allocate_memory_from_file(base, cow);
+    do_not_optimize(e.mmap_base());
+  });
+  rep.add(summarize("scratch(copy_on_write)", scratch_cow), params);
+  auto scratch_copy = sample_batches(100, 1, [&](size_t) {
+    write_copy();
+    LayoutEngine e(shared);
+    e.allocate_memory_from_file(copy);
+    do_not_optimize(e.mmap_base());
+  });
+  rep.add(summarize("scratch(full copy)", scratch_copy), params);
+
+  // 8 itens espalhados por commit: só as páginas deles vão para o destino
+  write_copy();
+  LayoutEngine s(shared);
+  s.allocate_memory_from_file(base, cow);
+  size_t pages = 0;
+  auto commit = sample_batches(50, 1, [&](size_t k) {
+    for (size_t j = 0; j < 8; ++j) {
+      item.price = 100.0 + k;
+      s.set("orders", &item, (j * n / 8 + k) % n);
+    }
+    pages = s.commit_private(copy);
+  });
+  params["pages"] = pages;
+  rep.add(summarize("commit_private(8 itens)", commit), params);
+
+  std::remove(copy.c_str());
+  std::remove(base.c_str());
+}
+
+// -------------------------------
+// VARREDURA PARALELA: parallel_reduce de 1 a N threads
+// -------------------------------
+static void bench_parallel(BenchReport &rep, const std::string &dir) {
+  std::string buf = dir + "/ramlane_bench_parallel.buf";
+  std::remove(buf.c_str());
+  constexpr size_t n = 1 << 21;
+  LayoutEngine e;
+  e.build_layout({{"orders",
+                   {{"type", "object[]"},
+                    {"max_items", n},
+                    {"schema",
+                     {{"price", "float64"},
+                      {"amount", "float32"},
+                      {"side", "int32"}}}}}});
+  e.allocate_memory_from_file(buf);
+  for (size_t i = 0; i < n; ++i) {
+    struct orders item{1.0f, 0.5 * (i % 1000), static_cast<int>(i % 2)};
+    e.insert("orders", &item);
+  }
+  for (size_t i = 0; i < n; i += 8)
+    e.pop("orders", i);
+
+  unsigned hw = std::max(1u, std::thread::hardware_concurrency());
+  std::vector<unsigned> counts;
+  for (unsigned t = 1; t < hw; t *= 2)
+    counts.push_back(t);
+  counts.push_back(hw);
+
+  double base = 0;
+  for (unsigned t : counts) {
+    ParallelOptions opts;
+    opts.threads = t;
+    // notional por lado: só a soma de price * amount dos itens vivos
+    auto scan = sample_batches(20, 1, [&](size_t) {
+      double v = e.parallel_reduce(
+          "orders", 0.0,
+          [](double acc, size_t, const void *p) {
+            auto *o = static_cast<const struct orders *>(p);
+            return acc + o->price * o->amount;
+          },
+          [](double a, double b) { return a + b; }, opts);
+      do_not_optimize(v);
+    });
+    for (auto &v : scan)
+      v /= n;
+    auto st = summarize(
+        "parallel_reduce " + std::to_string(t) + "T (ns/slot)", scan);
+    if (t == 1)
+      base = st.p50;
+    rep.add(st, {{"slots", n},
+                 {"threads", t},
+                 {"speedup", st.p50 > 0 ? base / st.p50 : 0}});
+  }
+
+  // parcial bool ("existe lado 1 com price acima do máximo"): nunca acha,
+  // varre tudo
+  ParallelOptions opts;
+  opts.threads = hw;
+  auto any = sample_batches(20, 1, [&](size_t) {
+    bool v = e.parallel_reduce(
+        "orders", false,
+        [](bool acc, size_t, const void *p) {
+          auto *o = static_cast<const struct orders *>(p);
+          return acc || (o->side == 1 && o->price > 1000.0);
+        },
+        [](bool a, bool b) { return a || b; }, opts);
+    do_not_optimize(v);
+  });
+  for (auto &v : any)
+    v /= n;
+  rep.add(summarize("parallel_reduce any " + std::to_string(hw) +
+                        "T (ns/slot)",
+                    any),
+          {{"slots", n}, {"threads", hw}});
+  std::remove(buf.c_str());
+}
+
+// -------------------------------
+// FFI GERADO (bench/bench_layout.json)
+// -------------------------------
+static void bench_generated(BenchReport &rep, const std::string &dir) {
+  std::string buf = dir + "/ramlane_bench_ffi.buf";
+  std::remove(buf.c_str());
+  int fd = open(buf.c_str(), O_RDWR | O_CREAT, 0600);
+  if (fd < 0)
+    throw std::runtime_error("open " + buf);
+  close(fd);
+  init_layout_buffer(buf.c_str());
+
+  constexpr size_t n = 4096;
+  nlohmann::json params = {{"layout", "bench_layout.json"}, {"max_items", n}};
+
+  auto set_scalar = sample_batches(2000, 256, [&](size_t i) {
+    set_balance(static_cast<double>(i));
+  });
+  rep.add(summarize("ffi.set_balance", set_scalar), params);
+
+  auto get_scalar = sample_batches(2000, 256, [&](size_t) {
+    do_not_optimize(get_balance());
+  });
+  rep.add(summarize("ffi.get_balance", get_scalar), params);
+
+  // string com prefixo de tamanho: copia só o valor, sem strlen na leitura
+  static const char sym[] = "BTC-USDT";
+  auto set_str = sample_batches(2000, 256, [&](size_t) {
+    set_name(sym, sizeof(sym) - 1);
+  });
+  rep.add(summarize("ffi.set_name(8 bytes)", set_str), params);
+
+  auto get_str = sample_batches(2000, 256, [&](size_t) {
+    do_not_optimize(get_name().size());
+  });
+  rep.add(summarize("ffi.get_name().size()", get_str), params);
+
+  auto set_arr = sample_batches(2000, 256, [&](size_t i) {
+    set_orders_price(i % n, static_cast<double>(i));
+  });
+  rep.add(summarize("ffi.set_orders_price(i)", set_arr), params);
+
+  auto get_arr = sample_batches(2000, 256, [&](size_t i) {
+    do_not_optimize(get_orders_price(i % n));
+  });
+  rep.add(summarize("ffi.get_orders_price(i)", get_arr), params);
+
+  auto get_item = sample_batches(2000, 256, [&](size_t i) {
+    do_not_optimize(get_orders_item(i % n));
+  });
+  rep.add(summarize("ffi.get_orders_item(i)", get_item), params);
+
+  // cópias em lote: ns por item copiado
+  std::vector<struct orders> out(n);
+  for (size_t batch : {64, 1024, 4096}) {
+    auto bulk = sample_batches(200, 1, [&](size_t) {
+      get_orders_items(0, batch, out.data());
+      do_not_optimize(out[batch - 1]);
+    });
+    for (auto &v : bulk)
+      v /= batch;
+    rep.add(summarize("ffi.get_orders_items (ns/item)", bulk),
+            {{"layout", "bench_layout.json"}, {"batch", batch}});
+  }
+
+  // itens vivos: denso (3 de cada 4 slots) e esparso (1 de cada 64);
+  // ns por slot varrido
+  char *slots =
+      static_cast<char *>(layout_default_ctx()->base) + OFFSET_orders_base;
+  for (size_t every : {4, 64}) {
+    set_orders_count(0);
+    set_orders_count(n); // todos vivos; pop libera os que ficam de fora
+    for (size_t i = 0; i < n; ++i)
+      if (every == 4 ? i % 4 == 3 : i % 64 != 0)
+        pop_orders(i);
+    auto by_index = sample_batches(200, 1, [&](size_t) {
+      double sum = 0;
+      for (size_t i = 0; i < n; ++i)
+        if (slots[i * STRIDE_orders])
+          sum += get_orders_price(i);
+      do_not_optimize(sum);
+    });
+    auto by_range = sample_batches(200, 1, [&](size_t) {
+      double sum = 0;
+      for (auto const &o : orders_range())
+        sum += o.price;
+      do_not_optimize(sum);
+    });
+    for (auto *v : {&by_index, &by_range})
+      for (auto &x : *v)
+        x /= n;
+    nlohmann::json live = {{"layout", "bench_layout.json"},
+                           {"slots", n},
+                           {"live", every == 4 ? n * 3 / 4 : n / 64}};
+    rep.add(summarize("ffi.orders live by index (ns/slot)", by_index), live);
+    rep.add(summarize("ffi.orders_range() (ns/slot)", by_range), live);
+  }
+
+  std::remove(buf.c_str());
+}
+
+int main(int argc, char *argv[]) {
+  std::string json_out;
+  std::string dir = "/dev/shm";
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--json" && i + 1 < argc) {
+      json_out = argv[++i];
+    } else if (arg == "--dir" && i + 1 < argc) {
+      dir = argv[++i];
+    } else {
+      std::cerr << "Uso: " << argv[0]
+                << " [--json <saida.json>] [--dir <diretorio>]\n";
+      return 1;
+    }
+  }
+
+  BenchReport rep;
+  for (auto const &sz : kSizes) {
+    std::printf("\n== layout %s (%zu campos, %zu itens)\n", sz.label,
+                sz.scalar_fields + 1, sz.max_items);
+    bench_engine(rep, sz, dir);
+    bench_attach(rep, sz, dir);
+    bench_codegen(rep, sz, dir);
+    bench_snapshot(rep, sz, dir);
+    bench_cow(rep, sz, dir);
+  }
+  std::printf("\n== Compilação do FFI gerado (1001 campos)\n");
+  bench_codegen_modes(rep, dir);
+  std::printf("\n== Varredura paralela (2M slots)\n");
+  bench_parallel(rep, dir);
+  std::printf("\n== FFI gerado (bench_layout.json)\n");
+  bench_generated(rep, dir);
+
+  if (!json_out.empty()) {
+    rep.write(json_out);
+    std::printf("\nResultados em %s\n", json_out.c_str());
+  }
+  return 0;
+}
@@ -0,0 +1,427 @@
+// Harness multiprocesso de contenção: W escritores e R leitores (fork) sobre o
+// mesmo arquivo de backing, cada um anexado via allocate_memory_from_file e
+// fixado em uma CPU. Mede a latência publish->observe em histograma e lê
+// cache-references/cache-misses de cada processo via perf_event_open.
+//
+//   ramlane_stress (--input layout.json | --map layout.ram)
+//                  [--backing-file /dev/shm/ramlane_stress.buf]
+//                  [--writers 1] [--readers 4] [--duration-ms 2000]
+//                  [--rate 0] [--cpus 0,1,2-5] [--json saida.json]
+//
+// Campos-sonda: todo campo escalar de 8 bytes (int64/float64) do layout. O
+// escritor w grava (w << 48 | seq) no campo w % n e registra o instante da
+// publicação em uma região anônima compartilhada; leitores varrem as sondas e
+// medem agora - instante ao verem um valor novo. O escritor 0 também insere
+// nos arrays `object[]` (a engine assume um único escritor por array) para
+// gerar tráfego de cache realista.
+#include "bench_util.hpp"
+#include "layout_engine.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <linux/perf_event.h>
+#include <sched.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+constexpr size_t MAX_PROCS = 256;
+constexpr size_t TS_RING = 4096;
+constexpr size_t HIST_BUCKETS = 16 + 40 * 8;
+
+// -------------------------------
+// HISTOGRAMA LOG-LINEAR (8 sub-buckets por potência de 2)
+// -------------------------------
+static size_t hist_index(uint64_t ns) {
+  if (ns < 16)
+    return ns;
+  int b = 63 - __builtin_clzll(ns);
+  size_t sub = (ns >> (b - 3)) & 7;
+  size_t idx = 16 + static_cast<size_t>(b - 4) * 8 + sub;
+  return idx < HIST_BUCKETS ? idx : HIST_BUCKETS - 1;
+}
+
+static uint64_t hist_lower(size_t idx) {
+  if (idx < 16)
+    return idx;
+  size_t b = (idx - 16) / 8 + 4, sub = (idx - 16) % 8;
+  return (8 + sub) << (b - 3);
+}
+
+// -------------------------------
+// REGIÃO COMPARTILHADA DO HARNESS (MAP_SHARED | MAP_ANONYMOUS)
+// -------------------------------
+struct TsSlot {
+  uint64_t seq;
+  uint64_t ns;
+};
+
+struct ProcResult {
+  int role; // 0 = escritor, 1 = leitor
+  int cpu;
+  uint64_t ops;
+  uint64_t observed;
+  int64_t cache_refs;
+  int64_t cache_misses;
+  uint64_t hist[HIST_BUCKETS];
+};
+
+struct Shared {
+  uint32_t ready;
+  uint32_t go;
+  uint32_t stop;
+  TsSlot ts[MAX_PROCS][TS_RING];
+  ProcResult results[MAX_PROCS];
+};
+
+// -------------------------------
+// PERF COUNTERS
+// -------------------------------
+static int perf_open(uint64_t config) {
+  perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.config = config;
+  attr.disabled = 1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+}
+
+static int64_t perf_read(int fd) {
+  if (fd < 0)
+    return -1;
+  int64_t v = 0;
+  if (read(fd, &v, sizeof(v)) != sizeof(v))
+    return -1;
+  return v;
+}
+
+// -------------------------------
+// CONFIGURAÇÃO
+// -------------------------------
+struct Config {
+  std::string json_layout;
+  std::string map_path;
+  std::string backing = "/dev/shm/ramlane_stress.buf";
+  size_t writers = 1;
+  size_t readers = 4;
+  uint64_t duration_ms = 2000;
+  uint64_t rate = 0; // publicações/s por escritor, 0 = sem limite
+  std::vector<int> cpus;
+  std::string json_out;
+};
+
+static std::vector<int> parse_cpus(const std::string &spec) {
+  std::vector<int> out;
+  size_t pos = 0;
+  while (pos < spec.size()) {
+    size_t end = spec.find(',', pos);
+    std::string tok =
+        spec.substr(pos, end == std::string::npos ? end : end - pos);
+    size_t dash = tok.find('-');
+    if (dash == std::string::npos) {
+      out.push_back(std::stoi(tok));
+    } else {
+      int last = std::stoi(tok.substr(dash + 1));
+      for (int c = std::stoi(tok.substr(0, dash)); c <= last; ++c)
+        out.push_back(c);
+    }
+    if (end == std::string::npos)
+      break;
+    pos = end + 1;
+  }
+  return out;
+}
+
+static void load_layout(LayoutEngine &e, const Config &cfg) {
+  if (!cfg.map_path.empty())
+    e.load_map_flatbuf(cfg.map_path);
+  else
+    e.load_layout_json(cfg.json_layout);
+}
+
+static void pin_to(int cpu) {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  if (sched_setaffinity(0, sizeof(set), &set) < 0)
+    std::perror("sched_setaffinity");
+}
+
+// -------------------------------
+// PROCESSOS
+// -------------------------------
+static void run_child(const Config &cfg, Shared *sh, size_t id, bool writer) {
+  ProcResult &res = sh->results[id];
+  res.role = writer ? 0 : 1;
+  res.cpu = cfg.cpus[id % cfg.cpus.size()];
+  pin_to(res.cpu);
+
+  LayoutEngine e;
+  load_layout(e, cfg);
+  e.allocate_memory_from_file(cfg.backing);
+  auto const &map = e.get_layout();
+  char *base = static_cast<char *>(e.mmap_base());
+
+  std::vector<size_t> probes;
+  std::vector<const FieldLayout *> arrays;
+  for (auto const &f : map.fields) {
+    if (f.type == FieldType::Int64 || f.type == FieldType::Float64)
+      probes.push_back(f.offset);
+    if (f.type == FieldType::Array)
+      arrays.push_back(&f);
+  }
+
+  int fd_refs = perf_open(PERF_COUNT_HW_CACHE_REFERENCES);
+  int fd_miss = perf_open(PERF_COUNT_HW_CACHE_MISSES);
+
+  __atomic_fetch_add(&sh->ready, 1, __ATOMIC_SEQ_CST);
+  while (!__atomic_load_n(&sh->go, __ATOMIC_ACQUIRE))
+    sched_yield();
+  for (int fd : {fd_refs, fd_miss})
+    if (fd >= 0)
+      ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+
+  if (writer) {
+    size_t w = id;
+    auto *probe =
+        reinterpret_cast<uint64_t *>(base + probes[w % probes.size()]);
+    std::vector<char> item;
+    uint64_t period = cfg.rate ? 1000000000ULL / cfg.rate : 0;
+    uint64_t next = now_ns();
+    for (uint64_t seq = 1; !__atomic_load_n(&sh->stop, __ATOMIC_ACQUIRE);
+         ++seq) {
+      if (period) {
+        while (now_ns() < next)
+          ;
+        next += period;
+      }
+      // tráfego: um insert por array, reiniciando quando enche
+      if (w == 0) {
+        for (auto const *arr : arrays) {
+          auto *cnt = reinterpret_cast<uint32_t *>(base + arr->count_offset);
+          if (*cnt >= arr->max_items)
+            *cnt = 0;
+          item.assign(arr->item_stride - 1, static_cast<char>(seq));
+          e.insert(arr->name, item.data());
+        }
+      }
+      TsSlot &slot = sh->ts[w][seq % TS_RING];
+      __atomic_store_n(&slot.ns, now_ns(), __ATOMIC_RELAXED);
+      __atomic_store_n(&slot.seq, seq, __ATOMIC_RELEASE);
+      __atomic_store_n(probe, (static_cast<uint64_t>(w) << 48) | seq,
+                       __ATOMIC_RELEASE);
+      ++res.ops;
+    }
+  } else {
+    std::vector<uint64_t> last(probes.size(), 0);
+    while (!__atomic_load_n(&sh->stop, __ATOMIC_ACQUIRE)) {
+      for (size_t p = 0; p < probes.size(); ++p) {
+        uint64_t v = __atomic_load_n(
+            reinterpret_cast<uint64_t *>(base + probes[p]), __ATOMIC_ACQUIRE);
+        ++res.ops;
+        if (v == last[p] || v == 0)
+          continue;
+        uint64_t t = now_ns();
+        last[p] = v;
+        size_t w = v >> 48;
+        uint64_t seq = v & ((1ULL << 48) - 1);
+        if (w >= MAX_PROCS)
+          continue;
+        TsSlot &slot = sh->ts[w][seq % TS_RING];
+        if (__atomic_load_n(&slot.seq, __ATOMIC_ACQUIRE) != seq)
+          continue; // slot já reciclado
+        uint64_t pub = __atomic_load_n(&slot.ns, __ATOMIC_RELAXED);
+        if (t >= pub) {
+          ++res.hist[hist_index(t - pub)];
+          ++res.observed;
+        }
+      }
+    }
+  }
+
+  res.cache_refs = perf_read(fd_refs);
+  res.cache_misses = perf_read(fd_miss);
+  _exit(0);
+}
+
+// -------------------------------
+// RELATÓRIO
+// -------------------------------
+static double hist_percentile(const std::vector<uint64_t> &h, uint64_t total,
+                              double p) {
+  uint64_t target = static_cast<uint64_t>(p * (total - 1)), acc = 0;
+  for (size_t i = 0; i < h.size(); ++i) {
+    acc += h[i];
+    if (acc > target)
+      return static_cast<double>(hist_lower(i));
+  }
+  return static_cast<double>(hist_lower(h.size() - 1));
+}
+
+static int usage(const char *argv0) {
+  std::cerr << "Uso: " << argv0
+            << " (--input <layout.json> | --map <layout.ram>)"
+            << " [--backing-file <buf>] [--writers N] [--readers N]"
+            << " [--duration-ms N] [--rate N] [--cpus 0,2-5]"
+            << " [--json <saida.json>]\n";
+  return 1;
+}
+
+int main(int argc, char *argv[]) {
+  Config cfg;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--input" && i + 1 < argc) {
+      cfg.json_layout = argv[++i];
+    } else if (arg == "--map" && i + 1 < argc) {
+      cfg.map_path = argv[++i];
+    } else if (arg == "--backing-file" && i + 1 < argc) {
+      cfg.backing = argv[++i];
+    } else if (arg == "--writers" && i + 1 < argc) {
+      cfg.writers = std::stoul(argv[++i]);
+    } else if (arg == "--readers" && i + 1 < argc) {
+      cfg.readers = std::stoul(argv[++i]);
+    } else if (arg == "--duration-ms" && i + 1 < argc) {
+      cfg.duration_ms = std::stoull(argv[++i]);
+    } else if (arg == "--rate" && i + 1 < argc) {
+      cfg.rate = std::stoull(argv[++i]);
+    } else if (arg == "--cpus" && i + 1 < argc) {
+      cfg.cpus = parse_cpus(argv[++i]);
+    } else if (arg == "--json" && i + 1 < argc) {
+      cfg.json_out = argv[++i];
+    } else {
+      return usage(argv[0]);
+    }
+  }
+  if ((cfg.json_layout.empty() && cfg.map_path.empty()) || cfg.writers == 0 ||
+      cfg.writers + cfg.readers > MAX_PROCS)
+    return usage(argv[0]);
+  if (cfg.cpus.empty())
+    for (long c = 0; c < sysconf(_SC_NPROCESSORS_ONLN); ++c)
+      cfg.cpus.push_back(static_cast<int>(c));
+
+  // Pai cria/valida o buffer; filhos se anexam por conta própria
+  {
+    LayoutEngine e;
+    load_layout(e, cfg);
+    e.allocate_memory_from_file(cfg.backing);
+    bool has_probe = false;
+    for (auto const &f : e.get_layout().fields)
+      has_probe |= (f.type == FieldType::Int64 || f.type == FieldType::Float64);
+    if (!has_probe)
+      throw std::runtime_error("layout sem campo int64/float64 para sonda");
+  }
+
+  auto *sh = static_cast<Shared *>(mmap(nullptr, sizeof(Shared),
+                                        PROT_READ | PROT_WRITE,
+                                        MAP_SHARED | MAP_ANONYMOUS, -1, 0));
+  if (sh == MAP_FAILED)
+    throw std::runtime_error("mmap(shared)");
+
+  size_t nproc = cfg.writers + cfg.readers;
+  std::vector<pid_t> pids;
+  for (size_t id = 0; id < nproc; ++id) {
+    pid_t pid = fork();
+    if (pid < 0)
+      throw std::runtime_error("fork");
+    if (pid == 0)
+      run_child(cfg, sh, id, id < cfg.writers);
+    pids.push_back(pid);
+  }
+
+  while (__atomic_load_n(&sh->ready, __ATOMIC_ACQUIRE) < nproc)
+    usleep(1000);
+  __atomic_store_n(&sh->go, 1, __ATOMIC_RELEASE);
+  usleep(static_cast<useconds_t>(cfg.duration_ms * 1000));
+  __atomic_store_n(&sh->stop, 1, __ATOMIC_RELEASE);
+  for (pid_t pid : pids)
+    waitpid(pid, nullptr, 0);
+
+  // Agregação
+  std::vector<uint64_t> hist(HIST_BUCKETS, 0);
+  uint64_t observed = 0, wops = 0, rops = 0;
+  nlohmann::json procs = nlohmann::json::array();
+  std::printf("%-4s %-7s %-4s %14s %12s %14s %14s\n", "id", "role", "cpu",
+              "ops", "observed", "cache-refs", "cache-misses");
+  for (size_t id = 0; id < nproc; ++id) {
+    auto const &r = sh->results[id];
+    for (size_t b = 0; b < HIST_BUCKETS; ++b)
+      hist[b] += r.hist[b];
+    observed += r.observed;
+    (r.role == 0 ? wops : rops) += r.ops;
+    std::printf("%-4zu %-7s %-4d %14llu %12llu %14lld %14lld\n", id,
+                r.role == 0 ? "writer" : "reader", r.cpu,
+                static_cast<unsigned long long>(r.ops),
+                static_cast<unsigned long long>(r.observed),
+                static_cast<long long>(r.cache_refs),
+                static_cast<long long>(r.cache_misses));
+    procs.push_back({{"id", id},
+                     {"role", r.role == 0 ? "writer" : "reader"},
+                     {"cpu", r.cpu},
+                     {"ops", r.ops},
+                     {"observed", r.observed},
+                     {"cache_references", r.cache_refs},
+                     {"cache_misses", r.cache_misses}});
+  }
+  if (sh->results[0].cache_refs < 0)
+    std::printf("(perf_event_open indisponível: contadores = -1)\n");
+
+  double secs = cfg.duration_ms / 1000.0;
+  std::printf("\npublicações/s: %.0f   leituras de sonda/s: %.0f\n",
+              wops / secs, rops / secs);
+
+  nlohmann::json lat = nlohmann::json::object();
+  if (observed > 0) {
+    double p50 = hist_percentile(hist, observed, 0.50);
+    double p90 = hist_percentile(hist, observed, 0.90);
+    double p99 = hist_percentile(hist, observed, 0.99);
+    double p999 = hist_percentile(hist, observed, 0.999);
+    std::printf("publish->observe (%llu amostras): p50=%.0fns p90=%.0fns "
+                "p99=%.0fns p99.9=%.0fns\n",
+                static_cast<unsigned long long>(observed), p50, p90, p99,
+                p999);
+    uint64_t peak = 0;
+    for (uint64_t c : hist)
+      peak = std::max(peak, c);
+    nlohmann::json buckets = nlohmann::json::array();
+    for (size_t b = 0; b < HIST_BUCKETS; ++b) {
+      if (!hist[b])
+        continue;
+      buckets.push_back({{"ge_ns", hist_lower(b)}, {"count", hist[b]}});
+      std::printf("  >= %10llu ns %10llu %s\n",
+                  static_cast<unsigned long long>(hist_lower(b)),
+                  static_cast<unsigned long long>(hist[b]),
+                  std::string(static_cast<size_t>(50.0 * hist[b] / peak), '#')
+                      .c_str());
+    }
+    lat = {{"samples", observed}, {"p50_ns", p50},   {"p90_ns", p90},
+           {"p99_ns", p99},       {"p999_ns", p999}, {"histogram", buckets}};
+  } else {
+    std::printf("nenhuma publicação observada\n");
+  }
+
+  if (!cfg.json_out.empty()) {
+    std::ofstream out(cfg.json_out);
+    out << nlohmann::json{{"writers", cfg.writers},
+                          {"readers", cfg.readers},
+                          {"duration_ms", cfg.duration_ms},
+                          {"rate", cfg.rate},
+                          {"publish_per_sec", wops / secs},
+                          {"publish_to_observe", lat},
+                          {"processes", procs}}
+               .dump(2)
+        << "\n";
+  }
+  munmap(sh, sizeof(Shared));
+  return 0;
+}
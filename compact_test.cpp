@@ -0,0 +1,129 @@
+#include <cassert>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <unistd.h>
+
+#include "compact/layout_ffi.hpp"
+
+// Acessores do modo compacto (--compact) gerados de compact_layout.json.
+// O `using namespace std` garante que get/set<FieldId> não colidem com
+// std::get em quem inclui o header assim.
+using namespace std;
+using layout::FieldId;
+
+// Item de orders com o layout do slot (sem a flag de uso)
+#pragma pack(push, 1)
+struct order_item {
+  double price;
+  std::int32_t side;
+};
+#pragma pack(pop)
+
+// O tipo do valor vem do tipo do campo
+static_assert(is_same<layout::field_t<FieldId::id>, int32_t>::value, "int32");
+static_assert(is_same<layout::field_t<FieldId::seq>, int64_t>::value, "int64");
+static_assert(is_same<layout::field_t<FieldId::ratio>, float>::value, "float32");
+static_assert(is_same<layout::field_t<FieldId::balance>, double>::value, "float64");
+static_assert(is_same<layout::field_t<FieldId::name>, string_view>::value, "string");
+static_assert(is_same<layout::field_t<FieldId::note>, string_view>::value, "varstring");
+static_assert(is_same<layout::field_t<FieldId::orders_side>, int32_t>::value, "subcampo");
+static_assert(is_void<layout::field_t<FieldId::config>>::value, "objeto sem valor");
+static_assert(is_void<layout::field_t<FieldId::orders>>::value, "array sem valor");
+
+int main() {
+  const char* path = "compact_test.buf";
+  std::ofstream(path, std::ios::binary | std::ios::trunc).close();
+
+  // 1) init: dimensiona e carimba o arquivo vazio; objeto com default
+  init_layout_buffer(path);
+  assert(layout::get<FieldId::config_active>() == 1);
+  assert(layout::get<FieldId::config_threshold>() == 0.5f);
+
+  // 2) Escalares: o argumento é convertido para o tipo do campo
+  layout::set<FieldId::balance>(1.5f);
+  assert(layout::get<FieldId::balance>() == 1.5);
+  layout::set<FieldId::seq>(5);
+  assert(layout::get<FieldId::seq>() == 5);
+  layout::set<FieldId::id>(-7);
+  assert(layout::get<FieldId::id>() == -7);
+  layout::set<FieldId::ratio>(0.25);
+  assert(layout::get<FieldId::ratio>() == 0.25f);
+
+  // 3) Texto: string fixa (trunca) e varstring na arena
+  layout::set<FieldId::name>("abc");
+  assert(layout::get<FieldId::name>() == "abc");
+  layout::set<FieldId::name>(string(40, 'x'));
+  assert(layout::get<FieldId::name>().size() < 16);
+  layout::set<FieldId::note>("uma nota longa o bastante");
+  assert(layout::get<FieldId::note>() == "uma nota longa o bastante");
+  layout::set<FieldId::note>("curta");
+  assert(compact_arena() > 0);
+  assert(layout::get<FieldId::note>() == "curta");
+
+  // 4) Array fixo: contador, subcampos, item inteiro, itens vivos
+  layout::set_count(FieldId::orders, 4);
+  assert(layout::get_count(FieldId::orders) == 4);
+  for (size_t i = 0; i < 4; ++i) {
+    layout::set<FieldId::orders_price>(10.0 * i, i);
+    layout::set<FieldId::orders_side>(static_cast<int32_t>(i % 2), i);
+  }
+  order_item o = layout::get_item<FieldId::orders, order_item>(3);
+  assert(o.price == 30.0 && o.side == 1);
+  layout::pop_item(FieldId::orders, 1);
+  double sum = 0;
+  size_t live = 0;
+  for (size_t i : layout::live_items<FieldId::orders>()) {
+    sum += layout::get<FieldId::orders_price>(i);
+    ++live;
+  }
+  assert(live == 3 && sum == 0.0 + 20.0 + 30.0);
+  bool threw = false;
+  try {
+    layout::set_count(FieldId::orders, 65);
+  } catch (const std::runtime_error&) {
+    threw = true;
+  }
+  assert(threw && layout::get_count(FieldId::orders) == 4);
+
+  // 5) Array em chunks: set_count anexa chunks; acima de max_items lança
+  layout::set_count(FieldId::fills, 1000);
+  layout::set<FieldId::fills_qty>(2.5, 999);
+  assert(layout::get<FieldId::fills_qty>(999) == 2.5);
+  size_t fills = 0;
+  for (size_t i : layout::live_items<FieldId::fills>()) {
+    (void)i;
+    ++fills;
+  }
+  assert(fills == 1000);
+  threw = false;
+  try {
+    layout::set_count(FieldId::fills, 2049);
+  } catch (const std::runtime_error&) {
+    threw = true;
+  }
+  assert(threw);
+
+  // 6) Segundo contexto sobre o mesmo arquivo vê as escritas
+  layout_ctx* ctx = layout_open(path, 0, 0);
+  assert(ctx);
+  assert(layout::ctx_get<FieldId::seq>(ctx) == 5);
+  assert(layout::ctx_get<FieldId::fills_qty>(ctx, 999) == 2.5);
+  assert(layout::ctx_get_count(ctx, FieldId::orders) == 4);
+  layout::ctx_set<FieldId::id>(ctx, 42);
+  assert(layout::get<FieldId::id>() == 42);
+  size_t ctx_live = 0;
+  for (size_t i : layout::ctx_live_items<FieldId::orders>(ctx)) {
+    (void)i;
+    ++ctx_live;
+  }
+  assert(ctx_live == 3);
+  layout_close(ctx);
+
+  ::unlink(path);
+  std::cout << "Todos os testes passaram!" << std::endl;
+  return 0;
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include "layout_engine.hpp"
+
+#include <cstddef>
+#include <string>
+
+// Arrow IPC: Stream (mensagens + EOS) ou File ("ARROW1" + stream + footer)
+enum class ArrowFormat { Stream, File };
+
+// Exporta os itens vivos (flag de uso != 0) de um campo object[] como um
+// único RecordBatch Arrow, uma coluna por subcampo, sem nulos. Os valores
+// são lidos uma vez por item, pela imagem atual do engine: em modo A/B o
+// chamador fixa a época (pin_epoch) para obter um snapshot consistente.
+// Devolve o número de linhas exportadas.
+size_t export_arrow(LayoutEngine &engine, const std::string &field,
+                    const std::string &path,
+                    ArrowFormat format = ArrowFormat::File);
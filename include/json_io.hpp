@@ -0,0 +1,24 @@
+#pragma once
+
+#include "layout_engine.hpp"
+
+#include <cstddef>
+#include <string>
+
+// Json: um único documento { "campo": valor, ..., "array": [ {item}, ... ] }
+// Ndjson: uma linha com os campos que não são array e uma linha
+// { "array": {item} } por item vivo
+enum class JsonFormat { Json, Ndjson };
+
+// Grava o conteúdo da imagem atual do engine (itens vivos dos arrays, blob em
+// base64) em `path` ("-" = stdout) com buffer fixo, sem montar DOM.
+// Devolve o número de itens de array gravados.
+size_t dump_json(LayoutEngine &engine, const std::string &path,
+                 JsonFormat format = JsonFormat::Json);
+
+// Lê `path` ("-" = stdin) com o parser SAX do nlohmann e escreve pelos
+// métodos do engine (set/set_bytes/insert, portanto com WAL e stats):
+// itens de array são anexados. Aceita os dois formatos de dump_json.
+// Devolve o número de itens inseridos.
+size_t load_json(LayoutEngine &engine, const std::string &path,
+                 JsonFormat format = JsonFormat::Json);
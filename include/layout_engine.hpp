@@ -1,54 +1,355 @@
 #pragma once
 
+#include "numa.hpp"
+#include "parallel.hpp"
+#include "replication.hpp"
+#include "snapshot.hpp"
+#include "wal.hpp"
+
 #include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
 #include <nlohmann/json.hpp>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <vector>
 
-enum class FieldType { Int32, Int64, Float32, Float64, String, Object, Array };
+enum class FieldType {
+  Int32,
+  Int64,
+  Float32,
+  Float64,
+  String, // prefixo uint32 de tamanho + max_length bytes (sempre com NUL)
+  Object,
+  Array,
+  VarString, // referência (offset, tamanho) para a arena, terminada em NUL
+  Blob       // referência (offset, tamanho) para a arena, bytes crus
+};
+
+// Campos string: [uint32 tamanho][max_length bytes]; o valor guarda no máximo
+// max_length - 1 bytes e é sempre terminado em NUL
+constexpr size_t STRING_LEN_PREFIX = 4;
 
 struct FieldLayout {
   std::string name;
   FieldType type;
   size_t offset = 0;
   size_t size = 0;
-  size_t max_length = 0;      // para string
+  size_t max_length = 0;      // para string (sem o prefixo)
   size_t count_offset = 0;    // para array
   size_t item_stride = 0;     // para array
   size_t max_items = 0;       // para array
   bool has_used_flag = false; // para array
+  size_t chunk_items = 0;     // array crescente: itens por chunk (0 = fixo)
+  int numa_node = -1;         // campo de topo fixado num nó (páginas próprias)
+  // "default": bytes do valor inicial (escalar/objeto com `size` bytes;
+  // string/varstring/blob só o conteúdo). Vazio = zeros.
+  std::string default_value;
   std::vector<FieldLayout> children;
   std::unordered_map<std::string, size_t> field_index;
 };
 
+// Trecho contíguo do registro inicial; trechos separados por menos de
+// DEFAULT_RUN_GAP zeros são fundidos (em geral um único memcpy)
+constexpr size_t DEFAULT_RUN_GAP = 64;
+
+struct DefaultRun {
+  size_t offset;
+  std::string bytes;
+};
+
 struct LayoutMap {
   size_t total_size = 0;
+  size_t header_size = 0;
+  uint64_t fingerprint = 0;
+  size_t stats_offset = 0; // seção de FieldStats (0 = desabilitada)
+  size_t stats_slots = 0;
+  size_t pool_instances = 0;  // pool: N registros de total_size (0 = sem pool)
+  size_t pool_offset = 0;     // início do registro 0 no arquivo
+  size_t instance_stride = 0; // distância entre registros (múltiplo de 64)
+  size_t arena_offset = 0;    // ArenaHeader + dados (0 = sem arena)
+  size_t arena_size = 0;      // capacidade de dados da arena
+  size_t grow_offset = 0;     // início dos chunks no arquivo (0 = sem chunks)
+  size_t grow_size = 0;       // espaço virtual reservado para chunks
+  // Registro inicial montado uma vez a partir dos "default" (valores nos
+  // offsets, varstring/blob no início da arena); vazio se nenhum campo tem
+  // default
+  std::vector<DefaultRun> default_image;
   std::vector<FieldLayout> fields;
   std::unordered_map<std::string, size_t> field_index;
 };
 
+// Cabeçalho reservado no offset 0 do buffer mapeado. Permite validar em O(1)
+// se um arquivo de backing foi construído com o mesmo layout.
+constexpr uint32_t LAYOUT_HEADER_MAGIC = 0x4E4C4152; // "RALN"
+constexpr uint16_t LAYOUT_FORMAT_VERSION = 1;
+constexpr size_t LAYOUT_HEADER_SIZE = 64;
+
+// Bits de LayoutHeader::flags
+constexpr uint32_t LAYOUT_FLAG_SUPERSEDED = 1u << 0; // buffer trocado (migrate)
+
+struct LayoutHeader {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t header_size;
+  uint64_t fingerprint;
+  uint64_t total_size;
+  uint32_t flags;
+  uint8_t reserved[36];
+};
+static_assert(sizeof(LayoutHeader) == LAYOUT_HEADER_SIZE,
+              "LayoutHeader deve ocupar exatamente LAYOUT_HEADER_SIZE bytes");
+
+// Arena de tamanho variável: varstring/blob guardam no registro uma
+// referência de 8 bytes (offset nos 32 bits baixos, tamanho nos altos) para
+// bytes alocados por bump a partir de ArenaHeader::top. Valores antigos só
+// são recuperados por compact_arena. O byte 0 dos dados é um NUL permanente:
+// referência 0 = valor vazio (ou nunca escrito), e nenhum valor com bytes é
+// alocado nele.
+constexpr size_t DEFAULT_ARENA_SIZE = 64 * 1024;
+constexpr size_t ARENA_RESERVED = 1;
+
+struct ArenaHeader {
+  uint64_t top;  // próximo byte livre (relativo aos dados)
+  uint64_t live; // bytes referenciados pelos campos
+  uint8_t reserved[48];
+};
+static_assert(sizeof(ArenaHeader) == 64, "ArenaHeader deve ocupar 64 bytes");
+
+// Arrays crescentes (object[] com chunk_items): o registro guarda o
+// contador, 4 bytes de padding e um diretório de max_items / chunk_items
+// offsets de arquivo (uint64, 0 = chunk não alocado). Chunks são anexados
+// ao arquivo a partir de grow_offset com fallocate; o mapeamento já cobre
+// toda a região reservada, então outros processos enxergam um chunk novo
+// assim que leem seu offset no diretório, sem remapear, e os índices
+// existentes nunca mudam de endereço.
+struct GrowControl {
+  uint64_t tail; // bytes já reservados na região de crescimento
+  uint8_t reserved[56];
+};
+static_assert(sizeof(GrowControl) == 64, "GrowControl deve ocupar 64 bytes");
+constexpr size_t CHUNK_DIR_OFFSET = 8; // diretório relativo a FieldLayout::offset
+
+// Tamanho de um chunk no arquivo (múltiplo de página)
+inline size_t chunk_bytes(const FieldLayout &f) {
+  return (f.chunk_items * f.item_stride + 4095) & ~size_t(4095);
+}
+
+// Pool: o arquivo começa com um LayoutHeader próprio, seguido do
+// PoolControl e do bitmap de instâncias ocupadas; os registros (cada um com
+// o layout completo, incluindo os 64 bytes reservados do header) começam em
+// LayoutMap::pool_offset, a cada instance_stride bytes.
+struct PoolControl {
+  uint64_t instances;
+  uint64_t stride;
+  uint64_t used; // instâncias alocadas
+  uint8_t reserved[40];
+};
+static_assert(sizeof(PoolControl) == 64, "PoolControl deve ocupar 64 bytes");
+constexpr size_t POOL_CONTROL_OFFSET = LAYOUT_HEADER_SIZE;
+constexpr size_t POOL_BITMAP_OFFSET = POOL_CONTROL_OFFSET + sizeof(PoolControl);
+
+// Modo A/B: bloco de controle no início do arquivo, seguido de duas cópias
+// completas do layout (cada uma com seu LayoutHeader). A cópia da frente é
+// `epoch & 1`; leitores fixam uma época contando-se em `readers`.
+constexpr uint32_t EPOCH_CONTROL_MAGIC = 0x454C4152; // "RALE"
+constexpr size_t EPOCH_CONTROL_SIZE = 4096;
+
+struct EpochControl {
+  uint32_t magic;
+  uint32_t copies;
+  alignas(64) uint64_t epoch;
+  struct alignas(64) ReaderCount {
+    uint32_t n;
+  } readers[2];
+};
+static_assert(sizeof(EpochControl) <= EPOCH_CONTROL_SIZE,
+              "EpochControl deve caber em EPOCH_CONTROL_SIZE");
+
+// Opções de allocate_memory_from_file
+struct MapOptions {
+  bool double_buffered = false; // duas cópias + flip atômico de época
+  bool read_only = false; // só anexa: sem O_CREAT/ftruncate, PROT_READ
+  // Anexa para escrita um buffer que já existe e já tem header: sem
+  // O_CREAT nem ftruncate (caminho errado lança em vez de criar o arquivo)
+  bool attach_existing = false;
+  bool populate = false;  // MAP_POPULATE: pré-carrega as page tables
+  // Reserva virtual (bytes, PROT_NONE) para crescer no lugar com grow():
+  // a base nunca muda. Arrays com chunk_items reservam grow_size sozinhos.
+  size_t reserve = 0;
+  // Política NUMA do mapeamento inteiro; campos com "numa_node" ficam presos
+  // ao próprio nó. numa_prefault toca as páginas a partir de threads nos nós.
+  NumaPolicy numa = NumaPolicy::Default;
+  uint64_t numa_nodes = 0; // bit N = nó N
+  bool numa_prefault = false;
+  // Prefault paralelo na inicialização: uma faixa do mapeamento por worker
+  // (prefault_threads, 0 = hardware_concurrency), fixados nos numa_nodes se
+  // houver. prefault_zero zera as faixas (memset) num buffer recém-criado;
+  // buffers existentes são só tocados.
+  bool prefault = false;
+  unsigned prefault_threads = 0;
+  bool prefault_zero = false;
+  // Instância de rascunho sobre uma imagem base já inicializada: MAP_PRIVATE,
+  // cada página escrita vira cópia privada e o arquivo não muda até
+  // commit_private(). Criar a instância custa um mmap, sem copiar a base.
+  bool copy_on_write = false;
+};
+
+// Tempos do último allocate_memory_from_file
+struct StartupReport {
+  double map_ms = 0;      // open/ftruncate/mmap/header/NUMA
+  double prefault_ms = 0; // prefault paralelo (0 se desligado)
+  size_t prefault_bytes = 0;
+  unsigned prefault_threads = 0;
+  bool zeroed = false;
+};
+
+// Opções de build_layout (raiz do layout.json: "stats", "pool")
+struct LayoutOptions {
+  size_t stats_slots = 0;    // 0 = sem seção de estatísticas
+  size_t pool_instances = 0; // 0 = um único registro por arquivo
+  size_t arena_size = 0;     // 0 = DEFAULT_ARENA_SIZE se houver varstring/blob
+};
+
+// Opções de generate_ffi_header/generate_ffi_cpp
+struct CodegenOptions {
+  // Tabela constexpr de descritores + get<T>/set<T>(FieldId) inline, em vez
+  // de um par de funções por campo (layouts com milhares de campos)
+  bool compact = false;
+  // Modo compacto: também get_<campo>/set_<campo> inline sobre a tabela,
+  // com os nomes do modo padrão
+  bool named_wrappers = false;
+};
+
+// Hash FNV-1a de 64 bits sobre nomes, tipos, offsets e tamanhos do layout
+uint64_t layout_fingerprint(const LayoutMap &map);
+
+// Bytes do arquivo de backing: total_size, ou o pool inteiro
+size_t layout_buffer_size(const LayoutMap &map);
+
+// Monta LayoutMap::default_image a partir dos default_value dos campos
+void build_default_image(LayoutMap &map);
+
 class LayoutEngine {
 public:
   LayoutEngine() = default;
+  // Nova instância sobre um mapa já parseado (ex.: um buffer por instrumento):
+  // só o mapeamento é por instância, o LayoutMap é compartilhado
+  explicit LayoutEngine(std::shared_ptr<const LayoutMap> map);
+  ~LayoutEngine();
 
   // Geração de mapa
   void load_layout_json(const std::string &path);
-  void build_layout(const nlohmann::json &layout_def);
+  void build_layout(const nlohmann::json &layout_def,
+                    const LayoutOptions &opts = {});
   void save_map_flatbuf(const std::string &path);
   void load_map_flatbuf(const std::string &path);
 
   // Alocação de memória
-  void allocate_memory_from_file(const std::string &path);
+  void allocate_memory_from_file(const std::string &path,
+                                 const MapOptions &opts = {});
   void *mmap_base() const;
   size_t mmap_size() const;
+  const LayoutMap &get_layout() const;
+  std::shared_ptr<const LayoutMap> shared_layout() const;
+  bool read_only() const;
+
+  // Reserva virtual (MapOptions::reserve): grow() estende o arquivo e mapeia
+  // o trecho novo no lugar; remap() só mapeia o que outro processo já
+  // estendeu. Ponteiros devolvidos por get() continuam válidos.
+  void grow(size_t new_len);
+  size_t remap();
+  size_t reserved_size() const;
+  size_t mapped_size() const;
+
+  // Copy-on-write (MapOptions::copy_on_write): commit_private grava só as
+  // páginas com cópia privada em `target` (vazio = a imagem base) e devolve
+  // quantas foram gravadas; na própria base elas voltam a ser compartilhadas.
+  // discard_private descarta todas as mudanças privadas.
+  size_t commit_private(const std::string &target = {});
+  void discard_private();
+  size_t private_pages() const;
+
+  // Páginas do mapeamento por nó NUMA (move_pages)
+  NumaPlacement numa_placement() const;
+  const StartupReport &startup_report() const;
+
+  // Troca de buffer (migrate): o escritor marca o buffer antigo e leitores
+  // anexados consultam a flag para se reanexarem ao novo arquivo
+  void mark_superseded();
+  bool superseded() const;
+
+  // Pool (LayoutOptions::pool_instances): claim/release pelo bitmap do
+  // arquivo; get/set/insert/pop operam na instância selecionada (0 no attach)
+  size_t pool_instances() const;
+  size_t claim_instance();
+  void release_instance(size_t idx);
+  bool instance_in_use(size_t idx) const;
+  void *instance_base(size_t idx) const;
+  void select_instance(size_t idx);
+
+  // Modo A/B (MapOptions::double_buffered). O escritor preenche a cópia de
+  // trás e publica com um único store atômico; leitores fixam a época para
+  // nunca verem estado parcial. begin_write espera no máximo timeout_ms
+  // pelos leitores ainda fixados na cópia de trás e lança depois disso (um
+  // leitor morto fixado não trava o escritor para sempre).
+  void *begin_write(bool copy_front = true, uint32_t timeout_ms = 1000);
+  uint64_t publish();
+  uint64_t pin_epoch();
+  void unpin_epoch();
 
   // Operações de inserção/pop/get (internas)
   void insert(const std::string &field_name, const void *item);
   void pop(const std::string &field_name, size_t index);
   void *get(const std::string &field_name, size_t index = 0);
+  void set(const std::string &field_name, const void *value, size_t index = 0);
+
+  // Varredura paralela dos itens vivos (flag de uso, índice < count) de um
+  // object[]. Os slots são divididos em tarefas de opts.task_bytes com
+  // fronteiras em linhas de cache e distribuídos num WorkStealingPool.
+  // parallel_reduce dobra cada tarefa com fold(acc, índice, item) a partir
+  // de `identity` e junta os parciais com combine na ordem dos slots: o
+  // resultado não depende do número de threads.
+  void parallel_for(const std::string &field_name,
+                    const std::function<void(size_t, void *)> &fn,
+                    const ParallelOptions &opts = {});
+  template <typename T, typename Fold, typename Combine>
+  T parallel_reduce(const std::string &field_name, T identity, Fold fold,
+                    Combine combine, const ParallelOptions &opts = {});
+
+  // Campos string/varstring/blob: a view aponta para o buffer (sem cópia) e
+  // vale até o próximo set_bytes/compact_arena no campo. Em string, valores
+  // maiores que max_length - 1 são truncados.
+  void set_bytes(const std::string &field_name, const void *data, size_t len);
+  std::string_view get_bytes(const std::string &field_name) const;
+  // Reescreve os valores vivos no início da arena; devolve bytes liberados.
+  // Sem leitores concorrentes (ou na cópia de trás em modo A/B).
+  size_t compact_arena();
+
+  // Durabilidade: WAL de insert/pop/set + snapshot do buffer
+  void enable_wal(const std::string &path, const WalOptions &opts = {});
+  void sync_wal();
+  void checkpoint(const std::string &snapshot_path);
+  size_t recover(const std::string &snapshot_path, const std::string &wal_path);
+  // Copia o snapshot (cru ou comprimido) para a imagem; false se o arquivo
+  // não existe
+  bool restore_snapshot(const std::string &snapshot_path);
+  // Formato dos snapshots gravados por checkpoint/recover (padrão: cru)
+  void set_snapshot_options(const SnapshotOptions &opts);
+
+  // Replicação: as mesmas escritas físicas do WAL vão em lotes para um ring
+  // em memória compartilhada (replication.hpp); checkpoint() registra no
+  // ring a posição refletida no snapshot. apply_delta é o lado do seguidor.
+  void enable_replication(const std::string &ring_path,
+                          const ReplOptions &opts = {});
+  void flush_replication();
+  ReplLag replication_lag() const;
+  void apply_delta(size_t image_offset, const void *data, size_t len);
 
   // Geração de FFI (header + source)
+  void set_codegen_options(const CodegenOptions &opts);
   void generate_ffi_header(const std::string &output_path);
   void generate_ffi_cpp(const std::string &output_path);
 
@@ -56,7 +357,96 @@ public:
     const std::string &cpp_path);
 
 private:
-  LayoutMap map_;
+  // Slots [index, index + n) contíguos na memória, a partir de `first`
+  struct ScanRange {
+    char *first;
+    size_t index;
+    size_t n;
+  };
+  std::vector<ScanRange> scan_ranges(const FieldLayout &fld,
+                                     const ParallelOptions &opts);
+  void run_parallel(size_t tasks, const ParallelOptions &opts,
+                    const std::function<void(size_t)> &fn);
+
+  void validate_header(const LayoutHeader &hdr, const std::string &what) const;
+  void stamp_header();
+  void stamp_defaults(char *record) const;
+  void require_writable(const char *op) const;
+  void set_string(size_t field_idx, const void *data, size_t len);
+  char *array_slot(const FieldLayout &fld, size_t idx);
+  void ensure_mapped(size_t len);
+  void ensure_chunk(const FieldLayout &fld, size_t idx);
+  void apply_numa(size_t from, size_t to);
+  void prefault_numa(size_t from, size_t to);
+  std::vector<size_t> private_page_list() const;
+  LayoutHeader *buffer_header() const;
+  char *image() const;
+  size_t image_offset() const;
+  void log_write(WalOp op, size_t field, size_t offset, const void *data,
+                 size_t len);
+  void log_image_write(WalOp op, size_t field, size_t offset,
+                       const void *data, size_t len);
+  void log_pool_control(size_t idx);
+  void log_commit();
+  std::vector<SnapshotRange> unused_ranges() const;
+  void write_snapshot(const std::string &path) const;
+  void write_compact_header(std::ostream &out) const;
+  void write_compact_cpp(std::ostream &out) const;
+
+  std::shared_ptr<const LayoutMap> map_ = std::make_shared<const LayoutMap>();
   void *base_ptr_ = nullptr;
   size_t size_ = 0;
+  void *map_ptr_ = nullptr; // início do mapeamento (inclui controle A/B)
+  size_t map_len_ = 0;
+  EpochControl *ctrl_ = nullptr;
+  char *copies_[2] = {nullptr, nullptr};
+  char *pool_ = nullptr; // início do arquivo em modo pool
+  int pinned_ = -1;
+  bool read_only_ = false;
+  int fd_ = -1; // mantido aberto com reserva virtual (grow/remap/chunks)
+  int prot_ = 0;
+  bool populate_ = false;
+  size_t mapped_len_ = 0; // prefixo da reserva mapeado sobre o arquivo
+  NumaPolicy numa_ = NumaPolicy::Default;
+  uint64_t numa_nodes_ = 0;
+  bool numa_prefault_ = false;
+  bool numa_fields_ = false; // algum campo com numa_node
+  bool cow_ = false;          // MAP_PRIVATE sobre cow_path_
+  std::string cow_path_;
+  StartupReport startup_;
+  std::unique_ptr<WriteAheadLog> wal_;
+  std::unique_ptr<ReplicationLog> repl_;
+  SnapshotOptions snapshot_opts_;
+  CodegenOptions codegen_opts_;
+  std::unique_ptr<WorkStealingPool> scan_pool_; // criado na 1ª varredura
 };
+
+template <typename T, typename Fold, typename Combine>
+T LayoutEngine::parallel_reduce(const std::string &field_name, T identity,
+                                Fold fold, Combine combine,
+                                const ParallelOptions &opts) {
+  auto const &fld = map_->fields[map_->field_index.at(field_name)];
+  std::vector<ScanRange> ranges = scan_ranges(fld, opts);
+  // um parcial por linha de cache: sem false sharing entre tarefas e sem
+  // o empacotamento em bits de std::vector<bool> (escrita concorrente no
+  // mesmo word)
+  struct alignas(64) Partial {
+    T v;
+  };
+  std::vector<Partial> partial(ranges.size(), Partial{identity});
+  size_t skip = fld.has_used_flag ? 1 : 0;
+  run_parallel(ranges.size(), opts, [&](size_t r) {
+    ScanRange const &sr = ranges[r];
+    T acc = identity;
+    char *slot = sr.first;
+    for (size_t k = 0; k < sr.n; ++k, slot += fld.item_stride)
+      if (!skip || *slot)
+        acc = fold(std::move(acc), sr.index + k,
+                   static_cast<const void *>(slot + skip));
+    partial[r].v = std::move(acc);
+  });
+  T out = std::move(identity);
+  for (auto &p : partial)
+    out = combine(std::move(out), std::move(p.v));
+  return out;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "layout_engine.hpp"
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Conversão aplicada a um passo de cópia
+enum class CopyConv { Raw, Int32ToInt64, Float32ToFloat64, Int32ToFloat64 };
+
+struct CopyStep {
+  CopyConv conv = CopyConv::Raw;
+  size_t src_offset = 0;
+  size_t dst_offset = 0;
+  size_t len = 0; // bytes lidos da origem
+};
+
+// Bloco de passos repetido `repeat` vezes (itens de um array). Para campos
+// simples repeat = 1 e os strides são ignorados.
+struct CopyBlock {
+  std::string field;
+  size_t repeat = 1;
+  size_t src_stride = 0;
+  size_t dst_stride = 0;
+  std::vector<CopyStep> steps;
+  // Arrays: contador copiado à parte, com checagem do novo max_items
+  bool has_count = false;
+  size_t src_count_offset = 0;
+  size_t dst_count_offset = 0;
+  size_t dst_max_items = 0;
+};
+
+struct MigrationPlan {
+  std::vector<CopyBlock> blocks;
+  std::vector<std::string> added;   // campos novos (ficam zerados)
+  std::vector<std::string> dropped; // campos removidos
+};
+
+// Casa campos por nome (recursivamente em object/object[]) e lança
+// std::runtime_error para conversões que perderiam dados.
+MigrationPlan plan_migration(const LayoutMap &from, const LayoutMap &to);
+
+// Aplica o plano em uma única passada, em ordem crescente de offset de origem.
+void apply_migration(const MigrationPlan &plan, const void *src, void *dst);
+
+// Migra o arquivo de backing vivo: constrói o novo buffer ao lado
+// (<backing>.migrate), troca-o atomicamente via rename e marca o buffer
+// antigo como LAYOUT_FLAG_SUPERSEDED para os leitores anexados.
+// `from` e `to` devem estar com o layout carregado; ao final `to` fica
+// mapeado no novo buffer.
+MigrationPlan migrate_backing_file(LayoutEngine &from, LayoutEngine &to,
+                                   const std::string &backing_path);
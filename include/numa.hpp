@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Política NUMA do mapeamento (mbind via syscall, sem depender de libnuma).
+// Em arquivos do tmpfs (/dev/shm) a política fica no objeto compartilhado e
+// vale para todos os processos que o mapeiam.
+enum class NumaPolicy {
+  Default,   // first-touch do kernel
+  Bind,      // só os nós da máscara
+  Preferred, // primeiro nó da máscara, com fallback
+  Interleave // round-robin entre os nós da máscara
+};
+
+// Páginas residentes por nó (índice = nó) e páginas ainda não alocadas
+struct NumaPlacement {
+  std::vector<size_t> pages_per_node;
+  size_t not_present = 0;
+};
+
+// Aplica a política às páginas inteiramente contidas em [addr, addr+len);
+// páginas já alocadas são migradas (MPOL_MF_MOVE)
+void numa_apply(void *addr, size_t len, NumaPolicy policy, uint64_t node_mask);
+
+// set_mempolicy da thread atual enquanto o objeto existe (volta ao default
+// no destrutor). Cobre alocações que não passam por um mapeamento, como o
+// fallocate de um arquivo do tmpfs.
+class NumaThreadPolicy {
+public:
+  NumaThreadPolicy(NumaPolicy policy, uint64_t node_mask);
+  ~NumaThreadPolicy();
+  NumaThreadPolicy(const NumaThreadPolicy &) = delete;
+  NumaThreadPolicy &operator=(const NumaThreadPolicy &) = delete;
+
+private:
+  bool active_ = false;
+};
+
+// Toca cada página a partir de uma thread fixada nas CPUs de `node` (-1 =
+// sem afinidade). Em mapeamentos graváveis usa um fetch_add(0) atômico, que
+// faz write-fault sem alterar o conteúdo.
+void numa_prefault(void *addr, size_t len, int node, bool writable);
+
+// Prefault em paralelo: [addr, addr+len) em faixas contíguas alinhadas a
+// página, uma por worker (0 = hardware_concurrency). Com node_mask os
+// workers vão em round-robin para as CPUs de cada nó (first-touch local).
+// zero faz memset da faixa em vez de tocar uma vez por página.
+// Devolve o número de workers usados.
+unsigned prefault_parallel(void *addr, size_t len, unsigned threads,
+                           uint64_t node_mask, bool writable, bool zero);
+
+// Nó de cada página de [addr, addr+len) via move_pages
+NumaPlacement numa_placement(const void *addr, size_t len);
+
+// CPUs do nó (lidas de /sys/devices/system/node/node<N>/cpulist)
+std::vector<int> numa_node_cpus(int node);
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// -------------------------------
+// VARREDURA PARALELA
+// -------------------------------
+struct ParallelOptions {
+  unsigned threads = 0;         // 0 = hardware_concurrency
+  size_t task_bytes = 64 << 10; // bytes de slots por tarefa (múltiplo de 64)
+};
+
+// Pool fixo com roubo de tarefas. Cada worker começa com uma faixa contígua
+// de tarefas [lo, hi) num único word atômico e consome pelo início; quem
+// esvazia a própria faixa rouba a metade de cima da faixa de outro worker.
+// A thread que chama run() trabalha como worker 0.
+class WorkStealingPool {
+public:
+  explicit WorkStealingPool(unsigned threads = 0);
+  ~WorkStealingPool();
+  WorkStealingPool(const WorkStealingPool &) = delete;
+  WorkStealingPool &operator=(const WorkStealingPool &) = delete;
+
+  unsigned threads() const;
+  // Executa fn(t) para t em [0, tasks) e bloqueia até o fim. A primeira
+  // exceção de uma tarefa é relançada (as tarefas ainda não iniciadas são
+  // descartadas). Não reentrante.
+  void run(size_t tasks, const std::function<void(size_t)> &fn);
+  // Faixas roubadas desde a criação do pool
+  uint64_t steals() const;
+
+private:
+  struct alignas(64) Queue {
+    std::atomic<uint64_t> range{0}; // lo << 32 | hi
+  };
+  void work(unsigned self);
+  bool take(unsigned self, size_t &task);
+  bool steal(unsigned self);
+  void loop(unsigned self);
+
+  unsigned n_;
+  std::unique_ptr<Queue[]> queues_;
+  std::vector<std::thread> workers_;
+  std::mutex m_;
+  std::condition_variable start_cv_, done_cv_;
+  uint64_t generation_ = 0;
+  unsigned running_ = 0;
+  bool stop_ = false;
+  const std::function<void(size_t)> *fn_ = nullptr;
+  std::exception_ptr error_;
+  std::atomic<bool> failed_{false};
+  std::atomic<uint64_t> steals_{0};
+};
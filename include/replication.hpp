@@ -0,0 +1,192 @@
+#pragma once
+
+#include "wal.hpp"
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class LayoutEngine;
+
+// -------------------------------
+// RING DE REPLICAÇÃO (arquivo em memória compartilhada, ex.: /dev/shm)
+// -------------------------------
+// [ReplRingHeader (4096 bytes)][dados: capacity bytes, potência de 2]
+// Posições são bytes lógicos monotônicos; o byte lógico p fica em
+// p & (capacity - 1). Um lote nunca dá a volta: se não cabe até o fim da
+// área, o escritor grava REPL_WRAP_MARKER e o lote começa no byte 0.
+// Cada open do escritor recria o ring com uma nova `generation`, sem nunca
+// encolher o arquivo: seguidores ainda mapeados não tomam SIGBUS e remapeiam
+// ao ver a geração mudar.
+constexpr uint32_t REPL_RING_MAGIC = 0x4C504552; // "REPL"
+constexpr uint32_t REPL_RING_VERSION = 3;
+constexpr size_t REPL_RING_HEADER_SIZE = 4096;
+constexpr uint32_t REPL_WRAP_MARKER = 0xFFFFFFFF;
+constexpr uint16_t REPL_NO_FIELD = 0xFFFF; // escrita sem campo (compact_arena)
+
+struct ReplRingHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t capacity;
+  uint64_t fingerprint; // layout do escritor
+  uint64_t image_size;  // bytes da imagem replicada
+  uint64_t generation;  // incrementada a cada open do escritor
+
+  // Escritor. reserve avança antes de o lote ser gravado e head depois:
+  // dados em [pos, pos + len) seguem íntegros enquanto reserve <= pos + capacity
+  alignas(64) uint64_t reserve;
+  uint64_t head;
+  uint64_t seq;        // lotes publicados
+  uint64_t publish_ns; // steady_clock do último lote
+
+  // Snapshot (checkpoint do escritor): gen ímpar = gravando; head = posição
+  // do ring já refletida no arquivo
+  alignas(64) uint64_t snapshot_gen;
+  uint64_t snapshot_head;
+  char snapshot_path[256];
+
+  // Seguidor
+  alignas(64) uint64_t applied;
+  uint64_t applied_seq;
+  uint64_t applied_ns; // publish_ns do último lote aplicado
+  uint64_t resyncs;
+};
+static_assert(sizeof(ReplRingHeader) <= REPL_RING_HEADER_SIZE,
+              "ReplRingHeader maior que a página de cabeçalho");
+
+// Lote: cabeçalho + registros (ReplRecordHeader + payload), com padding
+// até múltiplo de 8
+struct ReplBatchHeader {
+  uint32_t len; // bytes do lote, cabeçalho e padding incluídos
+  uint32_t records;
+  uint64_t seq;
+  uint64_t publish_ns;
+};
+
+#pragma pack(push, 1)
+struct ReplRecordHeader {
+  uint64_t offset; // destino dentro da imagem (como no WAL)
+  uint64_t len;    // bytes de payload
+  uint16_t field;  // índice do campo no LayoutMap ou REPL_NO_FIELD
+  uint8_t op;      // WalOp
+};
+#pragma pack(pop)
+
+struct ReplOptions {
+  size_t ring_bytes = 16 << 20;   // área de dados (arredondada p/ potência de 2)
+  size_t batch_bytes = 64 * 1024; // publica ao atingir este tamanho
+  uint32_t flush_interval_ms = 1; // 0 = publica a cada commit
+  std::string snapshot_path;      // se não vazio: checkpoint inicial
+};
+
+// Atraso do seguidor em relação ao escritor
+struct ReplLag {
+  uint64_t bytes = 0;   // head - applied
+  uint64_t batches = 0; // seq - applied_seq
+  uint64_t ns = 0;      // idade do último lote aplicado frente ao mais novo
+  uint64_t resyncs = 0; // ressincronizações completas pelo snapshot
+};
+
+ReplLag repl_lag(const ReplRingHeader &hdr);
+
+// Lado do escritor: acumula as escritas físicas de cada operação lógica e
+// publica lotes no ring sem nunca esperar pelo seguidor (quem fica para trás
+// se ressincroniza pelo snapshot).
+class ReplicationLog {
+public:
+  ReplicationLog() = default;
+  ~ReplicationLog();
+
+  ReplicationLog(const ReplicationLog &) = delete;
+  ReplicationLog &operator=(const ReplicationLog &) = delete;
+
+  void open(const std::string &ring_path, uint64_t fingerprint,
+            size_t image_size, const ReplOptions &opts = {});
+  void close();
+  bool is_open() const { return hdr_ != nullptr; }
+  const ReplOptions &options() const { return opts_; }
+
+  void append(WalOp op, uint16_t field, size_t offset, const void *data,
+              size_t len);
+  void commit(); // fim de uma operação lógica
+  void flush();  // publica o que já foi commitado
+
+  // checkpoint(): begin publica o pendente e marca a geração; end grava a
+  // posição refletida no snapshot (ou restaura a anterior se falhou)
+  void begin_snapshot(const std::string &path);
+  void end_snapshot(bool ok);
+
+  ReplLag lag() const;
+
+private:
+  void publish_locked();
+  void flusher_loop();
+
+  ReplRingHeader *hdr_ = nullptr;
+  char *data_ = nullptr;
+  size_t capacity_ = 0;
+  size_t map_len_ = 0; // arquivo inteiro (pode exceder a capacidade atual)
+  ReplOptions opts_;
+  std::vector<char> pending_;
+  size_t committed_ = 0; // bytes de pending_ em operações completas
+  uint32_t committed_records_ = 0;
+  uint32_t open_records_ = 0;
+  uint64_t head_ = 0;
+  uint64_t seq_ = 0;
+  uint64_t prev_snapshot_head_ = 0;
+  std::string prev_snapshot_path_;
+  std::mutex mtx_;
+  std::condition_variable cv_;
+  std::thread flusher_;
+  bool stop_ = false;
+};
+
+struct FollowerOptions {
+  std::string snapshot_path;       // vazio = caminho gravado pelo escritor
+  uint32_t resync_interval_ms = 0; // > 0: ressincroniza periodicamente
+                                   // quando há snapshot novo
+};
+
+// Lado do seguidor: aplica os lotes do ring sobre a imagem de outra engine
+// (mesmo layout, mapeamento próprio). Um seguidor por ring.
+class ReplicaFollower {
+public:
+  ReplicaFollower(LayoutEngine &replica, const std::string &ring_path,
+                  const FollowerOptions &opts = {});
+  ~ReplicaFollower();
+
+  ReplicaFollower(const ReplicaFollower &) = delete;
+  ReplicaFollower &operator=(const ReplicaFollower &) = delete;
+
+  // Aplica até max_batches lotes; ressincroniza se ficou mais de uma volta
+  // para trás. Devolve os lotes aplicados.
+  size_t poll(size_t max_batches = SIZE_MAX);
+  // Recarrega o último snapshot e segue do ponto registrado nele
+  bool resync();
+  bool synced() const { return synced_; }
+  uint64_t position() const { return pos_; }
+  ReplLag lag() const;
+
+private:
+  bool map_ring();
+  bool intact(uint64_t pos) const;
+  void apply(const char *batch, size_t len);
+
+  LayoutEngine &engine_;
+  FollowerOptions opts_;
+  std::string ring_path_;
+  uint64_t generation_ = 0;
+  ReplRingHeader *hdr_ = nullptr;
+  const char *data_ = nullptr;
+  size_t capacity_ = 0;
+  size_t map_len_ = 0;
+  uint64_t pos_ = 0;
+  uint64_t snapshot_gen_ = 0;
+  uint64_t last_resync_ns_ = 0;
+  bool synced_ = false;
+  std::vector<char> buf_;
+};
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+// -------------------------------
+// SNAPSHOT COMPRIMIDO
+// -------------------------------
+// [SnapshotFileHeader][SnapshotBlock x blocks][payloads]
+// A imagem é dividida em blocos de block_bytes; cada bloco é gravado
+// comprimido, cru ou omitido (só zeros). Snapshots crus continuam sendo a
+// imagem byte a byte (começam pelo LayoutHeader): a leitura detecta o
+// formato pelo magic.
+constexpr uint32_t SNAPSHOT_MAGIC = 0x5A534C52; // "RLSZ"
+constexpr uint32_t SNAPSHOT_VERSION = 1;
+
+struct SnapshotFileHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t fingerprint;
+  uint64_t image_size;
+  uint64_t block_bytes;
+  uint64_t blocks;
+};
+
+enum class SnapshotBlockKind : uint32_t { Stored = 0, Lz = 1, Zero = 2 };
+
+struct SnapshotBlock {
+  uint64_t file_offset;
+  uint32_t stored_len;
+  uint32_t kind; // SnapshotBlockKind
+};
+
+struct SnapshotOptions {
+  bool compress = false;    // blocos LZ em paralelo
+  bool skip_unused = false; // slots livres e cauda da arena saem como zeros
+  size_t block_bytes = 1 << 20;
+  unsigned threads = 0;     // 0 = hardware_concurrency
+};
+
+// Trecho da imagem sem conteúdo vivo (restaurado como zeros)
+struct SnapshotRange {
+  size_t offset;
+  size_t len;
+};
+
+// Grava a imagem em `path` (tmp + fsync + rename). Sem compress nem
+// skip_unused o arquivo é a imagem crua; `unused` deve estar ordenado.
+void snapshot_write(const std::string &path, const char *image, size_t size,
+                    uint64_t fingerprint,
+                    const std::vector<SnapshotRange> &unused,
+                    const SnapshotOptions &opts);
+
+// Lê um snapshot cru ou comprimido direto em `image`. `validate` recebe os
+// primeiros bytes da imagem (LayoutHeader) antes de qualquer escrita.
+// Devolve false se o arquivo não existe.
+bool snapshot_read(const std::string &path, char *image, size_t size,
+                   uint64_t fingerprint, unsigned threads,
+                   const std::function<void(const char *)> &validate);
+
+// Compressão LZ de bloco (sequências literal + match no estilo LZ4, offset
+// de 16 bits). lz_decompress lança em entrada corrompida.
+size_t lz_compress_bound(size_t n);
+size_t lz_compress(const char *src, size_t n, char *dst);
+void lz_decompress(const char *src, size_t n, char *dst, size_t out_len);
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+struct LayoutMap;
+
+// Seção opcional de estatísticas no fim do buffer: `stats_slots` blocos (um
+// por CPU, slot = sched_getcpu() % slots) com um FieldStats por campo de topo.
+// Contadores usam atômicos relaxed; cada FieldStats ocupa uma linha de cache.
+constexpr size_t DEFAULT_STATS_SLOTS = 16;
+// A CPU fica em cache por thread e é relida a cada N atualizações: depois de
+// migrar, a thread conta no slot antigo por no máximo N - 1 atualizações
+constexpr unsigned STATS_CPU_REFRESH = 64;
+
+struct alignas(64) FieldStats {
+  uint64_t inserts;
+  uint64_t pops;
+  uint64_t full_rejections;
+  uint64_t writes;
+  uint64_t max_occupancy;
+  uint64_t last_write_ns; // CLOCK_REALTIME_COARSE
+};
+static_assert(sizeof(FieldStats) == 64, "FieldStats deve ocupar 64 bytes");
+
+// Slot da CPU em que a thread rodou na última releitura (STATS_CPU_REFRESH)
+size_t stats_slot(size_t slots);
+uint64_t stats_now_ns();
+
+// Entrada do campo `field_idx` no slot da thread atual
+FieldStats *stats_entry(const LayoutMap &map, void *base, size_t field_idx);
+
+void stats_on_insert(FieldStats *s, uint64_t occupancy);
+void stats_on_pop(FieldStats *s);
+void stats_on_full(FieldStats *s);
+void stats_on_write(FieldStats *s);
+
+// Soma dos slots (max para max_occupancy/last_write_ns)
+FieldStats stats_aggregate(const LayoutMap &map, const void *base,
+                           size_t field_idx);
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Tipos de operação registrados no log (apenas diagnóstico: o replay é
+// sempre físico, offset + bytes). Commit é o marcador sem payload gravado
+// por commit() no fim de cada operação lógica.
+enum class WalOp : uint8_t {
+  Insert = 1,
+  Pop = 2,
+  Set = 3,
+  Count = 4,
+  Commit = 5
+};
+
+struct WalOptions {
+  size_t batch_bytes = 64 * 1024; // lote em memória antes de um write()
+  uint32_t fsync_interval_ms = 5; // 0 = fsync síncrono a cada commit
+};
+
+// Início do arquivo de WAL, gravado antes do primeiro registro. A versão 1
+// (sem cabeçalho, offset/len de 32 bits) não é mais lida.
+constexpr uint32_t WAL_MAGIC = 0x4C574C52; // "RLWL"
+constexpr uint32_t WAL_VERSION = 2;
+
+struct WalFileHeader {
+  uint32_t magic;
+  uint32_t version;
+};
+
+// Cabeçalho de cada registro no arquivo de WAL
+#pragma pack(push, 1)
+struct WalRecordHeader {
+  uint32_t crc;    // crc32 de (len, offset, op, payload)
+  uint64_t len;    // bytes de payload
+  uint64_t offset; // offset do destino dentro da imagem (pool > 4 GiB)
+  uint8_t op;      // WalOp
+};
+#pragma pack(pop)
+
+// Log append-only de escritas físicas sobre o buffer mapeado.
+// Os registros são acumulados em memória e gravados em lote; o fsync é
+// feito em group commit por uma thread dedicada a cada fsync_interval_ms.
+class WriteAheadLog {
+public:
+  WriteAheadLog() = default;
+  ~WriteAheadLog();
+
+  WriteAheadLog(const WriteAheadLog &) = delete;
+  WriteAheadLog &operator=(const WriteAheadLog &) = delete;
+
+  void open(const std::string &path, const WalOptions &opts = {});
+  void close();
+  bool is_open() const { return fd_ >= 0; }
+
+  void append(WalOp op, size_t offset, const void *data, size_t len);
+  void commit(); // fim de uma operação lógica (grava o marcador Commit)
+  void sync();   // write + fdatasync imediato
+  void truncate();
+
+  // Reaplica os registros válidos de `path` sobre `base`, uma operação
+  // inteira por vez: os registros ficam retidos até o marcador Commit e são
+  // descartados se o log acabar antes dele. Para no primeiro registro
+  // truncado ou corrompido (cauda de um crash).
+  static size_t replay(const std::string &path, void *base, size_t size);
+
+private:
+  void write_pending_locked();
+  void flusher_loop();
+
+  int fd_ = -1;
+  WalOptions opts_;
+  std::vector<char> pending_;
+  bool dirty_ = false; // dados gravados ainda sem fdatasync
+  std::mutex mtx_;
+  std::condition_variable cv_;
+  std::thread flusher_;
+  bool stop_ = false;
+};
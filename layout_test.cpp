@@ -1,12 +1,27 @@
 // test_layout.cpp
 #include "compile/layout_ffi.hpp"
+#include "arrow_export.hpp"
+#include "json_io.hpp"
+#include "layout_engine.hpp"
+#include "migrate.hpp"
+#include "snapshot.hpp"
+#include "stats.hpp"
+#include <flatbuffers/flatbuffers.h>
+#include <algorithm>
 #include <cassert>
 #include <cmath>
+#include <cstdio>
 #include <cstring>
 #include <fstream>
 #include <iostream>
+#include <iterator>
+#include <string>
+#include <thread>
 #include <vector>
 
+#include <sched.h>
+#include <sys/mman.h>
+
 int main() {
   constexpr const char *backing = "/tmp/layout_test.buf";
 
@@ -25,6 +40,11 @@ int main() {
     return 1;
   }
 
+  // Buffer novo já vem com os "default" do layout.json
+  assert(get_config_active() == 1);
+  assert(std::fabs(get_config_threshold() - 0.5f) < 1e-6f);
+  assert(get_id() == 0);
+
   // 3) Teste de campo escalar
   set_balance(55.5);
   assert(std::fabs(get_balance() - 55.5) < 1e-6);
@@ -34,8 +54,15 @@ int main() {
 
   // 4) Teste de string
   const char *hello = "olá";
-  set_name(hello);
-  assert(std::strcmp(get_name(), hello) == 0);
+  set_name(hello, std::strlen(hello));
+  assert(get_name() == hello);
+  assert(get_name().data()[get_name().size()] == '\0');
+  // valor acima de name_MAX_LEN - 1 é truncado
+  std::string longo(name_MAX_LEN + 10, 'x');
+  set_name(longo.data(), longo.size());
+  assert(get_name().size() == name_MAX_LEN - 1);
+  set_name(hello, std::strlen(hello));
+  assert(get_name() == hello);
 
   // 5) Teste de array orders
   set_orders_count(0);
@@ -50,7 +77,918 @@ int main() {
   assert(std::fabs(get_orders_price(0) - 9.87) < 1e-9);
   assert(get_orders_side(0) == 1);
 
-  // 6) Se tudo passou:
+  // 5b) Range de itens vivos: set_orders_count marca os slots novos como
+  // vivos; pop zera a flag e o range pula o slot
+  {
+    for (std::size_t i = 1; i < 12; ++i)
+      set_orders_price(i, 10.0 * i);
+    set_orders_count(12);
+    pop_orders(1);
+    pop_orders(9);
+    auto live = orders_range();
+    assert(std::distance(live.begin(), live.end()) == 10);
+    assert(std::none_of(live.begin(), live.end(),
+                        [](const orders &o) { return o.price == 90.0; }));
+    auto it = std::find_if(live.begin(), live.end(),
+                           [](const orders &o) { return o.price > 9.87; });
+    assert(it != live.end() && it->price == 20.0);
+    set_orders_count(1);
+    assert(std::distance(live.begin(), live.end()) == 1);
+  }
+
+  // 6) Header: buffer construído com outro layout é rejeitado
+  {
+    constexpr const char *other = "/tmp/layout_test_other.buf";
+    std::vector<char> bytes(OFFSET_TOTAL_SIZE, 0);
+    layout_header hdr{HEADER_MAGIC, HEADER_VERSION, HEADER_SIZE,
+                      LAYOUT_FINGERPRINT ^ 1, OFFSET_TOTAL_SIZE, 0};
+    std::memcpy(bytes.data(), &hdr, sizeof(hdr));
+    std::ofstream(other, std::ios::binary).write(bytes.data(), bytes.size());
+    bool rejected = false;
+    try {
+      init_layout_buffer(other);
+    } catch (const std::exception &) {
+      rejected = true;
+    }
+    assert(rejected);
+    assert(get_id() == 1234); // mapeamento anterior continua ativo
+  }
+
+  // 7) Somente leitura: anexa o mesmo buffer sem criar/redimensionar
+  {
+    init_layout_buffer_readonly(backing, 1);
+    assert(get_id() == 1234);
+    assert(get_orders_count() == 1);
+    bool rejected = false;
+    try {
+      init_layout_buffer_readonly("/tmp/layout_test_missing.buf", 0);
+    } catch (const std::exception &) {
+      rejected = true;
+    }
+    assert(rejected);
+  }
+
+  // 8) Instâncias independentes via layout_ctx
+  {
+    const char *paths[] = {"/tmp/layout_test_ctx0.buf",
+                           "/tmp/layout_test_ctx1.buf"};
+    layout_ctx *ctx[2];
+    for (int i = 0; i < 2; ++i) {
+      std::ofstream(paths[i], std::ios::binary | std::ios::trunc);
+      ctx[i] = layout_open(paths[i], 0, 0);
+      ctx_set_id(ctx[i], 100 + i);
+      ctx_set_orders_price(ctx[i], 0, 1.5 * i);
+      ctx_set_orders_count(ctx[i], 1);
+    }
+    assert(ctx_get_id(ctx[0]) == 100 && ctx_get_id(ctx[1]) == 101);
+    assert(ctx_get_config_active(ctx[1]) == 1);
+    assert(std::fabs(ctx_get_orders_price(ctx[1], 0) - 1.5) < 1e-9);
+    assert(get_id() == 1234); // contexto padrão não é afetado
+    assert(ctx_get_id(layout_default_ctx()) == 1234);
+    for (auto *c : ctx)
+      layout_close(c);
+  }
+
+  // 9) WAL cortado em qualquer byte: o replay só aplica operações inteiras,
+  // então count e itens continuam consistentes
+  {
+    const std::string buf = "/tmp/layout_test_wal.buf",
+                      snap = "/tmp/layout_test_wal.snap",
+                      wal = "/tmp/layout_test_wal.log",
+                      cut = "/tmp/layout_test_wal_cut.log",
+                      cut_snap = "/tmp/layout_test_wal_cut.snap";
+    for (auto &p : {buf, snap, wal})
+      std::remove(p.c_str());
+    LayoutEngine e;
+    e.build_layout(nlohmann::json::parse(R"({
+      "id": {"type": "int32"},
+      "orders": {"type": "object[]", "max_items": 8,
+                 "schema": {"price": "float64", "side": "int32"}}
+    })"));
+    e.allocate_memory_from_file(buf);
+    e.enable_wal(wal, {64, 1000}); // lote pequeno: flush no meio de operações
+    e.checkpoint(snap);
+    auto const &orders = e.get_layout().fields[e.get_layout().field_index.at("orders")];
+    std::vector<char> item(orders.item_stride - 1);
+    for (int k = 0; k < 4; ++k) {
+      std::fill(item.begin(), item.end(), char(k + 1));
+      e.insert("orders", item.data());
+      int32_t id = k + 1;
+      e.set("id", &id);
+    }
+    e.pop("orders", 1);
+    e.sync_wal();
+
+    std::ifstream in(wal, std::ios::binary);
+    std::string log((std::istreambuf_iterator<char>(in)),
+                    std::istreambuf_iterator<char>());
+    std::ifstream sin(snap, std::ios::binary);
+    std::string base((std::istreambuf_iterator<char>(sin)),
+                     std::istreambuf_iterator<char>());
+    LayoutEngine r(e.shared_layout());
+    std::remove("/tmp/layout_test_wal_r.buf");
+    r.allocate_memory_from_file("/tmp/layout_test_wal_r.buf");
+    uint32_t last = 0;
+    for (size_t n = 0; n <= log.size(); ++n) {
+      std::ofstream(cut_snap, std::ios::binary | std::ios::trunc) << base;
+      std::ofstream(cut, std::ios::binary | std::ios::trunc)
+          .write(log.data(), n);
+      r.recover(cut_snap, cut);
+      uint32_t cnt = *static_cast<uint32_t *>(
+          static_cast<void *>(static_cast<char *>(r.mmap_base()) +
+                              orders.count_offset));
+      int32_t id = *static_cast<int32_t *>(r.get("id"));
+      // cada insert é seguido do set de id = número de itens
+      assert(id == int32_t(cnt) || id + 1 == int32_t(cnt));
+      assert(cnt >= last && cnt <= 4);
+      last = cnt;
+      for (uint32_t k = 0; k < orders.max_items; ++k) {
+        auto *slot = static_cast<char *>(r.mmap_base()) + orders.offset + 4 +
+                     k * orders.item_stride;
+        if (k >= cnt) {
+          assert(slot[0] == 0 && slot[1] == 0);
+        } else if (slot[0]) {
+          assert(std::all_of(slot + 1, slot + orders.item_stride,
+                             [&](char c) { return c == char(k + 1); }));
+        } else {
+          assert(k == 1); // só o item removido pelo pop
+        }
+      }
+    }
+    assert(last == 4 && r.get("orders", 1) == nullptr);
+  }
+
+  // 10) Arena: valor vazio continua "" depois de compact_arena
+  {
+    const char *path = "/tmp/layout_test_arena.buf";
+    std::remove(path);
+    LayoutEngine e;
+    e.build_layout(nlohmann::json::parse(R"({
+      "a": {"type": "varstring"},
+      "b": {"type": "varstring"}
+    })"));
+    e.allocate_memory_from_file(path);
+    assert(std::strcmp(static_cast<char *>(e.get("a")), "") == 0);
+    e.set_bytes("a", "", 0);
+    e.set_bytes("b", "xyz", 3);
+    e.set_bytes("b", "abc", 3);
+    e.compact_arena();
+    assert(std::strcmp(static_cast<char *>(e.get("a")), "") == 0);
+    assert(std::strcmp(static_cast<char *>(e.get("b")), "abc") == 0);
+    assert(e.get_bytes("a").empty() && e.get_bytes("b") == "abc");
+  }
+
+  // 11) parallel_reduce: tarefas pequenas (várias por word) com parcial
+  // bool ("any") e soma
+  {
+    const char *path = "/tmp/layout_test_reduce.buf";
+    std::remove(path);
+    LayoutEngine e;
+    e.build_layout(nlohmann::json::parse(R"({
+      "vals": {"type": "object[]", "max_items": 4096,
+               "schema": {"v": "int32"}}
+    })"));
+    e.allocate_memory_from_file(path);
+    for (int32_t i = 0; i < 4096; ++i)
+      e.insert("vals", &i);
+    e.pop("vals", 3000);
+    ParallelOptions opts;
+    opts.threads = 4;
+    opts.task_bytes = 64;
+    auto any_of = [&](int32_t want) {
+      return e.parallel_reduce(
+          "vals", false,
+          [want](bool acc, std::size_t, const void *p) {
+            return acc || *static_cast<const int32_t *>(p) == want;
+          },
+          [](bool a, bool b) { return a || b; }, opts);
+    };
+    for (int round = 0; round < 50; ++round)
+      assert(any_of(4095) && any_of(0) && !any_of(3000) && !any_of(-1));
+    long long sum = e.parallel_reduce(
+        "vals", 0LL,
+        [](long long acc, std::size_t, const void *p) {
+          return acc + *static_cast<const int32_t *>(p);
+        },
+        [](long long a, long long b) { return a + b; }, opts);
+    assert(sum == 4095LL * 4096 / 2 - 3000);
+    std::remove(path);
+  }
+
+  // 12) Pool com WAL: claim/release entram no log (registro carimbado,
+  // word do bitmap e contador), então o recover não devolve ao pool uma
+  // instância cujos dados foram reaplicados
+  {
+    const std::string buf = "/tmp/layout_test_pool.buf",
+                      rbuf = "/tmp/layout_test_pool_r.buf",
+                      snap = "/tmp/layout_test_pool.snap",
+                      wal = "/tmp/layout_test_pool.log";
+    for (auto &p : {buf, rbuf, snap, wal})
+      std::remove(p.c_str());
+    LayoutOptions lo;
+    lo.pool_instances = 4;
+    LayoutEngine e;
+    e.build_layout(nlohmann::json::parse(R"({"x": {"type": "int32"}})"), lo);
+    e.allocate_memory_from_file(buf);
+    e.enable_wal(wal);
+    e.checkpoint(snap);
+    std::size_t a = e.claim_instance(), b = e.claim_instance();
+    e.select_instance(b);
+    int32_t x = 42;
+    e.set("x", &x);
+    e.release_instance(a);
+    e.sync_wal();
+
+    LayoutEngine r(e.shared_layout());
+    r.allocate_memory_from_file(rbuf);
+    r.recover(snap, wal);
+    assert(!r.instance_in_use(a) && r.instance_in_use(b));
+    assert(r.claim_instance() == a);
+    r.select_instance(b);
+    assert(*static_cast<int32_t *>(r.get("x")) == 42);
+    for (auto &p : {buf, rbuf, snap, wal})
+      std::remove(p.c_str());
+  }
+
+  // 13) WAL com offset acima de 4 GiB: o registro volta no mesmo lugar
+  // (imagem anônima esparsa, só as páginas tocadas são alocadas)
+  {
+    const std::string wal = "/tmp/layout_test_wal64.log";
+    std::remove(wal.c_str());
+    const std::size_t size = std::size_t(5) << 30,
+                      far = (std::size_t(1) << 32) + 64;
+    void *img = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    assert(img != MAP_FAILED);
+    {
+      WriteAheadLog w;
+      w.open(wal, {64, 0});
+      w.append(WalOp::Set, far, "abc", 3);
+      w.commit();
+    }
+    assert(WriteAheadLog::replay(wal, img, size) == 1);
+    char *p = static_cast<char *>(img);
+    assert(std::memcmp(p + far, "abc", 3) == 0 && p[64] == 0);
+    munmap(img, size);
+    std::remove(wal.c_str());
+  }
+
+  // 14) Replicação: lotes que dão a volta no fim do ring, seguidor atrasado
+  // mais de uma volta (só o snapshot recupera) e escritor reabrindo com
+  // ring menor (seguidor remapeia pela nova geração)
+  {
+    const std::string buf = "/tmp/layout_test_repl.buf",
+                      rbuf = "/tmp/layout_test_repl_r.buf",
+                      ring = "/tmp/layout_test_repl.ring",
+                      snap = "/tmp/layout_test_repl.snap";
+    for (auto &p : {buf, rbuf, ring, snap})
+      std::remove(p.c_str());
+    LayoutEngine e;
+    e.build_layout(nlohmann::json::parse(R"({"x": {"type": "int32"}})"));
+    e.allocate_memory_from_file(buf);
+    ReplOptions ro;
+    ro.ring_bytes = 16384;
+    ro.batch_bytes = 1024;
+    ro.flush_interval_ms = 0; // um lote por operação
+    ro.snapshot_path = snap;
+    e.enable_replication(ring, ro);
+
+    LayoutEngine r(e.shared_layout());
+    r.allocate_memory_from_file(rbuf);
+    ReplicaFollower f(r, ring);
+    auto x_of = [](LayoutEngine &eng) {
+      return *static_cast<int32_t *>(eng.get("x"));
+    };
+    int32_t x = 0;
+    auto write = [&](int n) {
+      for (int k = 0; k < n; ++k) {
+        ++x;
+        e.set("x", &x);
+      }
+    };
+
+    // lotes de 48 bytes não dividem o ring: várias voltas com marcador
+    for (int round = 0; round < 40; ++round) {
+      write(50);
+      f.poll();
+      assert(f.synced() && x_of(r) == x);
+    }
+    assert(f.position() > 4 * 16384 && f.lag().resyncs == 1);
+
+    // mais de uma volta sem poll: sem checkpoint novo não há como seguir
+    write(1000);
+    assert(f.poll() == 0 && !f.synced() && x_of(r) != x);
+    e.checkpoint(snap);
+    f.poll();
+    assert(f.synced() && x_of(r) == x && f.lag().resyncs == 2);
+    write(10);
+    assert(f.poll() == 10 && x_of(r) == x);
+
+    // escritor reabre com ring menor: o arquivo não encolhe e o seguidor
+    // recomeça pelo snapshot da nova geração
+    ro.ring_bytes = 4096;
+    e.enable_replication(ring, ro);
+    write(5);
+    f.poll();
+    assert(f.synced() && x_of(r) == x);
+    for (int round = 0; round < 20; ++round) {
+      write(20);
+      f.poll();
+      assert(x_of(r) == x);
+    }
+    for (auto &p : {buf, rbuf, ring, snap})
+      std::remove(p.c_str());
+  }
+
+  // 15) A/B: leitor fixado na cópia de trás faz begin_write lançar depois
+  // do timeout em vez de travar; WAL não combina com o modo
+  {
+    const std::string buf = "/tmp/layout_test_ab.buf";
+    std::remove(buf.c_str());
+    MapOptions mo;
+    mo.double_buffered = true;
+    LayoutEngine w;
+    w.build_layout(nlohmann::json::parse(R"({"x": {"type": "int32"}})"));
+    w.allocate_memory_from_file(buf, mo);
+    LayoutEngine rd(w.shared_layout());
+    rd.allocate_memory_from_file(buf, mo);
+    bool threw = false;
+    try {
+      w.enable_wal("/tmp/layout_test_ab.log");
+    } catch (const std::runtime_error &) {
+      threw = true;
+    }
+    assert(threw);
+
+    rd.pin_epoch(); // cópia da frente; vira a de trás após o publish
+    w.begin_write(true);
+    w.publish();
+    threw = false;
+    try {
+      w.begin_write(true, 20);
+    } catch (const std::runtime_error &) {
+      threw = true;
+    }
+    assert(threw);
+    rd.unpin_epoch();
+    w.begin_write(true, 20);
+    w.publish();
+    std::remove(buf.c_str());
+  }
+
+  // 16) Migração: conversões que alargam, string que cresce, array que
+  // encolhe abaixo do contador e caminho vivo inexistente
+  {
+    const std::string buf = "/tmp/layout_test_migrate.buf";
+    std::remove(buf.c_str());
+    std::remove((buf + ".migrate").c_str());
+    auto from_json = nlohmann::json::parse(R"({
+      "a": {"type": "int32"}, "b": {"type": "float32"},
+      "c": {"type": "int32"}, "s": {"type": "string", "max_length": 8},
+      "orders": {"type": "object[]", "max_items": 8, "schema": {"p": "int32"}}
+    })");
+    auto to_json = nlohmann::json::parse(R"({
+      "a": {"type": "int64"}, "b": {"type": "float64"},
+      "c": {"type": "float64"}, "s": {"type": "string", "max_length": 32},
+      "orders": {"type": "object[]", "max_items": 4, "schema": {"p": "float64"}}
+    })");
+    LayoutEngine from, to;
+    from.build_layout(from_json);
+    to.build_layout(to_json);
+
+    // caminho inexistente: lança sem criar o arquivo
+    bool threw = false;
+    try {
+      migrate_backing_file(from, to, buf);
+    } catch (const std::runtime_error &) {
+      threw = true;
+    }
+    assert(threw);
+    assert(std::ifstream(buf).fail());
+    // arquivo vazio (sem header) também é recusado
+    std::ofstream(buf, std::ios::binary | std::ios::trunc).close();
+    threw = false;
+    try {
+      migrate_backing_file(from, to, buf);
+    } catch (const std::runtime_error &) {
+      threw = true;
+    }
+    assert(threw);
+    std::remove(buf.c_str());
+
+    // string que encolhe e conversão que estreita são recusadas no plano
+    {
+      LayoutEngine narrow;
+      narrow.build_layout(nlohmann::json::parse(R"({
+        "a": {"type": "int32"}, "s": {"type": "string", "max_length": 4}
+      })"));
+      threw = false;
+      try {
+        plan_migration(from.get_layout(), narrow.get_layout());
+      } catch (const std::runtime_error &) {
+        threw = true;
+      }
+      assert(threw);
+      threw = false;
+      try {
+        plan_migration(to.get_layout(), from.get_layout());
+      } catch (const std::runtime_error &) {
+        threw = true;
+      }
+      assert(threw);
+    }
+
+    // 6 itens não cabem em max_items 4: lança e o buffer vivo fica
+    {
+      LayoutEngine big(from.shared_layout());
+      big.allocate_memory_from_file(buf);
+      for (int32_t p : {1, 2, 3, 4, 5, 6})
+        big.insert("orders", &p);
+      threw = false;
+      try {
+        migrate_backing_file(big, to, buf);
+      } catch (const std::runtime_error &) {
+        threw = true;
+      }
+      assert(threw);
+      assert(*static_cast<int32_t *>(big.get("orders", 5)) == 6);
+    }
+    std::remove(buf.c_str());
+    std::remove((buf + ".migrate").c_str());
+
+    int32_t a = -5, c = 7;
+    float b = 1.25f;
+    from.allocate_memory_from_file(buf);
+    from.set("a", &a);
+    from.set("b", &b);
+    from.set("c", &c);
+    from.set("s", "abcdefg");
+    for (int32_t p : {10, 20, 30})
+      from.insert("orders", &p);
+    auto plan = migrate_backing_file(from, to, buf);
+    assert(plan.added.empty() && plan.dropped.empty());
+    assert(*static_cast<int64_t *>(to.get("a")) == -5);
+    assert(*static_cast<double *>(to.get("b")) == 1.25);
+    assert(*static_cast<double *>(to.get("c")) == 7.0);
+    assert(std::string(static_cast<char *>(to.get("s"))) == "abcdefg");
+    for (size_t i = 0; i < 3; ++i)
+      assert(*static_cast<double *>(to.get("orders", i)) == 10.0 * (i + 1));
+    assert(to.get("orders", 3) == nullptr);
+    // a string nova aceita o comprimento maior
+    to.set("s", "abcdefghijklmnopqrstuvwxyz");
+    assert(std::string(static_cast<char *>(to.get("s"))) ==
+           "abcdefghijklmnopqrstuvwxyz");
+    std::remove(buf.c_str());
+  }
+
+  // 17) Snapshot comprimido + skip_unused: checkpoint de um object[]
+  // parcialmente ocupado volta igual pelo restore; bloco LZ corrompido lança
+  {
+    const std::string buf = "/tmp/layout_test_snap.buf";
+    const std::string buf2 = "/tmp/layout_test_snap2.buf";
+    const std::string snap = "/tmp/layout_test_snap.snap";
+    for (auto const &f : {buf, buf2, snap})
+      std::remove(f.c_str());
+#pragma pack(push, 1)
+    struct item {
+      int32_t k;
+      double v;
+    };
+#pragma pack(pop)
+    auto js = nlohmann::json::parse(R"({
+      "n": {"type": "int64"},
+      "items": {"type": "object[]", "max_items": 2048,
+                "schema": {"k": "int32", "v": "float64"}}
+    })");
+    SnapshotOptions so;
+    so.compress = true;
+    so.skip_unused = true;
+    so.block_bytes = 4096;
+    LayoutEngine w;
+    w.build_layout(js);
+    w.allocate_memory_from_file(buf);
+    w.set_snapshot_options(so);
+    int64_t n = 123456789;
+    w.set("n", &n);
+    for (int32_t i = 0; i < 600; ++i) {
+      item it{i, i * 0.5};
+      w.insert("items", &it);
+    }
+    for (size_t i = 0; i < 600; i += 3)
+      w.pop("items", i);
+    w.checkpoint(snap);
+
+    LayoutEngine r(w.shared_layout());
+    r.allocate_memory_from_file(buf2);
+    r.set_snapshot_options(so);
+    assert(r.restore_snapshot(snap));
+    assert(*static_cast<int64_t *>(r.get("n")) == n);
+    for (size_t i = 0; i < 600; ++i) {
+      auto *it = static_cast<item *>(r.get("items", i));
+      if (i % 3 == 0) {
+        assert(it == nullptr);
+        continue;
+      }
+      assert(it && it->k == static_cast<int32_t>(i) && it->v == i * 0.5);
+    }
+    assert(r.get("items", 600) == nullptr);
+
+    // Bloco LZ depois do primeiro com token 0 e offset 0: inválido
+    std::vector<char> file;
+    {
+      std::ifstream in(snap, std::ios::binary);
+      file.assign(std::istreambuf_iterator<char>(in),
+                  std::istreambuf_iterator<char>());
+    }
+    SnapshotFileHeader fh;
+    memcpy(&fh, file.data(), sizeof(fh));
+    assert(fh.magic == SNAPSHOT_MAGIC && fh.block_bytes == 4096);
+    assert(file.size() < w.get_layout().total_size);
+    size_t corrupted = 0;
+    for (size_t b = 1; b < fh.blocks && !corrupted; ++b) {
+      SnapshotBlock sb;
+      memcpy(&sb, file.data() + sizeof(fh) + b * sizeof(sb), sizeof(sb));
+      if (sb.kind != static_cast<uint32_t>(SnapshotBlockKind::Lz))
+        continue;
+      assert(sb.stored_len >= 3);
+      memset(file.data() + sb.file_offset, 0, 3);
+      corrupted = b;
+    }
+    assert(corrupted);
+    std::ofstream(snap, std::ios::binary | std::ios::trunc)
+        .write(file.data(), file.size());
+    bool threw = false;
+    try {
+      r.restore_snapshot(snap);
+    } catch (const std::runtime_error &e) {
+      threw = std::string(e.what()).find("LZ") != std::string::npos;
+    }
+    assert(threw);
+
+    // Direto: stream truncado também lança
+    std::vector<char> raw(4096), lz(lz_compress_bound(raw.size())),
+        out(raw.size());
+    for (size_t i = 0; i < raw.size(); ++i)
+      raw[i] = static_cast<char>(i % 7);
+    size_t lz_len = lz_compress(raw.data(), raw.size(), lz.data());
+    lz_decompress(lz.data(), lz_len, out.data(), out.size());
+    assert(out == raw);
+    threw = false;
+    try {
+      lz_decompress(lz.data(), lz_len - 1, out.data(), out.size());
+    } catch (const std::runtime_error &) {
+      threw = true;
+    }
+    assert(threw);
+    for (auto const &f : {buf, buf2, snap})
+      std::remove(f.c_str());
+  }
+
+  // 18) Copy-on-write: só as páginas escritas ficam privadas, e o commit
+  // na base grava exatamente essas páginas (vistas por um attach MAP_SHARED)
+  {
+    const std::string buf = "/tmp/layout_test_cow.buf";
+    std::remove(buf.c_str());
+    LayoutEngine base;
+    base.build_layout(nlohmann::json::parse(R"({
+      "items": {"type": "object[]", "max_items": 4096,
+                "schema": {"v": "float64"}}
+    })"));
+    base.allocate_memory_from_file(buf);
+    for (size_t i = 0; i < 4096; ++i) {
+      double v = static_cast<double>(i);
+      base.insert("items", &v);
+    }
+    assert(base.get_layout().total_size > 8 * 4096);
+
+    MapOptions mo;
+    mo.copy_on_write = true;
+    LayoutEngine cow(base.shared_layout());
+    cow.allocate_memory_from_file(buf, mo);
+    assert(cow.private_pages() == 0);
+    // itens 0 e 3000 ficam em páginas diferentes (slot de 9 bytes)
+    double a = -1.0, b = -2.0;
+    cow.set("items", &a, 0);
+    cow.set("items", &b, 3000);
+    assert(cow.private_pages() == 2);
+    assert(*static_cast<double *>(base.get("items", 0)) == 0.0);
+
+    assert(cow.commit_private() == 2);
+    assert(cow.private_pages() == 0);
+    LayoutEngine shared(base.shared_layout());
+    shared.allocate_memory_from_file(buf);
+    assert(*static_cast<double *>(shared.get("items", 0)) == -1.0);
+    assert(*static_cast<double *>(shared.get("items", 3000)) == -2.0);
+    assert(*static_cast<double *>(shared.get("items", 1500)) == 1500.0);
+    assert(*static_cast<double *>(base.get("items", 3000)) == -2.0);
+    std::remove(buf.c_str());
+  }
+
+  // 19) dump_json -> load_json nos dois formatos devolve o mesmo conteúdo;
+  // números fora do intervalo do campo lançam em vez de truncar
+  {
+    const std::string dir = "/tmp/layout_test_json";
+    auto js = nlohmann::json::parse(R"({
+      "i32": {"type": "int32"}, "i64": {"type": "int64"},
+      "f32": {"type": "float32"}, "f64": {"type": "float64"},
+      "name": {"type": "string", "max_length": 16},
+      "note": {"type": "varstring"}, "raw": {"type": "blob"},
+      "cfg": {"type": "object", "schema": {"a": "int32", "b": "float64"}},
+      "orders": {"type": "object[]", "max_items": 16,
+                 "schema": {"p": "float64", "q": "int32"}}
+    })");
+    auto slurp = [](const std::string &path) {
+      std::ifstream in(path, std::ios::binary);
+      return std::string(std::istreambuf_iterator<char>(in),
+                         std::istreambuf_iterator<char>());
+    };
+    std::remove((dir + ".src.buf").c_str());
+    LayoutEngine src;
+    src.build_layout(js);
+    src.allocate_memory_from_file(dir + ".src.buf");
+    int32_t i32 = -2147483647 - 1;
+    int64_t i64 = 9223372036854775807LL;
+    float f32 = 0.1f;
+    double f64 = -1e300;
+    src.set("i32", &i32);
+    src.set("i64", &i64);
+    src.set("f32", &f32);
+    src.set("f64", &f64);
+    src.set_bytes("name", "nome \"x\"", 8);
+    src.set_bytes("note", "linha 1\nlinha 2", 15);
+    const char raw[] = {0, 1, 2, '\xff', '\x80'};
+    src.set_bytes("raw", raw, sizeof(raw));
+#pragma pack(push, 1)
+    struct cfg_t {
+      int32_t a;
+      double b;
+    } cfg{7, 2.5};
+    struct order_t {
+      double p;
+      int32_t q;
+    };
+#pragma pack(pop)
+    src.set("cfg", &cfg);
+    for (int32_t i = 0; i < 5; ++i) {
+      order_t o{i * 1.25, -i};
+      src.insert("orders", &o);
+    }
+    src.pop("orders", 2);
+
+    for (JsonFormat fmt : {JsonFormat::Json, JsonFormat::Ndjson}) {
+      std::string tag = fmt == JsonFormat::Json ? "json" : "ndjson";
+      std::string out1 = dir + "." + tag, out2 = dir + ".2." + tag;
+      std::string buf = dir + "." + tag + ".buf";
+      std::remove(buf.c_str());
+      assert(dump_json(src, out1, fmt) == 4);
+      LayoutEngine dst(src.shared_layout());
+      dst.allocate_memory_from_file(buf);
+      assert(load_json(dst, out1, fmt) == 4);
+      assert(*static_cast<int32_t *>(dst.get("i32")) == i32);
+      assert(*static_cast<int64_t *>(dst.get("i64")) == i64);
+      assert(*static_cast<float *>(dst.get("f32")) == f32);
+      assert(*static_cast<double *>(dst.get("f64")) == f64);
+      assert(dst.get_bytes("name") == "nome \"x\"");
+      assert(dst.get_bytes("note") == "linha 1\nlinha 2");
+      assert(dst.get_bytes("raw") == std::string_view(raw, sizeof(raw)));
+      auto *o = static_cast<order_t *>(dst.get("orders", 2));
+      assert(o && o->p == 3 * 1.25 && o->q == -3);
+      dump_json(dst, out2, fmt);
+      assert(slurp(out1) == slurp(out2));
+      for (auto const &f : {out1, out2, buf})
+        std::remove(f.c_str());
+    }
+
+    const std::string bad = dir + ".bad.json", buf = dir + ".bad.buf";
+    for (const char *doc :
+         {R"({"i32": 2147483648})", R"({"i32": -2147483649})",
+          R"({"i32": 1e10})", R"({"i64": 9223372036854775808})",
+          R"({"i64": 1e300})", R"({"i64": -1e19})", R"({"f32": 1e39})",
+          R"({"cfg": {"a": 4294967296}})",
+          R"({"orders": [{"p": 1.0, "q": 3000000000}]})"}) {
+      std::ofstream(bad, std::ios::trunc) << doc;
+      std::remove(buf.c_str());
+      LayoutEngine dst(src.shared_layout());
+      dst.allocate_memory_from_file(buf);
+      bool threw = false;
+      try {
+        load_json(dst, bad);
+      } catch (const std::runtime_error &e) {
+        threw = std::string(e.what()).find("fora do intervalo") !=
+                std::string::npos;
+      }
+      assert(threw);
+    }
+    // limites exatos ainda passam
+    std::ofstream(bad, std::ios::trunc)
+        << R"({"i32": -2147483648, "i64": -9223372036854775808, "f32": 3.0})";
+    std::remove(buf.c_str());
+    LayoutEngine dst(src.shared_layout());
+    dst.allocate_memory_from_file(buf);
+    load_json(dst, bad);
+    assert(*static_cast<int32_t *>(dst.get("i32")) == INT32_MIN);
+    assert(*static_cast<int64_t *>(dst.get("i64")) == INT64_MIN);
+    assert(*static_cast<float *>(dst.get("f32")) == 3.0f);
+    for (auto const &f : {bad, buf, dir + ".src.buf"})
+      std::remove(f.c_str());
+  }
+
+  // 20) Arrow File: magic nas duas pontas, mensagens com prefixo
+  // 0xFFFFFFFF + tamanho múltiplo de 8, footer com o tamanho gravado antes
+  // do magic final e length do RecordBatch = itens vivos (slots removidos
+  // ficam de fora)
+  {
+    const std::string buf = "/tmp/layout_test_arrow.buf";
+    const std::string out = "/tmp/layout_test_arrow.arrow";
+    std::remove(buf.c_str());
+    LayoutEngine e;
+    e.build_layout(nlohmann::json::parse(R"({
+      "orders": {"type": "object[]", "max_items": 32,
+                 "schema": {"px": "float64", "qty": "int32"}}
+    })"));
+    e.allocate_memory_from_file(buf);
+#pragma pack(push, 1)
+    struct order_t {
+      double px;
+      int32_t qty;
+    };
+#pragma pack(pop)
+    for (int32_t i = 0; i < 10; ++i) {
+      order_t o{i + 0.5, i};
+      e.insert("orders", &o);
+    }
+    for (size_t i : {1, 4, 7})
+      e.pop("orders", i);
+    assert(export_arrow(e, "orders", out) == 7);
+
+    std::string f;
+    {
+      std::ifstream in(out, std::ios::binary);
+      f.assign(std::istreambuf_iterator<char>(in),
+               std::istreambuf_iterator<char>());
+    }
+    auto u32 = [&](size_t at) {
+      uint32_t v;
+      memcpy(&v, f.data() + at, 4);
+      return v;
+    };
+    assert(f.size() > 8 + 10 && f.compare(0, 8, std::string("ARROW1\0\0", 8)) == 0);
+    assert(f.compare(f.size() - 6, 6, "ARROW1") == 0);
+
+    // vt(id) do Message/RecordBatch/Footer (ver arrow_export.cpp)
+    auto vt = [](int id) { return static_cast<flatbuffers::voffset_t>(4 + 2 * id); };
+    size_t pos = 8, batch_pos = 0;
+    int64_t rows = -1;
+    for (int m = 0; m < 2; ++m) {
+      assert(pos % 8 == 0 && u32(pos) == 0xFFFFFFFFu);
+      uint32_t meta = u32(pos + 4);
+      assert(meta % 8 == 0);
+      auto *msg = flatbuffers::GetRoot<flatbuffers::Table>(f.data() + pos + 8);
+      int64_t body = msg->GetField<int64_t>(vt(3), 0);
+      if (m == 1) {
+        assert(msg->GetField<uint8_t>(vt(1), 0) == 3); // RecordBatch
+        auto *rb = msg->GetPointer<const flatbuffers::Table *>(vt(2));
+        rows = rb->GetField<int64_t>(vt(0), -1);
+        // coluna px: buffers[1] (validade vazia em buffers[0])
+        auto *bufs = rb->GetPointer<const uint8_t *>(vt(2));
+        int64_t px_off;
+        memcpy(&px_off, bufs + 4 + 16, 8);
+        const char *col = f.data() + pos + 8 + meta + px_off;
+        size_t r = 0;
+        for (int32_t i = 0; i < 10; ++i) {
+          if (i == 1 || i == 4 || i == 7)
+            continue;
+          double px;
+          memcpy(&px, col + 8 * r++, 8);
+          assert(px == i + 0.5);
+        }
+        batch_pos = pos;
+      } else {
+        assert(body == 0);
+      }
+      pos += 8 + meta + static_cast<size_t>(body);
+    }
+    assert(rows == 7);
+    assert(u32(pos) == 0xFFFFFFFFu && u32(pos + 4) == 0); // EOS
+    pos += 8;
+    int32_t footer_len;
+    memcpy(&footer_len, f.data() + f.size() - 10, 4);
+    assert(footer_len > 0 && pos + footer_len == f.size() - 10);
+    auto *footer = flatbuffers::GetRoot<flatbuffers::Table>(f.data() + pos);
+    auto *blocks = footer->GetPointer<const uint8_t *>(vt(3));
+    uint32_t nblocks;
+    int64_t block_off;
+    memcpy(&nblocks, blocks, 4);
+    memcpy(&block_off, blocks + 4, 8);
+    assert(nblocks == 1 && static_cast<size_t>(block_off) == batch_pos);
+
+    // Stream: sem magic, mesma contagem
+    assert(export_arrow(e, "orders", out, ArrowFormat::Stream) == 7);
+    {
+      std::ifstream in(out, std::ios::binary);
+      f.assign(std::istreambuf_iterator<char>(in),
+               std::istreambuf_iterator<char>());
+    }
+    assert(u32(0) == 0xFFFFFFFFu && u32(f.size() - 8) == 0xFFFFFFFFu &&
+           u32(f.size() - 4) == 0);
+    std::remove(buf.c_str());
+    std::remove(out.c_str());
+  }
+
+  // 21) Arrays em chunks: inserir além de chunk_items anexa chunks ao
+  // arquivo; outro engine anexado ao mesmo arquivo (inclusive somente
+  // leitura) mapeia os chunks novos sob demanda, e ponteiros antigos
+  // continuam válidos (a base da reserva não muda)
+  {
+    const std::string buf = "/tmp/layout_test_chunks.buf";
+    std::remove(buf.c_str());
+    LayoutEngine a;
+    a.build_layout(nlohmann::json::parse(R"({
+      "n": {"type": "int32"},
+      "items": {"type": "object[]", "max_items": 1024, "chunk_items": 64,
+                "schema": {"v": "float64"}}
+    })"));
+    a.allocate_memory_from_file(buf);
+    LayoutEngine b(a.shared_layout());
+    b.allocate_memory_from_file(buf);
+    MapOptions ro;
+    ro.read_only = true;
+    LayoutEngine c(a.shared_layout());
+    c.allocate_memory_from_file(buf, ro);
+
+    double v0 = 0.0;
+    a.insert("items", &v0);
+    void *base = a.mmap_base();
+    auto *first = static_cast<double *>(a.get("items", 0));
+    for (size_t i = 1; i < 200; ++i) {
+      double v = static_cast<double>(i);
+      a.insert("items", &v);
+    }
+    assert(a.mmap_base() == base && a.get("items", 0) == first);
+    for (size_t i : {size_t(63), size_t(64), size_t(150), size_t(199)}) {
+      assert(*static_cast<double *>(b.get("items", i)) == static_cast<double>(i));
+      assert(*static_cast<double *>(c.get("items", i)) == static_cast<double>(i));
+    }
+    assert(b.get("items", 200) == nullptr);
+
+    // o segundo engine também cresce: chunk alocado por b, lido por a
+    for (size_t i = 200; i < 300; ++i) {
+      double v = static_cast<double>(i);
+      b.insert("items", &v);
+    }
+    assert(*static_cast<double *>(a.get("items", 299)) == 299.0);
+    assert(*static_cast<double *>(c.get("items", 256)) == 256.0);
+    *first = -1.0;
+    assert(*static_cast<double *>(b.get("items", 0)) == -1.0);
+    std::remove(buf.c_str());
+  }
+
+  // 22) Estatísticas: a thread que muda de CPU passa a contar no slot da
+  // CPU nova em até STATS_CPU_REFRESH atualizações (precisa de 2 CPUs)
+  {
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    sched_getaffinity(0, sizeof(allowed), &allowed);
+    int cpus[2], found = 0;
+    for (int c = 0; c < CPU_SETSIZE && found < 2; ++c)
+      if (CPU_ISSET(c, &allowed))
+        cpus[found++] = c;
+    LayoutOptions lo;
+    lo.stats_slots = 64;
+    if (found == 2 && cpus[0] % 64 != cpus[1] % 64) {
+      const std::string buf = "/tmp/layout_test_stats.buf";
+      std::remove(buf.c_str());
+      LayoutEngine e;
+      e.build_layout(nlohmann::json::parse(R"({"x": {"type": "int32"}})"), lo);
+      e.allocate_memory_from_file(buf);
+      auto const &map = e.get_layout();
+      auto writes = [&](int cpu) {
+        auto *s = reinterpret_cast<FieldStats *>(
+                      static_cast<char *>(e.mmap_base()) + map.stats_offset) +
+                  static_cast<size_t>(cpu % 64) * map.fields.size();
+        return __atomic_load_n(&s->writes, __ATOMIC_RELAXED);
+      };
+      std::thread([&] {
+        int32_t v = 1;
+        for (int cpu : cpus) {
+          cpu_set_t one;
+          CPU_ZERO(&one);
+          CPU_SET(cpu, &one);
+          sched_setaffinity(0, sizeof(one), &one);
+          for (unsigned i = 0; i < 2 * STATS_CPU_REFRESH; ++i)
+            e.set("x", &v);
+        }
+      }).join();
+      // na CPU nova, ao menos a última volta de STATS_CPU_REFRESH conta lá
+      assert(writes(cpus[1]) >= STATS_CPU_REFRESH);
+      assert(writes(cpus[0]) + writes(cpus[1]) == 4 * STATS_CPU_REFRESH);
+      assert(stats_aggregate(map, e.mmap_base(), 0).writes ==
+             4 * STATS_CPU_REFRESH);
+      std::remove(buf.c_str());
+    }
+  }
+
+  // 23) Se tudo passou:
   std::cout << "Todos os testes passaram!\n";
   return 0;
 }
@@ -1,14 +1,410 @@
+#include <arrow_export.hpp>
+#include <chrono>
+#include <cstdio>
 #include <iostream>
+#include <json_io.hpp>
 #include <layout_engine.hpp>
+#include <migrate.hpp>
 #include <nlohmann/json.hpp>
+#include <replication.hpp>
+#include <stats.hpp>
 #include <string>
+#include <thread>
+#include <vector>
+
+// ramlane migrate: copia o buffer vivo para o novo layout e troca o arquivo
+static int run_migrate(int argc, char *argv[]) {
+  std::string old_map;
+  std::string json_path;
+  std::string backing_file;
+  std::string flatbuf_path;
+  std::string output_dir;
+
+  for (int i = 2; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--old-map" && i + 1 < argc) {
+      old_map = argv[++i];
+    } else if (arg == "--input" && i + 1 < argc) {
+      json_path = argv[++i];
+    } else if (arg == "--backing-file" && i + 1 < argc) {
+      backing_file = argv[++i];
+    } else if (arg == "--flatbuffer" && i + 1 < argc) {
+      flatbuf_path = argv[++i];
+    } else if (arg == "--out-dir" && i + 1 < argc) {
+      output_dir = argv[++i];
+    } else {
+      std::cerr << "Argumento desconhecido: " << arg << "\n";
+      return 1;
+    }
+  }
+
+  if (old_map.empty() || json_path.empty() || backing_file.empty()) {
+    std::cerr << "Uso: " << argv[0] << " migrate --old-map <old.ram>"
+              << " --input <layout.json>"
+              << " --backing-file <memory.buf>"
+              << " [--flatbuffer <new.ram>] [--out-dir <output_dir>]\n";
+    return 1;
+  }
+
+  LayoutEngine from, to;
+  from.load_map_flatbuf(old_map);
+  to.load_layout_json(json_path);
+  auto plan = migrate_backing_file(from, to, backing_file);
+
+  for (auto const &f : plan.added)
+    std::cout << "  + " << f << "\n";
+  for (auto const &f : plan.dropped)
+    std::cout << "  - " << f << "\n";
+  std::cout << "Migrado: " << backing_file << " (" << from.mmap_size()
+            << " -> " << to.mmap_size() << " bytes)\n";
+
+  if (!flatbuf_path.empty())
+    to.save_map_flatbuf(flatbuf_path);
+  if (!output_dir.empty()) {
+    to.generate_ffi_header(output_dir + "/layout_ffi.hpp");
+    to.generate_ffi_cpp(output_dir + "/layout_ffi.cpp");
+  }
+  return 0;
+}
+
+// ramlane stats: anexa o buffer somente leitura e imprime os contadores
+static int run_stats(int argc, char *argv[]) {
+  std::string flatbuf_path;
+  std::string backing_file;
+  int interval_ms = 1000;
+  size_t instance = 0;
+  bool once = false;
+  bool numa = false;
+
+  for (int i = 2; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--flatbuffer" && i + 1 < argc) {
+      flatbuf_path = argv[++i];
+    } else if (arg == "--backing-file" && i + 1 < argc) {
+      backing_file = argv[++i];
+    } else if (arg == "--interval-ms" && i + 1 < argc) {
+      interval_ms = std::stoi(argv[++i]);
+    } else if (arg == "--instance" && i + 1 < argc) {
+      instance = std::stoul(argv[++i]);
+    } else if (arg == "--once") {
+      once = true;
+    } else if (arg == "--numa") {
+      numa = true;
+    } else {
+      std::cerr << "Argumento desconhecido: " << arg << "\n";
+      return 1;
+    }
+  }
+
+  if (flatbuf_path.empty() || backing_file.empty()) {
+    std::cerr << "Uso: " << argv[0] << " stats --flatbuffer <layout.ram>"
+              << " --backing-file <memory.buf>"
+              << " [--interval-ms <ms>] [--instance <n>] [--once]"
+              << " [--numa]\n";
+    return 1;
+  }
+
+  LayoutEngine engine;
+  engine.load_map_flatbuf(flatbuf_path);
+  auto const &map = engine.get_layout();
+  if (numa) {
+    // Só o relatório de posicionamento: dispensa a seção de estatísticas
+    // move_pages só enxerga páginas mapeadas neste processo: prefault de
+    // leitura antes de consultar
+    MapOptions opts;
+    opts.read_only = true;
+    opts.numa_prefault = true;
+    engine.allocate_memory_from_file(backing_file, opts);
+    NumaPlacement p = engine.numa_placement();
+    std::printf("%-8s %12s\n", "nó", "páginas");
+    for (size_t n = 0; n < p.pages_per_node.size(); ++n)
+      if (p.pages_per_node[n])
+        std::printf("%-8zu %12zu\n", n, p.pages_per_node[n]);
+    std::printf("%-8s %12zu\n", "ausente", p.not_present);
+    // Campos com afinidade: páginas da imagem atual fora do nó pedido
+    if (map.pool_instances)
+      engine.select_instance(instance);
+    auto *base = static_cast<const char *>(engine.mmap_base());
+    for (auto const &f : map.fields) {
+      if (f.numa_node < 0)
+        continue;
+      size_t len = f.size + (f.type == FieldType::Array ? 4 : 0);
+      NumaPlacement fp = numa_placement(base + f.offset, len);
+      size_t total = 0, local = 0;
+      for (size_t n = 0; n < fp.pages_per_node.size(); ++n)
+        total += fp.pages_per_node[n];
+      if (static_cast<size_t>(f.numa_node) < fp.pages_per_node.size())
+        local = fp.pages_per_node[f.numa_node];
+      std::printf("%-20s nó %d: %zu/%zu páginas no nó\n", f.name.c_str(),
+                  f.numa_node, local, total);
+    }
+    return 0;
+  }
+  if (!map.stats_slots) {
+    std::cerr << "Layout sem seção de estatísticas (\"stats\" no layout.json)\n";
+    return 1;
+  }
+
+  // Mapeamento PROT_READ: nunca escreve no buffer do processo observado
+  MapOptions opts;
+  opts.read_only = true;
+  engine.allocate_memory_from_file(backing_file, opts);
+  if (map.pool_instances)
+    engine.select_instance(instance);
+  const void *base = engine.mmap_base();
+
+  std::vector<FieldStats> prev(map.fields.size());
+  auto t_prev = std::chrono::steady_clock::now();
+  for (bool first = true;; first = false) {
+    auto t_now = std::chrono::steady_clock::now();
+    double dt = std::chrono::duration<double>(t_now - t_prev).count();
+    uint64_t now_ns = stats_now_ns();
+
+    std::printf("%-20s %12s %12s %8s %12s %10s %10s %10s\n", "campo", "inserts",
+                "pops", "cheio", "writes", "max_ocup", "ops/s", "ult_ms");
+    for (size_t i = 0; i < map.fields.size(); ++i) {
+      FieldStats s = stats_aggregate(map, base, i);
+      uint64_t ops = s.inserts + s.pops + s.writes;
+      uint64_t prev_ops = prev[i].inserts + prev[i].pops + prev[i].writes;
+      double rate = first || dt <= 0 ? 0.0 : (ops - prev_ops) / dt;
+      double age_ms =
+          s.last_write_ns ? (now_ns - s.last_write_ns) / 1e6 : -1.0;
+      std::printf("%-20s %12llu %12llu %8llu %12llu %10llu %10.0f %10.1f\n",
+                  map.fields[i].name.c_str(), (unsigned long long)s.inserts,
+                  (unsigned long long)s.pops,
+                  (unsigned long long)s.full_rejections,
+                  (unsigned long long)s.writes,
+                  (unsigned long long)s.max_occupancy, rate, age_ms);
+      prev[i] = s;
+    }
+    std::fflush(stdout);
+    if (once)
+      break;
+    t_prev = t_now;
+    std::this_thread::sleep_for(std::chrono::milliseconds(interval_ms));
+    std::printf("\n");
+  }
+  return 0;
+}
+
+// ramlane export-arrow: snapshot das linhas vivas de um object[] em Arrow IPC
+static int run_export_arrow(int argc, char *argv[]) {
+  std::string flatbuf_path;
+  std::string backing_file;
+  std::string field;
+  std::string out_path;
+  ArrowFormat format = ArrowFormat::File;
+  bool double_buffered = false;
+  size_t instance = 0;
+
+  for (int i = 2; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--flatbuffer" && i + 1 < argc) {
+      flatbuf_path = argv[++i];
+    } else if (arg == "--backing-file" && i + 1 < argc) {
+      backing_file = argv[++i];
+    } else if (arg == "--field" && i + 1 < argc) {
+      field = argv[++i];
+    } else if (arg == "--out" && i + 1 < argc) {
+      out_path = argv[++i];
+    } else if (arg == "--stream") {
+      format = ArrowFormat::Stream;
+    } else if (arg == "--double-buffered") {
+      double_buffered = true;
+    } else if (arg == "--instance" && i + 1 < argc) {
+      instance = std::stoul(argv[++i]);
+    } else {
+      std::cerr << "Argumento desconhecido: " << arg << "\n";
+      return 1;
+    }
+  }
+
+  if (flatbuf_path.empty() || backing_file.empty() || field.empty() ||
+      out_path.empty()) {
+    std::cerr << "Uso: " << argv[0] << " export-arrow --flatbuffer <layout.ram>"
+              << " --backing-file <memory.buf> --field <object[]>"
+              << " --out <saida.arrow> [--stream] [--double-buffered]"
+              << " [--instance <n>]\n";
+    return 1;
+  }
+
+  LayoutEngine engine;
+  engine.load_map_flatbuf(flatbuf_path);
+  MapOptions opts;
+  opts.read_only = true;
+  opts.double_buffered = double_buffered;
+  engine.allocate_memory_from_file(backing_file, opts);
+  if (engine.get_layout().pool_instances)
+    engine.select_instance(instance);
+
+  // A/B: a época fixada garante que o escritor não altera a cópia lida
+  if (double_buffered)
+    engine.pin_epoch();
+  size_t rows = export_arrow(engine, field, out_path, format);
+  engine.unpin_epoch();
+  std::cout << "Exportado: " << rows << " itens de " << field << " -> "
+            << out_path << "\n";
+  return 0;
+}
+
+// ramlane dump | load: conteúdo do buffer <-> JSON/NDJSON em streaming
+static int run_json_io(int argc, char *argv[], bool load) {
+  std::string flatbuf_path;
+  std::string backing_file;
+  std::string path = "-";
+  JsonFormat format = JsonFormat::Json;
+  bool double_buffered = false;
+  size_t instance = 0;
+
+  for (int i = 2; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--flatbuffer" && i + 1 < argc) {
+      flatbuf_path = argv[++i];
+    } else if (arg == "--backing-file" && i + 1 < argc) {
+      backing_file = argv[++i];
+    } else if (arg == (load ? "--in" : "--out") && i + 1 < argc) {
+      path = argv[++i];
+    } else if (arg == "--ndjson") {
+      format = JsonFormat::Ndjson;
+    } else if (arg == "--double-buffered") {
+      double_buffered = true;
+    } else if (arg == "--instance" && i + 1 < argc) {
+      instance = std::stoul(argv[++i]);
+    } else {
+      std::cerr << "Argumento desconhecido: " << arg << "\n";
+      return 1;
+    }
+  }
+
+  if (flatbuf_path.empty() || backing_file.empty()) {
+    std::cerr << "Uso: " << argv[0] << (load ? " load" : " dump")
+              << " --flatbuffer <layout.ram> --backing-file <memory.buf>"
+              << (load ? " [--in <dados.json>|-]" : " [--out <dados.json>|-]")
+              << " [--ndjson] [--double-buffered] [--instance <n>]\n";
+    return 1;
+  }
+
+  LayoutEngine engine;
+  engine.load_map_flatbuf(flatbuf_path);
+  MapOptions opts;
+  opts.read_only = !load;
+  opts.double_buffered = double_buffered;
+  engine.allocate_memory_from_file(backing_file, opts);
+  if (engine.get_layout().pool_instances)
+    engine.select_instance(instance);
+
+  // A/B: dump lê a época fixada; load escreve na cópia de trás e publica
+  size_t items;
+  if (load) {
+    if (double_buffered)
+      engine.begin_write(true);
+    items = load_json(engine, path, format);
+    if (double_buffered)
+      engine.publish();
+  } else {
+    if (double_buffered)
+      engine.pin_epoch();
+    items = dump_json(engine, path, format);
+    engine.unpin_epoch();
+  }
+  std::cerr << (load ? "Carregado: " : "Exportado: ") << items
+            << " itens de array\n";
+  return 0;
+}
+
+// ramlane follow: aplica os deltas do ring do escritor numa cópia local
+static int run_follow(int argc, char *argv[]) {
+  std::string flatbuf_path;
+  std::string backing_file;
+  std::string ring_path;
+  FollowerOptions fopts;
+  int interval_ms = 1;
+  int report_ms = 1000;
+  bool once = false;
+
+  for (int i = 2; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--flatbuffer" && i + 1 < argc) {
+      flatbuf_path = argv[++i];
+    } else if (arg == "--backing-file" && i + 1 < argc) {
+      backing_file = argv[++i];
+    } else if (arg == "--ring" && i + 1 < argc) {
+      ring_path = argv[++i];
+    } else if (arg == "--snapshot" && i + 1 < argc) {
+      fopts.snapshot_path = argv[++i];
+    } else if (arg == "--interval-ms" && i + 1 < argc) {
+      interval_ms = std::stoi(argv[++i]);
+    } else if (arg == "--resync-ms" && i + 1 < argc) {
+      fopts.resync_interval_ms = std::stoul(argv[++i]);
+    } else if (arg == "--report-ms" && i + 1 < argc) {
+      report_ms = std::stoi(argv[++i]);
+    } else if (arg == "--once") {
+      once = true;
+    } else {
+      std::cerr << "Argumento desconhecido: " << arg << "\n";
+      return 1;
+    }
+  }
+
+  if (flatbuf_path.empty() || backing_file.empty() || ring_path.empty()) {
+    std::cerr << "Uso: " << argv[0] << " follow --flatbuffer <layout.ram>"
+              << " --backing-file <replica.buf> --ring <ring>"
+              << " [--snapshot <layout.snap>] [--interval-ms <ms>]"
+              << " [--resync-ms <ms>] [--report-ms <ms>] [--once]\n";
+    return 1;
+  }
+
+  LayoutEngine engine;
+  engine.load_map_flatbuf(flatbuf_path);
+  engine.allocate_memory_from_file(backing_file);
+  ReplicaFollower follower(engine, ring_path, fopts);
+
+  auto t_report = std::chrono::steady_clock::now();
+  for (;;) {
+    size_t n = follower.poll();
+    auto now = std::chrono::steady_clock::now();
+    bool caught_up = follower.synced() && follower.lag().bytes == 0;
+    if ((once && caught_up) ||
+        now - t_report >= std::chrono::milliseconds(report_ms)) {
+      ReplLag l = follower.lag();
+      std::printf("pos %llu atraso %llu bytes %llu lotes %.3f ms"
+                  " ressincronizações %llu%s\n",
+                  (unsigned long long)follower.position(),
+                  (unsigned long long)l.bytes, (unsigned long long)l.batches,
+                  l.ns / 1e6, (unsigned long long)l.resyncs,
+                  follower.synced() ? "" : " (aguardando snapshot)");
+      std::fflush(stdout);
+      t_report = now;
+      if (once && caught_up)
+        break;
+    }
+    if (n == 0)
+      std::this_thread::sleep_for(std::chrono::milliseconds(interval_ms));
+  }
+  return 0;
+}
 
 int main(int argc, char *argv[]) {
+  if (argc > 1 && std::string(argv[1]) == "migrate")
+    return run_migrate(argc, argv);
+  if (argc > 1 && std::string(argv[1]) == "stats")
+    return run_stats(argc, argv);
+  if (argc > 1 && std::string(argv[1]) == "export-arrow")
+    return run_export_arrow(argc, argv);
+  if (argc > 1 && std::string(argv[1]) == "dump")
+    return run_json_io(argc, argv, false);
+  if (argc > 1 && std::string(argv[1]) == "load")
+    return run_json_io(argc, argv, true);
+  if (argc > 1 && std::string(argv[1]) == "follow")
+    return run_follow(argc, argv);
+
   std::string json_path;
   std::string backing_file;
   std::string flatbuf_path;
   std::string output_dir;
   bool do_format = false;
+  MapOptions map_opts;
+  CodegenOptions codegen;
 
   // Parse dos argumentos
   for (int i = 1; i < argc; ++i) {
@@ -23,6 +419,15 @@ int main(int argc, char *argv[]) {
       output_dir = argv[++i];
     } else if (arg == "--format") {
       do_format = true;
+    } else if (arg == "--prefault-threads" && i + 1 < argc) {
+      map_opts.prefault = true;
+      map_opts.prefault_threads = std::stoul(argv[++i]);
+    } else if (arg == "--prefault-zero") {
+      map_opts.prefault = map_opts.prefault_zero = true;
+    } else if (arg == "--compact") {
+      codegen.compact = true;
+    } else if (arg == "--named-wrappers") {
+      codegen.compact = codegen.named_wrappers = true;
     } else {
       std::cerr << "Argumento desconhecido: " << arg << "\n";
       return 1;
@@ -36,15 +441,17 @@ int main(int argc, char *argv[]) {
               << " --backing-file <memory.buf>"
               << " --flatbuffer <layout.ram>"
               << " --out-dir <output_dir>"
-              << " [--format]\n";
+              << " [--format] [--prefault-threads <n>] [--prefault-zero]"
+              << " [--compact] [--named-wrappers]\n";
     return 1;
   }
 
   // Pipeline principal
   LayoutEngine engine;
   engine.load_layout_json(json_path);
-  engine.allocate_memory_from_file(backing_file);
+  engine.allocate_memory_from_file(backing_file, map_opts);
   engine.save_map_flatbuf(flatbuf_path);
+  engine.set_codegen_options(codegen);
   engine.generate_ffi_header(output_dir + "/layout_ffi.hpp");
   engine.generate_ffi_cpp(output_dir + "/layout_ffi.cpp");
 
@@ -56,6 +463,14 @@ int main(int argc, char *argv[]) {
   auto size = engine.mmap_size();
   std::cout << "Total buffer size: " << size << " bytes (" << size / 1024.0
             << " KB, " << size / (1024.0 * 1024.0) << " MB)\n";
+  if (map_opts.prefault) {
+    auto const &st = engine.startup_report();
+    std::printf("Startup: mapeamento %.1f ms, %s %.1f MB em %.1f ms"
+                " (%u threads)\n",
+                st.map_ms, st.zeroed ? "zero" : "prefault",
+                st.prefault_bytes / (1024.0 * 1024.0), st.prefault_ms,
+                st.prefault_threads);
+  }
 
   return 0;
 }
@@ -0,0 +1,251 @@
+#include "arrow_export.hpp"
+
+#include "flatbuffers/flatbuffers.h"
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+// -------------------------------
+// METADADOS ARROW (Schema.fbs / Message.fbs / File.fbs)
+// -------------------------------
+// Sem código gerado do formato Arrow: as tabelas são montadas com a API
+// genérica do FlatBufferBuilder. vt(id) é o voffset do campo de número `id`
+// no .fbs do Arrow; uniões ocupam dois ids (tipo e valor).
+namespace {
+
+constexpr flatbuffers::voffset_t vt(int id) {
+  return static_cast<flatbuffers::voffset_t>(4 + 2 * id);
+}
+
+constexpr int16_t METADATA_V5 = 4;
+constexpr uint8_t HEADER_SCHEMA = 1;
+constexpr uint8_t HEADER_RECORD_BATCH = 3;
+constexpr uint8_t TYPE_INT = 2;
+constexpr uint8_t TYPE_FLOATING_POINT = 3;
+constexpr int16_t PRECISION_SINGLE = 1;
+constexpr int16_t PRECISION_DOUBLE = 2;
+constexpr size_t BODY_ALIGN = 64; // alinhamento recomendado dos buffers
+
+struct FieldNode {
+  int64_t length;
+  int64_t null_count;
+};
+
+struct BufferDesc {
+  int64_t offset;
+  int64_t length;
+};
+
+struct Block {
+  int64_t offset;
+  int32_t meta_len;
+  int32_t pad;
+  int64_t body_len;
+};
+
+using Table = flatbuffers::Offset<void>;
+
+Table arrow_type(flatbuffers::FlatBufferBuilder &b, const FieldLayout &f,
+                 uint8_t &type_id) {
+  auto start = b.StartTable();
+  switch (f.type) {
+  case FieldType::Int32:
+  case FieldType::Int64:
+    type_id = TYPE_INT;
+    b.AddElement<int32_t>(vt(0), f.type == FieldType::Int32 ? 32 : 64, 0);
+    b.AddElement<uint8_t>(vt(1), 1, 0); // is_signed
+    break;
+  case FieldType::Float32:
+  case FieldType::Float64:
+    type_id = TYPE_FLOATING_POINT;
+    b.AddElement<int16_t>(vt(0),
+                          f.type == FieldType::Float32 ? PRECISION_SINGLE
+                                                       : PRECISION_DOUBLE,
+                          0);
+    break;
+  default:
+    throw std::runtime_error("export_arrow: subcampo sem tipo Arrow: " +
+                             f.name);
+  }
+  return Table(b.EndTable(start));
+}
+
+Table arrow_schema(flatbuffers::FlatBufferBuilder &b, const FieldLayout &arr) {
+  std::vector<Table> fields;
+  for (auto const &c : arr.children) {
+    auto name = b.CreateString(c.name);
+    uint8_t type_id = 0;
+    auto type = arrow_type(b, c, type_id);
+    auto children = b.CreateVector(std::vector<Table>());
+    auto start = b.StartTable();
+    b.AddOffset(vt(0), name);
+    b.AddElement<uint8_t>(vt(1), 0, 1); // nullable = false
+    b.AddElement<uint8_t>(vt(2), type_id, 0);
+    b.AddOffset(vt(3), type);
+    b.AddOffset(vt(5), children);
+    fields.push_back(Table(b.EndTable(start)));
+  }
+  auto vec = b.CreateVector(fields);
+  auto start = b.StartTable();
+  b.AddOffset(vt(1), vec); // endianness = Little (default)
+  return Table(b.EndTable(start));
+}
+
+// Message { version, header (união), bodyLength }
+void finish_message(flatbuffers::FlatBufferBuilder &b, uint8_t header_type,
+                    Table header, int64_t body_len) {
+  auto start = b.StartTable();
+  b.AddElement<int64_t>(vt(3), body_len, 0);
+  b.AddOffset(vt(2), header);
+  b.AddElement<int16_t>(vt(0), METADATA_V5, 0);
+  b.AddElement<uint8_t>(vt(1), header_type, 0);
+  b.Finish(Table(b.EndTable(start)));
+}
+
+class IpcWriter {
+public:
+  explicit IpcWriter(const std::string &path)
+      : out_(path, std::ios::binary | std::ios::trunc) {
+    if (!out_)
+      throw std::runtime_error("export_arrow: não abriu " + path);
+  }
+
+  void write(const void *data, size_t len) {
+    out_.write(static_cast<const char *>(data), len);
+    pos_ += len;
+  }
+
+  void zeros(size_t len) {
+    static const char z[BODY_ALIGN] = {};
+    write(z, len);
+  }
+
+  // Mensagem encapsulada: 0xFFFFFFFF, tamanho do metadata (com padding até
+  // 8) e o flatbuffer. Devolve o tamanho total do prefixo + metadata.
+  int32_t message(const flatbuffers::FlatBufferBuilder &b) {
+    uint32_t size = b.GetSize();
+    uint32_t padded = (size + 8 + 7) / 8 * 8 - 8;
+    uint32_t cont = 0xFFFFFFFF;
+    write(&cont, 4);
+    write(&padded, 4);
+    write(b.GetBufferPointer(), size);
+    zeros(padded - size);
+    return static_cast<int32_t>(padded + 8);
+  }
+
+  void eos() {
+    uint32_t marker[2] = {0xFFFFFFFF, 0};
+    write(marker, sizeof(marker));
+  }
+
+  size_t pos() const { return pos_; }
+
+  void close() {
+    out_.close();
+    if (!out_)
+      throw std::runtime_error("export_arrow: falha de escrita");
+  }
+
+private:
+  std::ofstream out_;
+  size_t pos_ = 0;
+};
+
+} // namespace
+
+// -------------------------------
+// EXPORT
+// -------------------------------
+size_t export_arrow(LayoutEngine &engine, const std::string &field,
+                    const std::string &path, ArrowFormat format) {
+  auto const &map = engine.get_layout();
+  auto it = map.field_index.find(field);
+  if (it == map.field_index.end())
+    throw std::runtime_error("export_arrow: campo inexistente: " + field);
+  auto const &arr = map.fields[it->second];
+  if (arr.type != FieldType::Array)
+    throw std::runtime_error("export_arrow: campo não é object[]: " + field);
+
+  // Um passe pelos itens: cada item é lido de uma vez para todas as colunas
+  // (layout AoS no buffer; as colunas Arrow são montadas aqui)
+  auto *count = reinterpret_cast<uint32_t *>(
+      static_cast<char *>(engine.mmap_base()) + arr.count_offset);
+  size_t n = __atomic_load_n(count, __ATOMIC_ACQUIRE);
+  std::vector<std::vector<char>> columns(arr.children.size());
+  for (size_t c = 0; c < arr.children.size(); ++c)
+    columns[c].resize(n * arr.children[c].size);
+  size_t rows = 0;
+  for (size_t i = 0; i < n; ++i) {
+    auto *item = static_cast<const char *>(engine.get(field, i));
+    if (!item)
+      continue;
+    for (size_t c = 0; c < arr.children.size(); ++c) {
+      auto const &ch = arr.children[c];
+      memcpy(columns[c].data() + rows * ch.size, item + ch.offset, ch.size);
+    }
+    ++rows;
+  }
+
+  // Corpo: por coluna, validade vazia (null_count 0) + valores
+  std::vector<FieldNode> nodes;
+  std::vector<BufferDesc> buffers;
+  int64_t body_len = 0;
+  for (size_t c = 0; c < arr.children.size(); ++c) {
+    int64_t len = static_cast<int64_t>(rows * arr.children[c].size);
+    nodes.push_back({static_cast<int64_t>(rows), 0});
+    buffers.push_back({body_len, 0});
+    buffers.push_back({body_len, len});
+    body_len += (len + BODY_ALIGN - 1) / BODY_ALIGN * BODY_ALIGN;
+  }
+
+  IpcWriter out(path);
+  if (format == ArrowFormat::File)
+    out.write("ARROW1\0\0", 8);
+
+  flatbuffers::FlatBufferBuilder schema_fb;
+  finish_message(schema_fb, HEADER_SCHEMA, arrow_schema(schema_fb, arr), 0);
+  out.message(schema_fb);
+
+  flatbuffers::FlatBufferBuilder batch_fb;
+  {
+    auto &b = batch_fb;
+    auto nv = b.CreateVectorOfStructs(nodes.data(), nodes.size());
+    auto bv = b.CreateVectorOfStructs(buffers.data(), buffers.size());
+    auto start = b.StartTable();
+    b.AddElement<int64_t>(vt(0), static_cast<int64_t>(rows), 0);
+    b.AddOffset(vt(1), nv);
+    b.AddOffset(vt(2), bv);
+    finish_message(b, HEADER_RECORD_BATCH, Table(b.EndTable(start)), body_len);
+  }
+  Block block{static_cast<int64_t>(out.pos()), 0, 0, body_len};
+  block.meta_len = out.message(batch_fb);
+  for (size_t c = 0; c < columns.size(); ++c) {
+    size_t len = rows * arr.children[c].size;
+    out.write(columns[c].data(), len);
+    out.zeros((BODY_ALIGN - len % BODY_ALIGN) % BODY_ALIGN);
+  }
+  out.eos();
+
+  if (format == ArrowFormat::File) {
+    // Footer { version, schema, dictionaries, recordBatches }
+    flatbuffers::FlatBufferBuilder b;
+    auto schema = arrow_schema(b, arr);
+    auto dicts = b.CreateVectorOfStructs(static_cast<Block *>(nullptr), 0);
+    auto batches = b.CreateVectorOfStructs(&block, 1);
+    auto start = b.StartTable();
+    b.AddOffset(vt(1), schema);
+    b.AddOffset(vt(2), dicts);
+    b.AddOffset(vt(3), batches);
+    b.AddElement<int16_t>(vt(0), METADATA_V5, 0);
+    b.Finish(Table(b.EndTable(start)));
+    out.write(b.GetBufferPointer(), b.GetSize());
+    int32_t footer_len = static_cast<int32_t>(b.GetSize());
+    out.write(&footer_len, 4);
+    out.write("ARROW1", 6);
+  }
+  out.close();
+  return rows;
+}
@@ -0,0 +1,529 @@
+#include "json_io.hpp"
+
+#include <cfloat>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+using json = nlohmann::json;
+
+// -------------------------------
+// BASE64 (blob)
+// -------------------------------
+static const char B64[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static int b64_value(char c) {
+  if (c >= 'A' && c <= 'Z')
+    return c - 'A';
+  if (c >= 'a' && c <= 'z')
+    return c - 'a' + 26;
+  if (c >= '0' && c <= '9')
+    return c - '0' + 52;
+  if (c == '+')
+    return 62;
+  if (c == '/')
+    return 63;
+  return -1;
+}
+
+static std::string b64_decode(const std::string &in) {
+  std::string out;
+  out.reserve(in.size() / 4 * 3);
+  uint32_t acc = 0;
+  int bits = 0;
+  for (char c : in) {
+    if (c == '=')
+      break;
+    int v = b64_value(c);
+    if (v < 0)
+      throw std::runtime_error("load_json: base64 inválido");
+    acc = (acc << 6) | static_cast<uint32_t>(v);
+    bits += 6;
+    if (bits >= 8) {
+      bits -= 8;
+      out.push_back(static_cast<char>((acc >> bits) & 0xff));
+    }
+  }
+  return out;
+}
+
+// -------------------------------
+// WRITER
+// -------------------------------
+// Buffer fixo descarregado com fwrite: nenhuma alocação por valor
+namespace {
+
+class JsonWriter {
+public:
+  explicit JsonWriter(std::FILE *out) : out_(out) {}
+
+  void raw(const char *s, size_t n) {
+    if (len_ + n > sizeof(buf_)) {
+      flush();
+      if (n > sizeof(buf_)) {
+        put(s, n);
+        return;
+      }
+    }
+    memcpy(buf_ + len_, s, n);
+    len_ += n;
+  }
+  void raw(const char *s) { raw(s, strlen(s)); }
+  void ch(char c) { raw(&c, 1); }
+
+  void key(const std::string &k) {
+    str(k.data(), k.size());
+    ch(':');
+  }
+
+  void str(const char *s, size_t n) {
+    ch('"');
+    size_t run = 0; // trecho sem escape copiado de uma vez
+    for (size_t i = 0; i < n; ++i) {
+      unsigned char c = static_cast<unsigned char>(s[i]);
+      if (c >= 0x20 && c != '"' && c != '\\')
+        continue;
+      raw(s + run, i - run);
+      run = i + 1;
+      char esc[8];
+      switch (c) {
+      case '"':
+        raw("\\\"", 2);
+        break;
+      case '\\':
+        raw("\\\\", 2);
+        break;
+      case '\n':
+        raw("\\n", 2);
+        break;
+      case '\t':
+        raw("\\t", 2);
+        break;
+      default:
+        std::snprintf(esc, sizeof(esc), "\\u%04x", c);
+        raw(esc, 6);
+      }
+    }
+    raw(s + run, n - run);
+    ch('"');
+  }
+
+  void base64(const unsigned char *p, size_t n) {
+    ch('"');
+    char q[4];
+    for (size_t i = 0; i < n; i += 3) {
+      uint32_t v = p[i] << 16;
+      if (i + 1 < n)
+        v |= p[i + 1] << 8;
+      if (i + 2 < n)
+        v |= p[i + 2];
+      q[0] = B64[(v >> 18) & 63];
+      q[1] = B64[(v >> 12) & 63];
+      q[2] = i + 1 < n ? B64[(v >> 6) & 63] : '=';
+      q[3] = i + 2 < n ? B64[v & 63] : '=';
+      raw(q, 4);
+    }
+    ch('"');
+  }
+
+  template <typename T> void num(T v) {
+    if constexpr (std::is_floating_point_v<T>) {
+      if (!std::isfinite(v)) { // JSON não tem NaN/Inf
+        raw("null", 4);
+        return;
+      }
+    }
+    char tmp[32];
+    auto r = std::to_chars(tmp, tmp + sizeof(tmp), v);
+    raw(tmp, r.ptr - tmp);
+  }
+
+  void flush() {
+    put(buf_, len_);
+    len_ = 0;
+  }
+
+private:
+  void put(const char *s, size_t n) {
+    if (n && std::fwrite(s, 1, n, out_) != n)
+      throw std::runtime_error("dump_json: falha de escrita");
+  }
+
+  std::FILE *out_;
+  char buf_[1 << 16];
+  size_t len_ = 0;
+};
+
+template <typename T> T load_scalar(const char *p) {
+  T v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+void write_scalar(JsonWriter &w, const FieldLayout &f, const char *p) {
+  switch (f.type) {
+  case FieldType::Int32:
+    w.num(load_scalar<int32_t>(p));
+    break;
+  case FieldType::Int64:
+    w.num(load_scalar<int64_t>(p));
+    break;
+  case FieldType::Float32:
+    w.num(load_scalar<float>(p));
+    break;
+  case FieldType::Float64:
+    w.num(load_scalar<double>(p));
+    break;
+  default:
+    throw std::runtime_error("dump_json: tipo sem representação: " + f.name);
+  }
+}
+
+// { "sub": v, ... } de um object ou item de array
+void write_record(JsonWriter &w, const FieldLayout &f, const char *p) {
+  w.ch('{');
+  for (size_t c = 0; c < f.children.size(); ++c) {
+    if (c)
+      w.ch(',');
+    w.key(f.children[c].name);
+    write_scalar(w, f.children[c], p + f.children[c].offset);
+  }
+  w.ch('}');
+}
+
+void write_field(JsonWriter &w, LayoutEngine &engine, const FieldLayout &f) {
+  switch (f.type) {
+  case FieldType::String:
+  case FieldType::VarString: {
+    auto v = engine.get_bytes(f.name);
+    w.str(v.data(), v.size());
+    break;
+  }
+  case FieldType::Blob: {
+    auto v = engine.get_bytes(f.name);
+    w.base64(reinterpret_cast<const unsigned char *>(v.data()), v.size());
+    break;
+  }
+  case FieldType::Object:
+    write_record(w, f, static_cast<const char *>(engine.get(f.name)));
+    break;
+  default:
+    write_scalar(w, f, static_cast<const char *>(engine.get(f.name)));
+  }
+}
+
+} // namespace
+
+size_t dump_json(LayoutEngine &engine, const std::string &path,
+                 JsonFormat format) {
+  std::unique_ptr<std::FILE, int (*)(std::FILE *)> file(nullptr, std::fclose);
+  std::FILE *out = stdout;
+  if (path != "-") {
+    file.reset(std::fopen(path.c_str(), "wb"));
+    if (!(out = file.get()))
+      throw std::runtime_error("dump_json: não abriu " + path);
+  }
+  auto const &map = engine.get_layout();
+  size_t items = 0;
+  {
+    JsonWriter w(out);
+    bool ndjson = format == JsonFormat::Ndjson;
+    // Campos simples primeiro (em NDJSON, a primeira linha)
+    bool first = true;
+    w.ch('{');
+    for (auto const &f : map.fields) {
+      if (f.type == FieldType::Array)
+        continue;
+      if (!first)
+        w.ch(',');
+      first = false;
+      w.key(f.name);
+      write_field(w, engine, f);
+    }
+    if (ndjson)
+      w.raw("}\n", 2);
+    for (auto const &f : map.fields) {
+      if (f.type != FieldType::Array)
+        continue;
+      auto *cnt = reinterpret_cast<const uint32_t *>(
+          static_cast<const char *>(engine.mmap_base()) + f.count_offset);
+      size_t n = __atomic_load_n(cnt, __ATOMIC_ACQUIRE);
+      if (!ndjson) {
+        if (!first)
+          w.ch(',');
+        first = false;
+        w.key(f.name);
+        w.ch('[');
+      }
+      bool first_item = true;
+      for (size_t i = 0; i < n; ++i) {
+        auto *item = static_cast<const char *>(engine.get(f.name, i));
+        if (!item)
+          continue;
+        if (ndjson) {
+          w.ch('{');
+          w.key(f.name);
+        } else {
+          w.raw(",\n" + first_item, 2 - first_item);
+        }
+        first_item = false;
+        write_record(w, f, item);
+        if (ndjson)
+          w.raw("}\n", 2);
+        ++items;
+      }
+      if (!ndjson)
+        w.raw(first_item ? "]" : "\n]");
+    }
+    if (!ndjson)
+      w.raw("}\n", 2);
+    w.flush();
+  }
+  if (std::fflush(out) != 0)
+    throw std::runtime_error("dump_json: falha de escrita");
+  return items;
+}
+
+// -------------------------------
+// READER (SAX)
+// -------------------------------
+namespace {
+
+// Estados: raiz -> campo de topo -> (object | array -> item)
+class LoadHandler : public json::json_sax_t {
+public:
+  explicit LoadHandler(LayoutEngine &engine)
+      : engine_(engine), map_(engine.get_layout()) {}
+
+  size_t items = 0;
+
+  // null mantém o valor atual
+  bool null() override {
+    if (depth_ == 1)
+      field_ = nullptr;
+    else
+      child_ = nullptr;
+    return true;
+  }
+  bool boolean(bool v) override { return number({v ? 1.0 : 0.0, v, true}); }
+  bool number_integer(number_integer_t v) override {
+    return number({static_cast<double>(v), v, true});
+  }
+  bool number_unsigned(number_unsigned_t v) override {
+    // acima de INT64_MAX só cabe em campo float
+    bool fits = v <= static_cast<uint64_t>(INT64_MAX);
+    return number({static_cast<double>(v), fits ? static_cast<int64_t>(v) : 0,
+                   fits});
+  }
+  bool number_float(number_float_t v, const string_t &) override {
+    return number({v, 0, false});
+  }
+
+  bool string(string_t &v) override {
+    if (depth_ != 1 || !field_)
+      throw std::runtime_error("load_json: string fora de campo string");
+    if (field_->type == FieldType::Blob) {
+      auto bytes = b64_decode(v);
+      engine_.set_bytes(field_->name, bytes.data(), bytes.size());
+    } else if (field_->type == FieldType::String ||
+               field_->type == FieldType::VarString) {
+      engine_.set_bytes(field_->name, v.data(), v.size());
+    } else {
+      throw std::runtime_error("load_json: string em campo numérico: " +
+                               field_->name);
+    }
+    field_ = nullptr;
+    return true;
+  }
+
+  bool binary(binary_t &) override {
+    throw std::runtime_error("load_json: valor binário não suportado");
+  }
+
+  bool start_object(std::size_t) override {
+    ++depth_;
+    if (depth_ == 1)
+      return true; // raiz
+    if (!field_)
+      throw std::runtime_error("load_json: objeto fora de campo");
+    if (field_->type == FieldType::Object) {
+      // parte dos valores atuais: subcampos ausentes ficam como estão
+      record_.assign(field_->size, 0);
+      memcpy(record_.data(), engine_.get(field_->name), field_->size);
+    } else if (field_->type == FieldType::Array &&
+               (depth_ == 2 || (depth_ == 3 && in_array_))) {
+      // NDJSON ({"arr": {item}}) ou item dentro de [ ... ]
+      record_.assign(field_->item_stride - (field_->has_used_flag ? 1 : 0), 0);
+    } else {
+      throw std::runtime_error("load_json: objeto inesperado em " +
+                               field_->name);
+    }
+    return true;
+  }
+
+  bool key(string_t &k) override {
+    if (depth_ == 1) {
+      auto it = map_.field_index.find(k);
+      if (it == map_.field_index.end())
+        throw std::runtime_error("load_json: campo desconhecido: " + k);
+      field_ = &map_.fields[it->second];
+      return true;
+    }
+    auto it = field_->field_index.find(k);
+    if (it == field_->field_index.end())
+      throw std::runtime_error("load_json: subcampo desconhecido: " +
+                               field_->name + "." + k);
+    child_ = &field_->children[it->second];
+    return true;
+  }
+
+  bool end_object() override {
+    --depth_;
+    if (depth_ == 0 || !field_)
+      return true;
+    if (field_->type == FieldType::Object) {
+      engine_.set(field_->name, record_.data());
+      field_ = nullptr;
+    } else {
+      engine_.insert(field_->name, record_.data());
+      ++items;
+      if (!in_array_)
+        field_ = nullptr;
+    }
+    child_ = nullptr;
+    return true;
+  }
+
+  bool start_array(std::size_t) override {
+    if (depth_ != 1 || !field_ || field_->type != FieldType::Array)
+      throw std::runtime_error("load_json: array fora de campo object[]");
+    in_array_ = true;
+    ++depth_;
+    return true;
+  }
+
+  bool end_array() override {
+    in_array_ = false;
+    field_ = nullptr;
+    --depth_;
+    return true;
+  }
+
+  bool parse_error(std::size_t pos, const std::string &,
+                   const nlohmann::detail::exception &ex) override {
+    throw std::runtime_error("load_json: erro na posição " +
+                             std::to_string(pos) + ": " + ex.what());
+  }
+
+private:
+  // Valor lido; `i` só vale com `exact` (inteiro do JSON que cabe em int64)
+  struct Number {
+    double d;
+    int64_t i;
+    bool exact;
+  };
+
+  // Inteiros fora do intervalo do campo (ou float que não trunca para
+  // dentro dele, inclusive NaN) lançam em vez de truncar. [lo, hi + 1) em
+  // double é exato nos dois tipos: hi + 1 arredonda para 2^63 no int64.
+  static int64_t to_int(const Number &n, int64_t lo, int64_t hi,
+                        const char *type, const std::string &name) {
+    bool ok = n.exact ? n.i >= lo && n.i <= hi
+                      : n.d >= static_cast<double>(lo) &&
+                            n.d < static_cast<double>(hi) + 1.0;
+    if (!ok)
+      throw std::runtime_error(std::string("load_json: valor fora do intervalo de ") +
+                               type + " em " + name);
+    return n.exact ? n.i : static_cast<int64_t>(n.d);
+  }
+
+  static void store(char *p, FieldType t, const Number &n,
+                    const std::string &name) {
+    switch (t) {
+    case FieldType::Int32: {
+      int32_t v = static_cast<int32_t>(
+          to_int(n, INT32_MIN, INT32_MAX, "int32", name));
+      memcpy(p, &v, sizeof(v));
+      break;
+    }
+    case FieldType::Int64: {
+      int64_t v = to_int(n, INT64_MIN, INT64_MAX, "int64", name);
+      memcpy(p, &v, sizeof(v));
+      break;
+    }
+    case FieldType::Float32: {
+      if (std::isfinite(n.d) && std::fabs(n.d) > FLT_MAX)
+        throw std::runtime_error("load_json: valor fora do intervalo de float32 em " +
+                                 name);
+      float v = static_cast<float>(n.d);
+      memcpy(p, &v, sizeof(v));
+      break;
+    }
+    case FieldType::Float64:
+      memcpy(p, &n.d, sizeof(n.d));
+      break;
+    default:
+      throw std::runtime_error("load_json: número em campo não numérico");
+    }
+  }
+
+  bool number(const Number &n) {
+    if (depth_ == 1) {
+      if (!field_ || field_->type == FieldType::Object ||
+          field_->type == FieldType::Array)
+        throw std::runtime_error("load_json: número fora de campo escalar");
+      char tmp[8];
+      store(tmp, field_->type, n, field_->name);
+      engine_.set(field_->name, tmp);
+      field_ = nullptr;
+    } else {
+      if (!child_)
+        throw std::runtime_error("load_json: número fora de subcampo");
+      store(record_.data() + child_->offset, child_->type, n,
+            field_->name + "." + child_->name);
+      child_ = nullptr;
+    }
+    return true;
+  }
+
+  LayoutEngine &engine_;
+  const LayoutMap &map_;
+  const FieldLayout *field_ = nullptr;
+  const FieldLayout *child_ = nullptr;
+  std::vector<char> record_;
+  int depth_ = 0;
+  bool in_array_ = false;
+};
+
+} // namespace
+
+size_t load_json(LayoutEngine &engine, const std::string &path,
+                 JsonFormat format) {
+  std::ifstream file;
+  if (path != "-") {
+    file.open(path, std::ios::binary);
+    if (!file)
+      throw std::runtime_error("load_json: não abriu " + path);
+  }
+  std::istream &in = path == "-" ? std::cin : file;
+  LoadHandler h(engine);
+  if (format == JsonFormat::Json) {
+    json::sax_parse(in, &h);
+    return h.items;
+  }
+  // NDJSON: um documento por linha, buffer da linha reaproveitado
+  std::string line;
+  while (std::getline(in, line))
+    if (line.find_first_not_of(" \t\r") != std::string::npos)
+      json::sax_parse(line, &h);
+  return h.items;
+}
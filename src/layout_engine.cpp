@@ -1,14 +1,21 @@
 #include "layout_engine.hpp"
 #include "layout_map_generated.h" // FlatBuffers schema
+#include "stats.hpp"
 
+#include <algorithm>
+#include <chrono>
+#include <cstring>
 #include <fstream>
 #include <iostream>
 #include <regex>
 #include <stdexcept>
+#include <thread>
 
 // Para mmap
+#include <cerrno>
 #include <fcntl.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 // JSON alias
@@ -24,15 +31,178 @@ void LayoutEngine::load_layout_json(const std::string &path) {
   json root = json::parse(f);
   if (!root.contains("layout"))
     throw std::runtime_error("layout.json inválido: faltando 'layout'");
-  build_layout(root["layout"]);
+  LayoutOptions opts;
+  // "stats": true (slots padrão) ou { "slots": N }
+  if (root.contains("stats")) {
+    auto const &st = root["stats"];
+    if (st.is_boolean())
+      opts.stats_slots = st.get<bool>() ? DEFAULT_STATS_SLOTS : 0;
+    else
+      opts.stats_slots = st.value("slots", DEFAULT_STATS_SLOTS);
+  }
+  // "arena": N ou { "size": N } — capacidade para varstring/blob
+  if (root.contains("arena")) {
+    auto const &ar = root["arena"];
+    opts.arena_size = ar.is_number() ? ar.get<size_t>() : ar.at("size").get<size_t>();
+  }
+  // "pool": N ou { "type": "pool", "instances": N }
+  if (root.contains("pool")) {
+    auto const &pl = root["pool"];
+    opts.pool_instances =
+        pl.is_number() ? pl.get<size_t>() : pl.at("instances").get<size_t>();
+    if (opts.pool_instances == 0)
+      throw std::runtime_error("layout.json inválido: pool com 0 instâncias");
+  }
+  build_layout(root["layout"], opts);
 }
 
-void LayoutEngine::build_layout(const json &layout_def) {
-  size_t offset = 0;
+// -------------------------------
+// VALORES PADRÃO ("default")
+// -------------------------------
+// Bytes nativos de um escalar (mesma representação de set())
+static std::string encode_scalar(const FieldLayout &f, const json &v,
+                                 const std::string &what) {
+  if (!v.is_number())
+    throw std::runtime_error("default não numérico em " + what);
+  std::string out(f.size, '\0');
+  switch (f.type) {
+  case FieldType::Int32: {
+    if (!v.is_number_integer())
+      throw std::runtime_error("default não inteiro em " + what);
+    if (v.get<int64_t>() < INT32_MIN || v.get<int64_t>() > INT32_MAX)
+      throw std::runtime_error("default fora de int32 em " + what);
+    int32_t x = v.get<int32_t>();
+    memcpy(out.data(), &x, sizeof(x));
+    break;
+  }
+  case FieldType::Int64: {
+    if (!v.is_number_integer())
+      throw std::runtime_error("default não inteiro em " + what);
+    int64_t x = v.get<int64_t>();
+    memcpy(out.data(), &x, sizeof(x));
+    break;
+  }
+  case FieldType::Float32: {
+    float x = v.get<float>();
+    memcpy(out.data(), &x, sizeof(x));
+    break;
+  }
+  case FieldType::Float64: {
+    double x = v.get<double>();
+    memcpy(out.data(), &x, sizeof(x));
+    break;
+  }
+  default:
+    throw std::runtime_error("default não suportado em " + what);
+  }
+  return out;
+}
+
+static std::string encode_default(const FieldLayout &f, const json &v) {
+  switch (f.type) {
+  case FieldType::String:
+  case FieldType::VarString:
+  case FieldType::Blob: {
+    if (!v.is_string())
+      throw std::runtime_error("default deve ser string em " + f.name);
+    auto str = v.get<std::string>();
+    if (f.type == FieldType::String && str.size() > f.max_length - 1)
+      throw std::runtime_error("default maior que max_length - 1 em " + f.name);
+    return str;
+  }
+  case FieldType::Object: {
+    // { "subcampo": valor, ... }; subcampos omitidos ficam zerados
+    if (!v.is_object())
+      throw std::runtime_error("default deve ser objeto em " + f.name);
+    std::string out(f.size, '\0');
+    for (auto const &[key, val] : v.items()) {
+      auto it = f.field_index.find(key);
+      if (it == f.field_index.end())
+        throw std::runtime_error("default com subcampo desconhecido: " +
+                                 f.name + "." + key);
+      auto const &ch = f.children[it->second];
+      out.replace(ch.offset, ch.size, encode_scalar(ch, val, f.name + "." + key));
+    }
+    return out;
+  }
+  case FieldType::Array:
+    throw std::runtime_error("default não suportado em object[]: " + f.name);
+  default:
+    return encode_scalar(f, v, f.name);
+  }
+}
+
+void build_default_image(LayoutMap &map) {
+  std::vector<DefaultRun> parts;
+  std::string arena(ARENA_RESERVED, '\0');
+  uint64_t live = 0;
+  for (auto const &f : map.fields) {
+    auto const &d = f.default_value;
+    if (d.empty())
+      continue;
+    if (f.type == FieldType::String) {
+      uint32_t n = static_cast<uint32_t>(d.size());
+      std::string slot(reinterpret_cast<const char *>(&n), sizeof(n));
+      parts.push_back({f.offset, slot + d});
+    } else if (f.type == FieldType::VarString || f.type == FieldType::Blob) {
+      // alocado por bump a partir do início da arena, como set_bytes
+      uint64_t ref = arena.size() | uint64_t(d.size()) << 32;
+      arena += d;
+      if (f.type == FieldType::VarString)
+        arena += '\0';
+      live += d.size();
+      if (arena.size() > map.arena_size)
+        throw std::runtime_error("defaults não cabem na arena: " + f.name);
+      parts.push_back(
+          {f.offset, std::string(reinterpret_cast<const char *>(&ref), 8)});
+    } else {
+      parts.push_back({f.offset, d});
+    }
+  }
+  if (arena.size() > ARENA_RESERVED) {
+    ArenaHeader ah{};
+    ah.top = arena.size();
+    ah.live = live;
+    parts.push_back({map.arena_offset,
+                     std::string(reinterpret_cast<const char *>(&ah),
+                                 2 * sizeof(uint64_t))});
+    parts.push_back({map.arena_offset + sizeof(ArenaHeader), arena});
+  }
+  std::sort(parts.begin(), parts.end(),
+            [](auto const &x, auto const &y) { return x.offset < y.offset; });
+  std::vector<DefaultRun> runs;
+  for (auto &p : parts) {
+    if (!runs.empty()) {
+      auto &last = runs.back();
+      size_t end = last.offset + last.bytes.size();
+      if (p.offset <= end + DEFAULT_RUN_GAP) {
+        last.bytes.append(p.offset - end, '\0');
+        last.bytes += p.bytes;
+        continue;
+      }
+    }
+    runs.push_back(std::move(p));
+  }
+  map.default_image = std::move(runs);
+}
+
+void LayoutEngine::build_layout(const json &layout_def,
+                                const LayoutOptions &opts) {
+  // Mapa novo: instâncias que compartilham o anterior não são afetadas
+  LayoutMap map;
+  // Os primeiros bytes do buffer são do LayoutHeader
+  size_t offset = LAYOUT_HEADER_SIZE;
   for (auto it = layout_def.begin(); it != layout_def.end(); ++it) {
     FieldLayout field;
     field.name = it.key();
     const auto &def = it.value();
+    // Afinidade NUMA: o campo ocupa páginas inteiras, só dele
+    field.numa_node = def.value("numa_node", -1);
+    if (field.numa_node > 63)
+      throw std::runtime_error("numa_node acima de 63 em " + field.name);
+    if (field.numa_node >= 0)
+      offset = (offset + 4095) & ~size_t(4095);
+    field.offset = offset;
     std::string type = def["type"];
 
     if (type == "int32")
@@ -46,12 +216,19 @@ void LayoutEngine::build_layout(const json &layout_def) {
     else if (type == "string") {
       field.type = FieldType::String;
       field.max_length = def.value("max_length", 256ULL);
-      field.size = field.max_length;
+      if (field.max_length == 0)
+        throw std::runtime_error("layout.json inválido: max_length 0 em " +
+                                 field.name);
+      field.size = STRING_LEN_PREFIX + field.max_length;
+    } else if (type == "varstring" || type == "blob") {
+      field.type = type == "blob" ? FieldType::Blob : FieldType::VarString;
+      field.size = 8;
     } else if (type == "object" || type == "object[]") {
       bool isArray = (type == "object[]");
       field.type = isArray ? FieldType::Array : FieldType::Object;
       if (isArray) {
         field.max_items = def["max_items"];
+        field.chunk_items = def.value("chunk_items", 0ULL);
         field.count_offset = offset;
         offset += 4;
         field.has_used_flag = true;
@@ -75,19 +252,139 @@ void LayoutEngine::build_layout(const json &layout_def) {
       if (isArray) {
         field.item_stride = inner_offset + (field.has_used_flag ? 1 : 0);
         field.size = field.item_stride * field.max_items;
+        if (field.chunk_items) {
+          // capacidade arredondada para chunks inteiros; no registro fica só
+          // o diretório (padding + um uint64 por chunk)
+          size_t chunks =
+              (field.max_items + field.chunk_items - 1) / field.chunk_items;
+          field.max_items = chunks * field.chunk_items;
+          field.size = CHUNK_DIR_OFFSET - 4 + chunks * sizeof(uint64_t);
+        }
       } else {
         field.size = inner_offset;
       }
     } else {
       throw std::runtime_error("Tipo desconhecido: " + type);
     }
+    if (def.contains("default"))
+      field.default_value = encode_default(field, def["default"]);
 
-    field.offset = offset;
-    map_.field_index[field.name] = map_.fields.size();
-    map_.fields.push_back(field);
+    map.field_index[field.name] = map.fields.size();
+    map.fields.push_back(field);
     offset += field.size;
+    if (field.numa_node >= 0)
+      offset = (offset + 4095) & ~size_t(4095);
+  }
+  // Arena após os campos, se algum campo a referencia
+  bool has_arena = false;
+  for (auto const &f : map.fields)
+    has_arena |= f.type == FieldType::VarString || f.type == FieldType::Blob;
+  if (has_arena) {
+    size_t cap = opts.arena_size ? opts.arena_size : DEFAULT_ARENA_SIZE;
+    if (cap > UINT32_MAX)
+      throw std::runtime_error("arena maior que 4 GiB");
+    offset = (offset + 63) & ~size_t(63);
+    map.arena_offset = offset;
+    map.arena_size = cap;
+    offset += sizeof(ArenaHeader) + cap;
   }
-  map_.total_size = offset;
+  // Seção de estatísticas após os campos, alinhada em linha de cache
+  if (opts.stats_slots) {
+    offset = (offset + alignof(FieldStats) - 1) & ~(alignof(FieldStats) - 1);
+    map.stats_offset = offset;
+    map.stats_slots = opts.stats_slots;
+    offset += opts.stats_slots * map.fields.size() * sizeof(FieldStats);
+  }
+  // Região de crescimento: GrowControl no fim do buffer base, chunks a partir
+  // do limite de página seguinte
+  size_t grow = 0;
+  for (auto const &f : map.fields)
+    if (f.chunk_items)
+      grow += f.max_items / f.chunk_items * chunk_bytes(f);
+  if (grow) {
+    if (opts.pool_instances)
+      throw std::runtime_error("pool não suporta arrays com chunk_items");
+    offset = (offset + 63) & ~size_t(63);
+    offset = (offset + sizeof(GrowControl) + 4095) & ~size_t(4095);
+    map.grow_offset = offset;
+    map.grow_size = grow;
+  }
+  map.total_size = offset;
+  map.header_size = LAYOUT_HEADER_SIZE;
+  // Pool: registros alinhados em 64 após o bitmap (1 bit por instância)
+  if (opts.pool_instances) {
+    size_t words = (opts.pool_instances + 63) / 64;
+    map.pool_instances = opts.pool_instances;
+    map.instance_stride = (offset + 63) & ~size_t(63);
+    map.pool_offset = (POOL_BITMAP_OFFSET + words * 8 + 63) & ~size_t(63);
+    // campos com numa_node precisam das mesmas páginas em cada instância
+    bool numa = false;
+    for (auto const &f : map.fields)
+      numa |= f.numa_node >= 0;
+    if (numa) {
+      map.instance_stride = (map.instance_stride + 4095) & ~size_t(4095);
+      map.pool_offset = (map.pool_offset + 4095) & ~size_t(4095);
+    }
+  }
+  map.fingerprint = layout_fingerprint(map);
+  build_default_image(map);
+  map_ = std::make_shared<const LayoutMap>(std::move(map));
+}
+
+// -------------------------------
+// LAYOUT FINGERPRINT
+// -------------------------------
+static void fnv1a(uint64_t &h, const void *data, size_t len) {
+  auto p = static_cast<const uint8_t *>(data);
+  for (size_t i = 0; i < len; ++i) {
+    h ^= p[i];
+    h *= 0x100000001b3ULL;
+  }
+}
+
+static void fnv1a_u64(uint64_t &h, uint64_t v) { fnv1a(h, &v, sizeof(v)); }
+
+static void fingerprint_field(uint64_t &h, const FieldLayout &f) {
+  fnv1a(h, f.name.data(), f.name.size() + 1);
+  fnv1a_u64(h, static_cast<uint64_t>(f.type));
+  fnv1a_u64(h, f.offset);
+  fnv1a_u64(h, f.size);
+  fnv1a_u64(h, f.count_offset);
+  fnv1a_u64(h, f.item_stride);
+  fnv1a_u64(h, f.max_items);
+  fnv1a_u64(h, f.has_used_flag);
+  fnv1a_u64(h, f.chunk_items);
+  // numa_node e default_value ficam fora: não mudam o formato do buffer (o
+  // alinhamento NUMA já está nos offsets)
+  fnv1a_u64(h, f.children.size());
+  for (auto const &c : f.children)
+    fingerprint_field(h, c);
+}
+
+uint64_t layout_fingerprint(const LayoutMap &map) {
+  uint64_t h = 0xcbf29ce484222325ULL;
+  fnv1a_u64(h, LAYOUT_FORMAT_VERSION);
+  fnv1a_u64(h, map.header_size);
+  fnv1a_u64(h, map.total_size);
+  fnv1a_u64(h, map.stats_offset);
+  fnv1a_u64(h, map.stats_slots);
+  fnv1a_u64(h, map.pool_instances);
+  fnv1a_u64(h, map.pool_offset);
+  fnv1a_u64(h, map.instance_stride);
+  fnv1a_u64(h, map.arena_offset);
+  fnv1a_u64(h, map.arena_size);
+  fnv1a_u64(h, map.grow_offset);
+  fnv1a_u64(h, map.grow_size);
+  fnv1a_u64(h, map.fields.size());
+  for (auto const &f : map.fields)
+    fingerprint_field(h, f);
+  return h;
+}
+
+size_t layout_buffer_size(const LayoutMap &map) {
+  if (map.pool_instances)
+    return map.pool_offset + map.pool_instances * map.instance_stride;
+  return map.total_size;
 }
 
 // -------------------------------
@@ -102,18 +399,30 @@ void LayoutEngine::save_map_flatbuf(const std::string &path) {
     std::vector<flatbuffers::Offset<Layout::Field>> children;
     for (auto const &c : f.children)
       children.push_back(build_field(c));
+    flatbuffers::Offset<flatbuffers::Vector<uint8_t>> dflt;
+    if (!f.default_value.empty())
+      dflt = builder.CreateVector(
+          reinterpret_cast<const uint8_t *>(f.default_value.data()),
+          f.default_value.size());
     return Layout::CreateField(builder, builder.CreateString(f.name),
                                static_cast<Layout::FieldType>(f.type), f.offset,
                                f.size, f.count_offset, f.item_stride,
                                f.max_items, f.has_used_flag,
-                               builder.CreateVector(children));
+                               builder.CreateVector(children), f.chunk_items,
+                               f.numa_node, dflt);
   };
   std::vector<flatbuffers::Offset<Layout::Field>> vec;
-  for (auto const &f : map_.fields)
+  for (auto const &f : map_->fields)
     vec.push_back(build_field(f));
 
-  auto lm = Layout::CreateLayoutMap(builder, map_.total_size,
-                                    builder.CreateVector(vec));
+  auto lm = Layout::CreateLayoutMap(builder, map_->total_size,
+                                    builder.CreateVector(vec),
+                                    map_->header_size, map_->fingerprint,
+                                    map_->stats_offset, map_->stats_slots,
+                                    map_->pool_instances, map_->pool_offset,
+                                    map_->instance_stride, map_->arena_offset,
+                                    map_->arena_size, map_->grow_offset,
+                                    map_->grow_size);
   builder.Finish(lm);
 
   std::ofstream out(path, std::ios::binary);
@@ -131,9 +440,8 @@ void LayoutEngine::load_map_flatbuf(const std::string &path) {
   in.read(buf.data(), sz);
 
   auto lm = Layout::GetLayoutMap(buf.data());
-  map_.total_size = lm->total_size();
-  map_.fields.clear();
-  map_.field_index.clear();
+  LayoutMap map;
+  map.total_size = lm->total_size();
 
   std::function<FieldLayout(const Layout::Field *)> parse_field;
   parse_field = [&](auto const *f) -> FieldLayout {
@@ -146,6 +454,13 @@ void LayoutEngine::load_map_flatbuf(const std::string &path) {
     L.item_stride = f->stride();
     L.max_items = f->max_items();
     L.has_used_flag = f->has_used_flag();
+    L.chunk_items = f->chunk_items();
+    L.numa_node = f->numa_node();
+    if (auto const *d = f->default_value())
+      L.default_value.assign(reinterpret_cast<const char *>(d->data()),
+                             d->size());
+    if (L.type == FieldType::String)
+      L.max_length = L.size - STRING_LEN_PREFIX;
     if (f->children()) {
       for (auto const *c : *f->children()) {
         auto ch = parse_field(c);
@@ -158,107 +473,1448 @@ void LayoutEngine::load_map_flatbuf(const std::string &path) {
 
   for (auto const *f : *lm->fields()) {
     auto fld = parse_field(f);
-    map_.field_index[fld.name] = map_.fields.size();
-    map_.fields.push_back(std::move(fld));
+    map.field_index[fld.name] = map.fields.size();
+    map.fields.push_back(std::move(fld));
   }
+
+  // .ram sem header foi gerado antes do LayoutHeader: offsets incompatíveis
+  map.header_size = lm->header_size();
+  if (map.header_size != LAYOUT_HEADER_SIZE)
+    throw std::runtime_error(".ram sem LayoutHeader (formato antigo): " + path);
+  map.stats_offset = lm->stats_offset();
+  map.stats_slots = lm->stats_slots();
+  map.pool_instances = lm->pool_instances();
+  map.pool_offset = lm->pool_offset();
+  map.instance_stride = lm->instance_stride();
+  map.arena_offset = lm->arena_offset();
+  map.arena_size = lm->arena_size();
+  map.grow_offset = lm->grow_offset();
+  map.grow_size = lm->grow_size();
+  map.fingerprint = layout_fingerprint(map);
+  if (map.fingerprint != lm->fingerprint())
+    throw std::runtime_error(".ram com fingerprint inconsistente: " + path);
+  build_default_image(map);
+  map_ = std::make_shared<const LayoutMap>(std::move(map));
 }
 
 // -------------------------------
 // MMAP / MEMORY
 // -------------------------------
-void LayoutEngine::allocate_memory_from_file(const std::string &path) {
-  size_ = map_.total_size;
-  int fd = open(path.c_str(), O_RDWR | O_CREAT, 0600);
+LayoutEngine::LayoutEngine(std::shared_ptr<const LayoutMap> map)
+    : map_(std::move(map)) {
+  if (!map_)
+    throw std::runtime_error("LayoutEngine: LayoutMap nulo");
+}
+
+LayoutEngine::~LayoutEngine() {
+  unpin_epoch();
+  if (map_ptr_)
+    munmap(map_ptr_, map_len_);
+  if (fd_ >= 0)
+    close(fd_);
+}
+
+void LayoutEngine::allocate_memory_from_file(const std::string &path,
+                                              const MapOptions &opts) {
+  auto t_start = std::chrono::steady_clock::now();
+  startup_ = StartupReport{};
+  if (map_ptr_) {
+    munmap(map_ptr_, map_len_);
+    map_ptr_ = base_ptr_ = nullptr;
+    ctrl_ = nullptr;
+    copies_[0] = copies_[1] = nullptr;
+    pool_ = nullptr;
+    pinned_ = -1;
+  }
+  if (fd_ >= 0) {
+    close(fd_);
+    fd_ = -1;
+  }
+  // NUMA só passa a valer depois que as imagens estão no lugar
+  numa_ = NumaPolicy::Default;
+  numa_nodes_ = 0;
+  numa_prefault_ = numa_fields_ = false;
+  if (map_->pool_instances && opts.double_buffered)
+    throw std::runtime_error("pool não suporta MapOptions::double_buffered");
+  if (map_->grow_size && opts.double_buffered)
+    throw std::runtime_error(
+        "arrays com chunk_items não suportam MapOptions::double_buffered");
+  if (opts.reserve && opts.double_buffered)
+    throw std::runtime_error("MapOptions::reserve não combina com double_buffered");
+  if (opts.copy_on_write) {
+    if (opts.read_only || opts.double_buffered || opts.reserve ||
+        map_->grow_size)
+      throw std::runtime_error("copy_on_write não combina com read_only, "
+                               "double_buffered, reserve nem chunk_items");
+    // MAP_POPULATE num mapeamento privado gravável copiaria todas as páginas
+    if (opts.populate)
+      throw std::runtime_error("copy_on_write não combina com populate");
+  }
+  cow_ = opts.copy_on_write;
+  cow_path_ = cow_ ? path : std::string();
+  size_ = layout_buffer_size(*map_);
+  read_only_ = opts.read_only;
+
+  // A/B: controle + 2 cópias alinhadas a página
+  size_t hdr_off = 0, copy_stride = 0;
+  map_len_ = size_;
+  if (opts.double_buffered) {
+    copy_stride = (size_ + 4095) & ~size_t(4095);
+    hdr_off = EPOCH_CONTROL_SIZE;
+    map_len_ = EPOCH_CONTROL_SIZE + 2 * copy_stride;
+  }
+  // Reserva virtual: o arquivo tem ao menos o buffer base e cresce até o fim
+  // da reserva (grow_size dos chunks ou MapOptions::reserve); só o trecho
+  // existente do arquivo é mapeado, o resto fica PROT_NONE
+  size_t file_len = map_len_;
+  map_len_ += map_->grow_size;
+  if (opts.reserve > map_len_)
+    map_len_ = (opts.reserve + 4095) & ~size_t(4095);
+  bool reserved = map_len_ > file_len;
+  auto file_size_ok = [&](size_t sz) {
+    return reserved ? sz >= file_len && sz <= map_len_ : sz == file_len;
+  };
+
+  // Somente leitura: nunca cria nem redimensiona. No modo A/B o leitor ainda
+  // precisa escrever no bloco de controle (pin_epoch), então o fd é O_RDWR
+  // e só as cópias ficam PROT_READ.
+  // Copy-on-write só lê a base: MAP_PRIVATE gravável não exige O_RDWR
+  int fd;
+  if (opts.read_only)
+    fd = open(path.c_str(), opts.double_buffered ? O_RDWR : O_RDONLY);
+  else if (cow_)
+    fd = open(path.c_str(), O_RDONLY);
+  else if (opts.attach_existing)
+    fd = open(path.c_str(), O_RDWR);
+  else
+    fd = open(path.c_str(), O_RDWR | O_CREAT, 0600);
   if (fd < 0)
-    throw std::runtime_error("open(tmpfs) failed");
-  if (ftruncate(fd, size_) < 0) {
+    throw std::runtime_error(opts.read_only || cow_
+                                 ? "open(read-only) failed: " + path
+                             : opts.attach_existing
+                                 ? "open(attach_existing) failed: " + path
+                                 : "open(tmpfs) failed");
+
+  // Valida o header antes do ftruncate para não redimensionar um buffer
+  // construído com outro layout
+  struct stat st;
+  if (fstat(fd, &st) < 0) {
+    close(fd);
+    throw std::runtime_error("fstat");
+  }
+  bool fresh = true;
+  if (static_cast<size_t>(st.st_size) >= hdr_off + sizeof(LayoutHeader)) {
+    LayoutHeader hdr;
+    uint32_t ctrl_magic = 0;
+    if (pread(fd, &hdr, sizeof(hdr), hdr_off) != sizeof(hdr) ||
+        (opts.double_buffered &&
+         pread(fd, &ctrl_magic, sizeof(ctrl_magic), 0) != sizeof(ctrl_magic))) {
+      close(fd);
+      throw std::runtime_error("pread(header)");
+    }
+    fresh = (hdr.magic == 0 && ctrl_magic == 0);
+    try {
+      if (!fresh) {
+        if (opts.double_buffered && ctrl_magic != EPOCH_CONTROL_MAGIC)
+          throw std::runtime_error("buffer não está em modo A/B: " + path);
+        validate_header(hdr, path);
+      } else if (static_cast<size_t>(st.st_size) != file_len)
+        throw std::runtime_error("buffer sem header com tamanho incompatível: " +
+                                 path);
+    } catch (...) {
+      close(fd);
+      throw;
+    }
+  }
+
+  if (opts.read_only || cow_ || opts.attach_existing) {
+    // o leitor (e o copy-on-write, e quem só anexa) não carimba header:
+    // exige um buffer já inicializado
+    if (fresh || !file_size_ok(st.st_size)) {
+      close(fd);
+      throw std::runtime_error(opts.attach_existing
+                                   ? "buffer não inicializado: " + path
+                                   : "buffer não inicializado para leitura: " + path);
+    }
+  } else if (!reserved && static_cast<size_t>(st.st_size) > file_len) {
+    // crescido por outro processo com reserva: truncar perderia dados
+    close(fd);
+    throw std::runtime_error("buffer maior que o layout (use MapOptions::reserve): " +
+                             path);
+  } else if (!(reserved && file_size_ok(st.st_size)) &&
+             ftruncate(fd, file_len) < 0) {
     close(fd);
     throw std::runtime_error("ftruncate");
   }
-  base_ptr_ = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
-  if (base_ptr_ == MAP_FAILED) {
+  prot_ = opts.read_only ? PROT_READ : PROT_READ | PROT_WRITE;
+  populate_ = opts.populate;
+  if (reserved) {
+    // reserva sem backing; o arquivo é mapeado com MAP_FIXED no início dela
+    map_ptr_ = mmap(nullptr, map_len_, PROT_NONE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (map_ptr_ == MAP_FAILED) {
+      map_ptr_ = nullptr;
+      close(fd);
+      throw std::runtime_error("mmap(reserva)");
+    }
+    fd_ = fd;
+    mapped_len_ = 0;
+    try {
+      remap();
+    } catch (...) {
+      munmap(map_ptr_, map_len_);
+      map_ptr_ = nullptr;
+      throw;
+    }
+  } else {
+    int flags = (cow_ ? MAP_PRIVATE : MAP_SHARED) |
+                (opts.populate ? MAP_POPULATE : 0);
+    map_ptr_ = mmap(nullptr, map_len_, prot_, flags, fd, 0);
+    if (map_ptr_ == MAP_FAILED) {
+      map_ptr_ = nullptr;
+      close(fd);
+      throw std::runtime_error("mmap");
+    }
     close(fd);
-    throw std::runtime_error("mmap");
+    mapped_len_ = map_len_;
+  }
+  if (opts.read_only && opts.double_buffered &&
+      mprotect(map_ptr_, EPOCH_CONTROL_SIZE, PROT_READ | PROT_WRITE) < 0) {
+    munmap(map_ptr_, map_len_);
+    map_ptr_ = nullptr;
+    throw std::runtime_error("mprotect(controle A/B)");
+  }
+
+  // Buffer recém-criado: as faixas são zeradas em paralelo antes dos headers
+  // (a política geral vai antes, para o first-touch já cair nos nós certos)
+  std::chrono::steady_clock::duration t_prefault{};
+  if (opts.prefault && opts.prefault_zero && fresh && !opts.read_only) {
+    auto t0 = std::chrono::steady_clock::now();
+    try {
+      numa_apply(map_ptr_, mapped_len_, opts.numa, opts.numa_nodes);
+      startup_.prefault_threads =
+          prefault_parallel(map_ptr_, mapped_len_, opts.prefault_threads,
+                            opts.numa_nodes, true, true);
+    } catch (...) {
+      munmap(map_ptr_, map_len_);
+      map_ptr_ = nullptr;
+      if (fd_ >= 0) {
+        close(fd_);
+        fd_ = -1;
+      }
+      throw;
+    }
+    t_prefault = std::chrono::steady_clock::now() - t0;
+    startup_.prefault_bytes = mapped_len_;
+    startup_.zeroed = true;
+  }
+
+  base_ptr_ = map_ptr_;
+  if (opts.double_buffered) {
+    ctrl_ = static_cast<EpochControl *>(map_ptr_);
+    copies_[0] = static_cast<char *>(map_ptr_) + EPOCH_CONTROL_SIZE;
+    copies_[1] = copies_[0] + copy_stride;
+    if (fresh) {
+      for (char *copy : copies_) {
+        base_ptr_ = copy;
+        stamp_defaults(copy);
+        stamp_header();
+      }
+      ctrl_->copies = 2;
+      __atomic_store_n(&ctrl_->magic, EPOCH_CONTROL_MAGIC, __ATOMIC_RELEASE);
+    }
+    base_ptr_ = copies_[__atomic_load_n(&ctrl_->epoch, __ATOMIC_ACQUIRE) & 1];
+  } else if (fresh) {
+    if (!map_->pool_instances)
+      stamp_defaults(static_cast<char *>(base_ptr_));
+    stamp_header();
+  }
+  if (map_->pool_instances) {
+    pool_ = static_cast<char *>(map_ptr_);
+    if (fresh) {
+      auto *pc = reinterpret_cast<PoolControl *>(pool_ + POOL_CONTROL_OFFSET);
+      pc->instances = map_->pool_instances;
+      pc->stride = map_->instance_stride;
+      for (size_t i = 0; i < map_->pool_instances; ++i)
+        stamp_defaults(static_cast<char *>(instance_base(i)));
+    }
+    base_ptr_ = instance_base(0);
+  }
+
+  // Política NUMA e afinidade por campo; vale também para o que
+  // ensure_mapped/ensure_chunk mapearem depois
+  numa_ = opts.numa;
+  numa_nodes_ = opts.numa_nodes;
+  numa_prefault_ = opts.numa_prefault;
+  for (auto const &f : map_->fields)
+    numa_fields_ |= f.numa_node >= 0;
+  try {
+    apply_numa(0, mapped_len_);
+    if (numa_prefault_)
+      prefault_numa(0, mapped_len_);
+    if (opts.prefault && !startup_.zeroed) {
+      auto t0 = std::chrono::steady_clock::now();
+      startup_.prefault_threads =
+          prefault_parallel(map_ptr_, mapped_len_, opts.prefault_threads,
+                            numa_nodes_, (prot_ & PROT_WRITE) && !cow_, false);
+      t_prefault = std::chrono::steady_clock::now() - t0;
+      startup_.prefault_bytes = mapped_len_;
+    }
+  } catch (...) {
+    munmap(map_ptr_, map_len_);
+    map_ptr_ = base_ptr_ = nullptr;
+    ctrl_ = nullptr;
+    copies_[0] = copies_[1] = nullptr;
+    pool_ = nullptr;
+    if (fd_ >= 0) {
+      close(fd_);
+      fd_ = -1;
+    }
+    throw;
+  }
+  using ms = std::chrono::duration<double, std::milli>;
+  startup_.prefault_ms = ms(t_prefault).count();
+  startup_.map_ms =
+      ms(std::chrono::steady_clock::now() - t_start).count() -
+      startup_.prefault_ms;
+}
+
+const StartupReport &LayoutEngine::startup_report() const { return startup_; }
+
+// -------------------------------
+// RESERVA VIRTUAL: CRESCIMENTO NO LUGAR
+// -------------------------------
+// Mapeia [mapped_len_, len) do arquivo dentro da reserva. Os endereços já
+// entregues continuam válidos: nada é desmapeado nem movido.
+void LayoutEngine::ensure_mapped(size_t len) {
+  size_t cur = __atomic_load_n(&mapped_len_, __ATOMIC_ACQUIRE);
+  if (len <= cur)
+    return;
+  if (fd_ < 0)
+    throw std::runtime_error("mapeamento sem reserva virtual");
+  size_t end = (len + 4095) & ~size_t(4095);
+  if (end > map_len_)
+    throw std::runtime_error("crescimento além da reserva virtual");
+  void *p = mmap(static_cast<char *>(map_ptr_) + cur, end - cur, prot_,
+                 MAP_SHARED | MAP_FIXED | (populate_ ? MAP_POPULATE : 0), fd_,
+                 static_cast<off_t>(cur));
+  if (p == MAP_FAILED)
+    throw std::runtime_error("mmap(MAP_FIXED) na reserva");
+  apply_numa(cur, end);
+  // outra thread pode ter mapeado o mesmo trecho: o maior fim vence
+  while (cur < end && !__atomic_compare_exchange_n(&mapped_len_, &cur, end,
+                                                   true, __ATOMIC_RELEASE,
+                                                   __ATOMIC_ACQUIRE))
+    ;
+}
+
+size_t LayoutEngine::remap() {
+  if (fd_ < 0)
+    return mapped_len_;
+  struct stat st;
+  if (fstat(fd_, &st) < 0)
+    throw std::runtime_error("fstat");
+  ensure_mapped(std::min(static_cast<size_t>(st.st_size), map_len_));
+  return __atomic_load_n(&mapped_len_, __ATOMIC_ACQUIRE);
+}
+
+void LayoutEngine::grow(size_t new_len) {
+  require_writable("grow");
+  if (fd_ < 0)
+    throw std::runtime_error("grow requer MapOptions::reserve");
+  if (new_len > map_len_)
+    throw std::runtime_error("crescimento além da reserva virtual");
+  size_t cur = mapped_size();
+  {
+    // no tmpfs o fallocate já aloca as páginas: usa a política da thread
+    NumaThreadPolicy scope(numa_, numa_nodes_);
+    // fallocate só aumenta: nunca trunca o que outro processo já estendeu
+    if (new_len > size_ &&
+        fallocate(fd_, 0, 0, static_cast<off_t>(new_len)) < 0)
+      throw std::runtime_error("fallocate(grow) failed");
+  }
+  ensure_mapped(new_len);
+  if (numa_prefault_ && new_len > cur)
+    prefault_numa(cur, new_len);
+}
+
+size_t LayoutEngine::reserved_size() const { return map_len_; }
+size_t LayoutEngine::mapped_size() const {
+  return __atomic_load_n(&mapped_len_, __ATOMIC_ACQUIRE);
+}
+
+// -------------------------------
+// COPY-ON-WRITE: COMMIT DAS PÁGINAS PRIVADAS
+// -------------------------------
+// Páginas já copiadas pelo COW: no pagemap estão presentes (ou em swap) sem
+// o bit de página de arquivo. Sem /proc/self/pagemap, compara com a base.
+std::vector<size_t> LayoutEngine::private_page_list() const {
+  if (!cow_)
+    throw std::runtime_error("mapeamento não é copy_on_write");
+  size_t ps = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  size_t pages = (size_ + ps - 1) / ps;
+  std::vector<size_t> out;
+  std::vector<uint64_t> pm(pages);
+  int fd = open("/proc/self/pagemap", O_RDONLY);
+  if (fd >= 0) {
+    off_t at = static_cast<off_t>(reinterpret_cast<uintptr_t>(map_ptr_) / ps *
+                                  sizeof(uint64_t));
+    size_t want = pages * sizeof(uint64_t), got = 0;
+    while (got < want) {
+      ssize_t r = pread(fd, reinterpret_cast<char *>(pm.data()) + got,
+                        want - got, at + static_cast<off_t>(got));
+      if (r <= 0)
+        break;
+      got += static_cast<size_t>(r);
+    }
+    close(fd);
+    if (got == want) {
+      constexpr uint64_t PRESENT = 1ULL << 63, SWAPPED = 1ULL << 62,
+                         FILE_PAGE = 1ULL << 61;
+      for (size_t i = 0; i < pages; ++i)
+        if ((pm[i] & (PRESENT | SWAPPED)) && !(pm[i] & FILE_PAGE))
+          out.push_back(i);
+      return out;
+    }
+  }
+  fd = open(cow_path_.c_str(), O_RDONLY);
+  if (fd < 0)
+    throw std::runtime_error("open(base copy_on_write) failed: " + cow_path_);
+  std::vector<char> page(ps);
+  const char *m = static_cast<const char *>(map_ptr_);
+  for (size_t i = 0; i < pages; ++i) {
+    size_t len = std::min(ps, size_ - i * ps);
+    if (pread(fd, page.data(), len, static_cast<off_t>(i * ps)) !=
+            static_cast<ssize_t>(len) ||
+        memcmp(page.data(), m + i * ps, len) != 0)
+      out.push_back(i);
+  }
+  close(fd);
+  return out;
+}
+
+size_t LayoutEngine::private_pages() const { return private_page_list().size(); }
+
+size_t LayoutEngine::commit_private(const std::string &target) {
+  auto pages = private_page_list();
+  std::string path = target.empty() ? cow_path_ : target;
+  int fd = open(path.c_str(), O_RDWR);
+  if (fd < 0)
+    throw std::runtime_error("open(commit_private) failed: " + path);
+  struct stat st, base;
+  LayoutHeader hdr;
+  try {
+    // o destino precisa ter o mesmo layout (mesmo header e tamanho)
+    if (fstat(fd, &st) < 0 || static_cast<size_t>(st.st_size) != size_ ||
+        pread(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr))
+      throw std::runtime_error("destino com tamanho incompatível: " + path);
+    validate_header(hdr, path);
+  } catch (...) {
+    close(fd);
+    throw;
+  }
+  size_t ps = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  const char *m = static_cast<const char *>(map_ptr_);
+  // páginas consecutivas viram um único pwrite
+  for (size_t i = 0; i < pages.size();) {
+    size_t j = i + 1;
+    while (j < pages.size() && pages[j] == pages[j - 1] + 1)
+      ++j;
+    size_t off = pages[i] * ps;
+    size_t len = std::min((pages[j - 1] + 1) * ps, size_) - off;
+    for (size_t done = 0; done < len;) {
+      ssize_t w = pwrite(fd, m + off + done, len - done,
+                         static_cast<off_t>(off + done));
+      if (w <= 0) {
+        close(fd);
+        throw std::runtime_error("pwrite(commit_private) failed: " + path);
+      }
+      done += static_cast<size_t>(w);
+    }
+    i = j;
+  }
+  if (fdatasync(fd) < 0) {
+    close(fd);
+    throw std::runtime_error("fdatasync(commit_private) failed: " + path);
   }
   close(fd);
+  // Commit na própria base: descarta as cópias privadas, que agora são
+  // iguais ao arquivo (o próximo commit só grava o que mudar depois)
+  if (stat(cow_path_.c_str(), &base) == 0 && base.st_dev == st.st_dev &&
+      base.st_ino == st.st_ino)
+    for (size_t p : pages)
+      madvise(const_cast<char *>(m) + p * ps, ps, MADV_DONTNEED);
+  return pages.size();
+}
+
+void LayoutEngine::discard_private() {
+  if (!cow_)
+    throw std::runtime_error("mapeamento não é copy_on_write");
+  if (madvise(map_ptr_, map_len_, MADV_DONTNEED) < 0)
+    throw std::runtime_error("madvise(MADV_DONTNEED)");
+}
+
+// -------------------------------
+// NUMA
+// -------------------------------
+// Trechos [início, fim) dos campos com numa_node em cada imagem do mapeamento
+// (cópias A/B ou instâncias do pool), cortados a [from, to)
+template <typename Fn>
+static void for_each_numa_field(const LayoutMap &map,
+                                const std::vector<size_t> &images, size_t from,
+                                size_t to, Fn &&fn) {
+  for (size_t img : images)
+    for (auto const &f : map.fields) {
+      if (f.numa_node < 0)
+        continue;
+      size_t extent = f.size + (f.type == FieldType::Array ? 4 : 0);
+      size_t lo = img + f.offset;
+      size_t hi = (lo + extent + 4095) & ~size_t(4095);
+      lo = std::max(lo, from);
+      hi = std::min(hi, to);
+      if (lo < hi)
+        fn(f, lo, hi);
+    }
+}
+
+static std::vector<size_t> image_offsets(const LayoutMap &map, char *map_ptr,
+                                         char *const copies[2]) {
+  if (copies[0])
+    return {static_cast<size_t>(copies[0] - map_ptr),
+            static_cast<size_t>(copies[1] - map_ptr)};
+  if (map.pool_instances) {
+    std::vector<size_t> out;
+    for (size_t i = 0; i < map.pool_instances; ++i)
+      out.push_back(map.pool_offset + i * map.instance_stride);
+    return out;
+  }
+  return {0};
+}
+
+// Política geral em [from, to) e, por cima dela, o bind de cada campo ao seu
+// nó. Páginas já presentes migram (MPOL_MF_MOVE).
+void LayoutEngine::apply_numa(size_t from, size_t to) {
+  char *m = static_cast<char *>(map_ptr_);
+  if (numa_ != NumaPolicy::Default)
+    numa_apply(m + from, to - from, numa_, numa_nodes_);
+  if (!numa_fields_)
+    return;
+  for_each_numa_field(*map_, image_offsets(*map_, m, copies_), from, to,
+                      [&](const FieldLayout &f, size_t lo, size_t hi) {
+                        numa_apply(m + lo, hi - lo, NumaPolicy::Bind,
+                                   1ULL << f.numa_node);
+                      });
+}
+
+// Campos primeiro, cada um por uma thread no próprio nó; o restante a partir
+// do primeiro nó da máscara (first-touch local para Default/Preferred)
+void LayoutEngine::prefault_numa(size_t from, size_t to) {
+  char *m = static_cast<char *>(map_ptr_);
+  // no copy-on-write um toque de escrita copiaria a página
+  bool writable = (prot_ & PROT_WRITE) && !cow_;
+  if (numa_fields_)
+    for_each_numa_field(*map_, image_offsets(*map_, m, copies_), from, to,
+                        [&](const FieldLayout &f, size_t lo, size_t hi) {
+                          numa_prefault(m + lo, hi - lo, f.numa_node, writable);
+                        });
+  int node = numa_nodes_ ? __builtin_ctzll(numa_nodes_) : -1;
+  numa_prefault(m + from, to - from, node, writable);
+}
+
+NumaPlacement LayoutEngine::numa_placement() const {
+  return ::numa_placement(map_ptr_, mapped_size());
+}
+
+void LayoutEngine::validate_header(const LayoutHeader &hdr,
+                                   const std::string &what) const {
+  if (hdr.magic != LAYOUT_HEADER_MAGIC)
+    throw std::runtime_error("buffer não é um layout ramlane: " + what);
+  if (hdr.version != LAYOUT_FORMAT_VERSION)
+    throw std::runtime_error("versão de formato incompatível: " + what);
+  if (hdr.header_size != map_->header_size ||
+      hdr.fingerprint != map_->fingerprint ||
+      hdr.total_size != layout_buffer_size(*map_))
+    throw std::runtime_error("layout incompatível (fingerprint): " + what);
+}
+
+void LayoutEngine::stamp_header() {
+  LayoutHeader hdr{};
+  hdr.magic = LAYOUT_HEADER_MAGIC;
+  hdr.version = LAYOUT_FORMAT_VERSION;
+  hdr.header_size = static_cast<uint16_t>(map_->header_size);
+  hdr.fingerprint = map_->fingerprint;
+  hdr.total_size = layout_buffer_size(*map_);
+  memcpy(base_ptr_, &hdr, sizeof(hdr));
+}
+
+// Registro novo: copia os trechos do template de defaults (nenhum cobre os
+// LAYOUT_HEADER_SIZE bytes reservados do header)
+void LayoutEngine::stamp_defaults(char *record) const {
+  for (auto const &r : map_->default_image)
+    memcpy(record + r.offset, r.bytes.data(), r.bytes.size());
+}
+
+// Header do arquivo: no pool é o do início do arquivo, não o do registro
+LayoutHeader *LayoutEngine::buffer_header() const {
+  return reinterpret_cast<LayoutHeader *>(pool_ ? pool_
+                                                : static_cast<char *>(base_ptr_));
+}
+
+// Imagem persistida por WAL/snapshot: o pool inteiro ou a cópia atual
+char *LayoutEngine::image() const {
+  return pool_ ? pool_ : static_cast<char *>(base_ptr_);
+}
+
+size_t LayoutEngine::image_offset() const {
+  return pool_ ? static_cast<char *>(base_ptr_) - pool_ : 0;
 }
 
 void *LayoutEngine::mmap_base() const { return base_ptr_; }
 size_t LayoutEngine::mmap_size() const { return size_; }
+const LayoutMap &LayoutEngine::get_layout() const { return *map_; }
+std::shared_ptr<const LayoutMap> LayoutEngine::shared_layout() const {
+  return map_;
+}
+bool LayoutEngine::read_only() const { return read_only_; }
+
+// Escrita num mapeamento PROT_READ seria SIGSEGV: falha antes com exceção
+void LayoutEngine::require_writable(const char *op) const {
+  if (read_only_)
+    throw std::runtime_error(std::string(op) + ": buffer anexado somente leitura");
+}
+
+void LayoutEngine::mark_superseded() {
+  require_writable("mark_superseded");
+  for (char *copy : copies_) {
+    if (copy) {
+      auto *hdr = reinterpret_cast<LayoutHeader *>(copy);
+      __atomic_fetch_or(&hdr->flags, LAYOUT_FLAG_SUPERSEDED, __ATOMIC_RELEASE);
+    }
+  }
+  auto *hdr = buffer_header();
+  __atomic_fetch_or(&hdr->flags, LAYOUT_FLAG_SUPERSEDED, __ATOMIC_RELEASE);
+}
+
+bool LayoutEngine::superseded() const {
+  auto const *hdr = buffer_header();
+  return __atomic_load_n(&hdr->flags, __ATOMIC_ACQUIRE) &
+         LAYOUT_FLAG_SUPERSEDED;
+}
+
+// -------------------------------
+// POOL: CLAIM / RELEASE
+// -------------------------------
+size_t LayoutEngine::pool_instances() const { return map_->pool_instances; }
+
+void *LayoutEngine::instance_base(size_t idx) const {
+  if (!pool_ || idx >= map_->pool_instances)
+    throw std::runtime_error("instância fora do pool");
+  return pool_ + map_->pool_offset + idx * map_->instance_stride;
+}
+
+void LayoutEngine::select_instance(size_t idx) { base_ptr_ = instance_base(idx); }
+
+bool LayoutEngine::instance_in_use(size_t idx) const {
+  instance_base(idx); // valida idx
+  auto *bm = reinterpret_cast<const uint64_t *>(pool_ + POOL_BITMAP_OFFSET);
+  return (__atomic_load_n(&bm[idx / 64], __ATOMIC_ACQUIRE) >> (idx % 64)) & 1;
+}
+
+// Primeiro bit livre do bitmap via CAS; seguro entre processos
+size_t LayoutEngine::claim_instance() {
+  require_writable("claim_instance");
+  if (!pool_)
+    throw std::runtime_error("claim_instance requer layout com pool");
+  auto *bm = reinterpret_cast<uint64_t *>(pool_ + POOL_BITMAP_OFFSET);
+  auto *pc = reinterpret_cast<PoolControl *>(pool_ + POOL_CONTROL_OFFSET);
+  size_t n = map_->pool_instances;
+  for (size_t w = 0; w * 64 < n; ++w) {
+    uint64_t valid = n - w * 64 >= 64 ? ~0ULL : (1ULL << (n - w * 64)) - 1;
+    uint64_t cur = __atomic_load_n(&bm[w], __ATOMIC_ACQUIRE);
+    while (~cur & valid) {
+      int bit = __builtin_ctzll(~cur & valid);
+      if (__atomic_compare_exchange_n(&bm[w], &cur, cur | (1ULL << bit), false,
+                                      __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        size_t idx = w * 64 + bit;
+        __atomic_fetch_add(&pc->used, 1, __ATOMIC_RELAXED);
+        char *rec = static_cast<char *>(instance_base(idx));
+        memset(rec, 0, map_->total_size);
+        stamp_defaults(rec);
+        // registro carimbado, word do bitmap e contador numa só operação
+        log_image_write(WalOp::Set, REPL_NO_FIELD, rec - pool_, rec,
+                        map_->total_size);
+        log_pool_control(idx);
+        return idx;
+      }
+    }
+  }
+  throw std::runtime_error("pool cheio");
+}
+
+void LayoutEngine::release_instance(size_t idx) {
+  require_writable("release_instance");
+  instance_base(idx); // valida idx
+  auto *bm = reinterpret_cast<uint64_t *>(pool_ + POOL_BITMAP_OFFSET);
+  auto *pc = reinterpret_cast<PoolControl *>(pool_ + POOL_CONTROL_OFFSET);
+  uint64_t bit = 1ULL << (idx % 64);
+  if (!(__atomic_fetch_and(&bm[idx / 64], ~bit, __ATOMIC_ACQ_REL) & bit))
+    throw std::runtime_error("instância não alocada");
+  __atomic_fetch_sub(&pc->used, 1, __ATOMIC_RELAXED);
+  log_pool_control(idx);
+}
+
+// Word do bitmap de `idx` e PoolControl::used no WAL/ring, fechando a
+// operação (os valores lidos já incluem o claim/release desta engine)
+void LayoutEngine::log_pool_control(size_t idx) {
+  if (!wal_ && !repl_)
+    return;
+  auto *bm = reinterpret_cast<uint64_t *>(pool_ + POOL_BITMAP_OFFSET);
+  auto *pc = reinterpret_cast<PoolControl *>(pool_ + POOL_CONTROL_OFFSET);
+  uint64_t word = __atomic_load_n(&bm[idx / 64], __ATOMIC_ACQUIRE);
+  uint64_t used = __atomic_load_n(&pc->used, __ATOMIC_RELAXED);
+  log_image_write(WalOp::Set, REPL_NO_FIELD,
+                  reinterpret_cast<char *>(&bm[idx / 64]) - pool_, &word,
+                  sizeof(word));
+  log_image_write(WalOp::Set, REPL_NO_FIELD,
+                  reinterpret_cast<char *>(&pc->used) - pool_, &used,
+                  sizeof(used));
+  log_commit();
+}
+
+// -------------------------------
+// A/B: FLIP DE ÉPOCA
+// -------------------------------
+// Escritor: store seq_cst em `epoch` seguido de load em `readers`; leitor:
+// fetch_add em `readers` seguido de load em `epoch`. Com ordem total, ou o
+// escritor vê o leitor fixado, ou o leitor vê a nova época e tenta de novo.
+void *LayoutEngine::begin_write(bool copy_front, uint32_t timeout_ms) {
+  require_writable("begin_write");
+  if (!ctrl_)
+    throw std::runtime_error("begin_write requer MapOptions::double_buffered");
+  uint64_t e = __atomic_load_n(&ctrl_->epoch, __ATOMIC_SEQ_CST);
+  int back = static_cast<int>((e + 1) & 1);
+  // espera leitores ainda fixados na época anterior (mesma cópia)
+  auto deadline =
+      std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+  while (__atomic_load_n(&ctrl_->readers[back].n, __ATOMIC_SEQ_CST) != 0) {
+    if (std::chrono::steady_clock::now() >= deadline)
+      throw std::runtime_error(
+          "begin_write: leitor fixado na cópia de trás há mais de " +
+          std::to_string(timeout_ms) + " ms");
+    std::this_thread::yield();
+  }
+  if (copy_front)
+    memcpy(copies_[back], copies_[e & 1], size_);
+  base_ptr_ = copies_[back];
+  return base_ptr_;
+}
+
+uint64_t LayoutEngine::publish() {
+  require_writable("publish");
+  if (!ctrl_)
+    throw std::runtime_error("publish requer MapOptions::double_buffered");
+  uint64_t e = __atomic_load_n(&ctrl_->epoch, __ATOMIC_RELAXED) + 1;
+  __atomic_store_n(&ctrl_->epoch, e, __ATOMIC_SEQ_CST);
+  base_ptr_ = copies_[e & 1];
+  return e;
+}
+
+uint64_t LayoutEngine::pin_epoch() {
+  if (!ctrl_)
+    throw std::runtime_error("pin_epoch requer MapOptions::double_buffered");
+  for (;;) {
+    uint64_t e = __atomic_load_n(&ctrl_->epoch, __ATOMIC_SEQ_CST);
+    int idx = static_cast<int>(e & 1);
+    __atomic_fetch_add(&ctrl_->readers[idx].n, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&ctrl_->epoch, __ATOMIC_SEQ_CST) == e) {
+      pinned_ = idx;
+      base_ptr_ = copies_[idx];
+      return e;
+    }
+    __atomic_fetch_sub(&ctrl_->readers[idx].n, 1, __ATOMIC_RELEASE);
+  }
+}
+
+void LayoutEngine::unpin_epoch() {
+  if (pinned_ < 0)
+    return;
+  __atomic_fetch_sub(&ctrl_->readers[pinned_].n, 1, __ATOMIC_RELEASE);
+  pinned_ = -1;
+}
+
+// -------------------------------
+// ARRAYS CRESCENTES (CHUNKS)
+// -------------------------------
+// Slot do item `idx` (flag de uso incluída); nullptr se o chunk não existe
+char *LayoutEngine::array_slot(const FieldLayout &fld, size_t idx) {
+  char *base = static_cast<char *>(base_ptr_);
+  if (!fld.chunk_items)
+    return base + fld.offset + 4 + idx * fld.item_stride;
+  auto *dir = reinterpret_cast<uint64_t *>(base + fld.offset + CHUNK_DIR_OFFSET);
+  uint64_t off = __atomic_load_n(&dir[idx / fld.chunk_items], __ATOMIC_ACQUIRE);
+  if (!off)
+    return nullptr;
+  // chunk anexado por outro processo: mapeia sob demanda na reserva
+  ensure_mapped(off + chunk_bytes(fld));
+  return base + off + (idx % fld.chunk_items) * fld.item_stride;
+}
+
+// Anexa ao arquivo o chunk que contém `idx`, se ainda não existe. O espaço
+// vem de um bump em GrowControl::tail; quem perde a corrida pelo diretório
+// descarta o trecho reservado.
+void LayoutEngine::ensure_chunk(const FieldLayout &fld, size_t idx) {
+  if (!fld.chunk_items)
+    return;
+  char *base = static_cast<char *>(base_ptr_);
+  auto *dir = reinterpret_cast<uint64_t *>(base + fld.offset + CHUNK_DIR_OFFSET);
+  uint64_t *entry = &dir[idx / fld.chunk_items];
+  if (__atomic_load_n(entry, __ATOMIC_ACQUIRE))
+    return;
+  auto *gc = reinterpret_cast<GrowControl *>(base + map_->grow_offset -
+                                             sizeof(GrowControl));
+  size_t bytes = chunk_bytes(fld);
+  uint64_t rel = __atomic_fetch_add(&gc->tail, bytes, __ATOMIC_RELAXED);
+  if (rel + bytes > map_->grow_size)
+    throw std::runtime_error("região de crescimento esgotada");
+  uint64_t off = map_->grow_offset + rel;
+  bool pinned = fld.numa_node >= 0;
+  {
+    // páginas do chunk nascem no nó do campo (ou sob a política geral)
+    NumaThreadPolicy scope(pinned ? NumaPolicy::Bind : numa_,
+                           pinned ? 1ULL << fld.numa_node : numa_nodes_);
+    // fallocate só aumenta o arquivo: nunca trunca chunks de outro processo
+    if (fallocate(fd_, 0, static_cast<off_t>(off),
+                  static_cast<off_t>(bytes)) < 0)
+      throw std::runtime_error("fallocate(chunk) failed");
+  }
+  ensure_mapped(off + bytes);
+  if (pinned)
+    numa_apply(base + off, bytes, NumaPolicy::Bind, 1ULL << fld.numa_node);
+  if (numa_prefault_)
+    numa_prefault(base + off, bytes,
+                  pinned ? fld.numa_node
+                         : numa_nodes_ ? __builtin_ctzll(numa_nodes_) : -1,
+                  true);
+  uint64_t expected = 0;
+  __atomic_compare_exchange_n(entry, &expected, off, false, __ATOMIC_RELEASE,
+                              __ATOMIC_ACQUIRE);
+}
+
+// -------------------------------
+// INTERNAL INSERT / POP / GET
+// -------------------------------
+void LayoutEngine::insert(const std::string &field_name, const void *item) {
+  require_writable("insert");
+  size_t fi = map_->field_index.at(field_name);
+  auto const &fld = map_->fields[fi];
+  if (fld.type != FieldType::Array)
+    throw std::runtime_error("insert só valids para array");
+  uint32_t *cnt =
+      reinterpret_cast<uint32_t *>((char *)base_ptr_ + fld.count_offset);
+  if (*cnt >= fld.max_items) {
+    if (map_->stats_slots)
+      stats_on_full(stats_entry(*map_, base_ptr_, fi));
+    throw std::runtime_error("array cheio");
+  }
+  ensure_chunk(fld, *cnt);
+  char *slot = array_slot(fld, *cnt);
+  char *dst = slot;
+  if (fld.has_used_flag)
+    *dst++ = 1;
+  memcpy(dst, item, fld.item_stride - (fld.has_used_flag ? 1 : 0));
+  // slot antes do contador: um replay parcial nunca expõe item incompleto
+  log_write(WalOp::Insert, fi, slot - static_cast<char *>(base_ptr_), slot,
+            fld.item_stride);
+  (*cnt)++;
+  if (map_->stats_slots)
+    stats_on_insert(stats_entry(*map_, base_ptr_, fi), *cnt);
+  log_write(WalOp::Count, fi, fld.count_offset, cnt, sizeof(*cnt));
+  log_commit();
+}
+
+void LayoutEngine::pop(const std::string &f, size_t idx) {
+  require_writable("pop");
+  size_t fi = map_->field_index.at(f);
+  auto const &fld = map_->fields[fi];
+  if (fld.type != FieldType::Array)
+    throw std::runtime_error("pop só pra array");
+  uint32_t *cnt =
+      reinterpret_cast<uint32_t *>((char *)base_ptr_ + fld.count_offset);
+  if (idx >= *cnt)
+    throw std::runtime_error("out of bounds");
+  char *slot = array_slot(fld, idx);
+  if (map_->stats_slots)
+    stats_on_pop(stats_entry(*map_, base_ptr_, fi));
+  if (fld.has_used_flag) {
+    *slot = 0;
+    log_write(WalOp::Pop, fi, slot - static_cast<char *>(base_ptr_), slot, 1);
+    log_commit();
+  }
+}
+
+void *LayoutEngine::get(const std::string &f, size_t idx) {
+  auto const &fld = map_->fields[map_->field_index.at(f)];
+  if (fld.type == FieldType::Array) {
+    uint32_t *cnt =
+        reinterpret_cast<uint32_t *>((char *)base_ptr_ + fld.count_offset);
+    if (idx >= *cnt)
+      return nullptr;
+    char *slot = array_slot(fld, idx);
+    if (!slot || (fld.has_used_flag && *slot == 0))
+      return nullptr;
+    return slot + (fld.has_used_flag ? 1 : 0);
+  } else if (fld.type == FieldType::VarString || fld.type == FieldType::Blob) {
+    if (idx > 0)
+      return nullptr;
+    std::string_view v = get_bytes(f);
+    static char empty[1] = {0};
+    return v.empty() ? empty : const_cast<char *>(v.data());
+  } else if (fld.type == FieldType::String) {
+    if (idx > 0)
+      return nullptr;
+    return (char *)base_ptr_ + fld.offset + STRING_LEN_PREFIX;
+  } else {
+    if (idx > 0)
+      return nullptr;
+    return (char *)base_ptr_ + fld.offset;
+  }
+}
+
+void LayoutEngine::set(const std::string &f, const void *value, size_t idx) {
+  require_writable("set");
+  size_t fi = map_->field_index.at(f);
+  auto const &fld = map_->fields[fi];
+  if (fld.type == FieldType::VarString || fld.type == FieldType::String) {
+    if (idx > 0)
+      throw std::runtime_error("out of bounds");
+    auto *s = static_cast<const char *>(value);
+    set_bytes(f, s,
+              fld.type == FieldType::String ? strnlen(s, fld.max_length)
+                                            : strlen(s));
+    return;
+  }
+  if (fld.type == FieldType::Blob)
+    throw std::runtime_error("blob requer set_bytes: " + f);
+  size_t dst, len;
+  if (fld.type == FieldType::Array) {
+    uint32_t *cnt =
+        reinterpret_cast<uint32_t *>((char *)base_ptr_ + fld.count_offset);
+    if (idx >= *cnt)
+      throw std::runtime_error("out of bounds");
+    dst = array_slot(fld, idx) - static_cast<char *>(base_ptr_) +
+          (fld.has_used_flag ? 1 : 0);
+    len = fld.item_stride - (fld.has_used_flag ? 1 : 0);
+    memcpy((char *)base_ptr_ + dst, value, len);
+  } else {
+    if (idx > 0)
+      throw std::runtime_error("out of bounds");
+    dst = fld.offset;
+    len = fld.size;
+    memcpy((char *)base_ptr_ + dst, value, len);
+  }
+  if (map_->stats_slots)
+    stats_on_write(stats_entry(*map_, base_ptr_, fi));
+  log_write(WalOp::Set, fi, dst, (char *)base_ptr_ + dst, len);
+  log_commit();
+}
+
+// -------------------------------
+// VARREDURA PARALELA DE ARRAYS
+// -------------------------------
+// Slots [0, count) em tarefas de ~task_bytes. As fronteiras ficam em linhas
+// de cache: cada tarefa começa no primeiro slot que inicia depois de um
+// múltiplo de 64 bytes, e um item pertence à tarefa do seu primeiro byte.
+// Os chunks são resolvidos (e mapeados) aqui, antes de qualquer worker.
+std::vector<LayoutEngine::ScanRange>
+LayoutEngine::scan_ranges(const FieldLayout &fld, const ParallelOptions &opts) {
+  if (fld.type != FieldType::Array)
+    throw std::runtime_error("varredura paralela só para array: " + fld.name);
+  auto *cnt = reinterpret_cast<uint32_t *>(static_cast<char *>(base_ptr_) +
+                                           fld.count_offset);
+  size_t count = std::min<size_t>(__atomic_load_n(cnt, __ATOMIC_ACQUIRE),
+                                  fld.max_items);
+  std::vector<ScanRange> segments;
+  if (!fld.chunk_items) {
+    if (count)
+      segments.push_back({array_slot(fld, 0), 0, count});
+  } else {
+    for (size_t first = 0; first < count; first += fld.chunk_items)
+      if (char *slot = array_slot(fld, first))
+        segments.push_back(
+            {slot, first, std::min(fld.chunk_items, count - first)});
+  }
+
+  size_t step = std::max<size_t>(64, (opts.task_bytes + 63) & ~size_t(63));
+  size_t stride = fld.item_stride;
+  std::vector<ScanRange> out;
+  for (auto const &seg : segments) {
+    uintptr_t a = reinterpret_cast<uintptr_t>(seg.first);
+    uintptr_t line = (a & ~uintptr_t(63)) + step;
+    for (size_t k = 0; k < seg.n; line += step) {
+      size_t next = std::min(seg.n, (line - a + stride - 1) / stride);
+      if (next > k)
+        out.push_back({seg.first + k * stride, seg.index + k, next - k});
+      k = next;
+    }
+  }
+  return out;
+}
+
+void LayoutEngine::run_parallel(size_t tasks, const ParallelOptions &opts,
+                                const std::function<void(size_t)> &fn) {
+  unsigned threads = opts.threads
+                         ? opts.threads
+                         : std::max(1u, std::thread::hardware_concurrency());
+  if (!scan_pool_ || scan_pool_->threads() != threads)
+    scan_pool_ = std::make_unique<WorkStealingPool>(threads);
+  scan_pool_->run(tasks, fn);
+}
+
+void LayoutEngine::parallel_for(const std::string &field_name,
+                                const std::function<void(size_t, void *)> &fn,
+                                const ParallelOptions &opts) {
+  auto const &fld = map_->fields[map_->field_index.at(field_name)];
+  std::vector<ScanRange> ranges = scan_ranges(fld, opts);
+  size_t skip = fld.has_used_flag ? 1 : 0;
+  run_parallel(ranges.size(), opts, [&](size_t r) {
+    ScanRange const &sr = ranges[r];
+    char *slot = sr.first;
+    for (size_t k = 0; k < sr.n; ++k, slot += fld.item_stride)
+      if (!skip || *slot)
+        fn(sr.index + k, slot + skip);
+  });
+}
+
+// -------------------------------
+// STRING COM PREFIXO DE TAMANHO
+// -------------------------------
+// Copia só os bytes do valor + NUL (nada de zerar o slot inteiro) e publica
+// o tamanho por último
+void LayoutEngine::set_string(size_t fi, const void *data, size_t len) {
+  auto const &fld = map_->fields[fi];
+  size_t n = std::min(len, fld.max_length - 1);
+  char *slot = static_cast<char *>(base_ptr_) + fld.offset;
+  memcpy(slot + STRING_LEN_PREFIX, data, n);
+  slot[STRING_LEN_PREFIX + n] = 0;
+  __atomic_store_n(reinterpret_cast<uint32_t *>(slot),
+                   static_cast<uint32_t>(n), __ATOMIC_RELEASE);
+
+  if (map_->stats_slots)
+    stats_on_write(stats_entry(*map_, base_ptr_, fi));
+  log_write(WalOp::Set, fi, fld.offset, slot, STRING_LEN_PREFIX + n + 1);
+  log_commit();
+}
+
+// -------------------------------
+// ARENA: VARSTRING / BLOB
+// -------------------------------
+static uint64_t arena_ref(uint64_t off, uint64_t len) { return off | len << 32; }
+
+void LayoutEngine::set_bytes(const std::string &f, const void *data,
+                             size_t len) {
+  require_writable("set_bytes");
+  size_t fi = map_->field_index.at(f);
+  auto const &fld = map_->fields[fi];
+  if (fld.type == FieldType::String) {
+    set_string(fi, data, len);
+    return;
+  }
+  if (fld.type != FieldType::VarString && fld.type != FieldType::Blob)
+    throw std::runtime_error("set_bytes só para string/varstring/blob: " + f);
+  char *base = static_cast<char *>(base_ptr_);
+  auto *ah = reinterpret_cast<ArenaHeader *>(base + map_->arena_offset);
+  size_t data_off = map_->arena_offset + sizeof(ArenaHeader);
+  size_t need = len + (fld.type == FieldType::VarString ? 1 : 0);
+
+  // bump com CAS: escritores concorrentes nunca recebem o mesmo trecho.
+  // Valor vazio não aloca: a referência 0 aponta para o NUL reservado.
+  uint64_t off = 0;
+  if (len) {
+    uint64_t top = __atomic_load_n(&ah->top, __ATOMIC_RELAXED);
+    do {
+      off = std::max<uint64_t>(top, ARENA_RESERVED);
+      if (off + need > map_->arena_size)
+        throw std::runtime_error("arena cheia (compact_arena ou \"arena\" maior)");
+    } while (!__atomic_compare_exchange_n(&ah->top, &top, off + need, true,
+                                          __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+    memcpy(base + data_off + off, data, len);
+    if (need > len)
+      base[data_off + off + len] = 0;
+  }
+
+  // publica (offset, tamanho) num único store: leitores nunca misturam
+  auto *ref = reinterpret_cast<uint64_t *>(base + fld.offset);
+  uint64_t old = __atomic_exchange_n(ref, arena_ref(off, len), __ATOMIC_RELEASE);
+  __atomic_fetch_add(&ah->live, len - (old >> 32), __ATOMIC_RELAXED);
+
+  if (map_->stats_slots)
+    stats_on_write(stats_entry(*map_, base_ptr_, fi));
+  // referência por último (como o contador no insert): nunca aponta além
+  // do top registrado
+  if (len)
+    log_write(WalOp::Set, fi, data_off + off, base + data_off + off, need);
+  log_write(WalOp::Set, fi, map_->arena_offset, ah, 2 * sizeof(uint64_t));
+  log_write(WalOp::Set, fi, fld.offset, ref, sizeof(*ref));
+  log_commit();
+}
+
+std::string_view LayoutEngine::get_bytes(const std::string &f) const {
+  auto const &fld = map_->fields[map_->field_index.at(f)];
+  const char *base = static_cast<const char *>(base_ptr_);
+  if (fld.type == FieldType::String)
+    return std::string_view(
+        base + fld.offset + STRING_LEN_PREFIX,
+        __atomic_load_n(reinterpret_cast<const uint32_t *>(base + fld.offset),
+                        __ATOMIC_ACQUIRE));
+  if (fld.type != FieldType::VarString && fld.type != FieldType::Blob)
+    throw std::runtime_error("get_bytes só para string/varstring/blob: " + f);
+  uint64_t ref = __atomic_load_n(
+      reinterpret_cast<const uint64_t *>(base + fld.offset), __ATOMIC_ACQUIRE);
+  return std::string_view(base + map_->arena_offset + sizeof(ArenaHeader) +
+                              (ref & 0xffffffffu),
+                          ref >> 32);
+}
+
+size_t LayoutEngine::compact_arena() {
+  require_writable("compact_arena");
+  if (!map_->arena_offset)
+    return 0;
+  char *base = static_cast<char *>(base_ptr_);
+  auto *ah = reinterpret_cast<ArenaHeader *>(base + map_->arena_offset);
+  size_t data_off = map_->arena_offset + sizeof(ArenaHeader);
+  char *data = base + data_off;
+
+  // valores vivos em ordem de offset: mover para baixo nunca sobrescreve
+  // um valor ainda não movido
+  struct Live {
+    uint64_t *ref;
+    size_t nul;
+  };
+  std::vector<Live> live;
+  for (auto const &fld : map_->fields) {
+    if (fld.type != FieldType::VarString && fld.type != FieldType::Blob)
+      continue;
+    auto *ref = reinterpret_cast<uint64_t *>(base + fld.offset);
+    if (*ref >> 32)
+      live.push_back({ref, fld.type == FieldType::VarString ? 1u : 0u});
+    else
+      *ref = 0; // vazio: sempre no NUL reservado
+  }
+  std::sort(live.begin(), live.end(), [](const Live &a, const Live &b) {
+    return (*a.ref & 0xffffffffu) < (*b.ref & 0xffffffffu);
+  });
+
+  uint64_t dst = ARENA_RESERVED, bytes = 0;
+  for (auto const &l : live) {
+    uint64_t off = *l.ref & 0xffffffffu, len = *l.ref >> 32;
+    if (off != dst)
+      memmove(data + dst, data + off, len + l.nul);
+    __atomic_store_n(l.ref, arena_ref(dst, len), __ATOMIC_RELEASE);
+    dst += len + l.nul;
+    bytes += len;
+  }
+  uint64_t top = std::max(__atomic_load_n(&ah->top, __ATOMIC_RELAXED), dst);
+  memset(data + dst, 0, top - dst);
+  __atomic_store_n(&ah->top, dst, __ATOMIC_RELEASE);
+  __atomic_store_n(&ah->live, bytes, __ATOMIC_RELAXED);
+
+  if (wal_ || repl_) {
+    log_write(WalOp::Set, REPL_NO_FIELD, data_off, data, top);
+    for (auto const &fld : map_->fields)
+      if (fld.type == FieldType::VarString || fld.type == FieldType::Blob)
+        log_write(WalOp::Set, REPL_NO_FIELD, fld.offset, base + fld.offset,
+                  sizeof(uint64_t));
+    log_write(WalOp::Set, REPL_NO_FIELD, map_->arena_offset, ah,
+              2 * sizeof(uint64_t));
+    log_commit();
+  }
+  return top - dst;
+}
+
+// -------------------------------
+// WAL / SNAPSHOT / RECOVERY
+// -------------------------------
+// Escrita física de uma operação (offset relativo à cópia atual) para o WAL
+// e para o ring de replicação
+void LayoutEngine::log_write(WalOp op, size_t field, size_t offset,
+                             const void *data, size_t len) {
+  log_image_write(op, field, image_offset() + offset, data, len);
+}
+
+// Mesma escrita com offset relativo a image() (bitmap/controle do pool)
+void LayoutEngine::log_image_write(WalOp op, size_t field, size_t offset,
+                                   const void *data, size_t len) {
+  if (wal_)
+    wal_->append(op, offset, data, len);
+  if (repl_)
+    repl_->append(op, static_cast<uint16_t>(field), offset, data, len);
+}
+
+void LayoutEngine::log_commit() {
+  if (wal_)
+    wal_->commit();
+  if (repl_)
+    repl_->commit();
+}
+
+void LayoutEngine::enable_wal(const std::string &path, const WalOptions &opts) {
+  require_writable("enable_wal");
+  // offsets do WAL/snapshot cobrem só o buffer base, não os chunks
+  if (map_->grow_size)
+    throw std::runtime_error("WAL não suporta arrays com chunk_items");
+  // a cópia do begin_write e o flip do publish não são registrados
+  if (ctrl_)
+    throw std::runtime_error("WAL não suporta double_buffered");
+  if (!wal_)
+    wal_ = std::make_unique<WriteAheadLog>();
+  wal_->open(path, opts);
+}
+
+void LayoutEngine::sync_wal() {
+  if (wal_)
+    wal_->sync();
+}
+
+void LayoutEngine::set_snapshot_options(const SnapshotOptions &opts) {
+  snapshot_opts_ = opts;
+}
+
+// Trechos sem conteúdo vivo, relativos a image(): slots de object[] livres
+// (flag de uso zerada ou além do contador) e a cauda da arena, por instância
+std::vector<SnapshotRange> LayoutEngine::unused_ranges() const {
+  std::vector<SnapshotRange> out;
+  std::vector<size_t> bases{0};
+  if (pool_) {
+    bases.clear();
+    for (size_t i = 0; i < map_->pool_instances; ++i)
+      bases.push_back(map_->pool_offset + i * map_->instance_stride);
+  }
+  const char *img = image();
+  auto add = [&](size_t off, size_t len) {
+    if (!out.empty() && out.back().offset + out.back().len == off)
+      out.back().len += len;
+    else
+      out.push_back({off, len});
+  };
+  for (size_t base : bases) {
+    std::vector<SnapshotRange> inst;
+    for (auto const &f : map_->fields) {
+      if (f.type != FieldType::Array)
+        continue;
+      uint32_t cnt;
+      memcpy(&cnt, img + base + f.count_offset, sizeof(cnt));
+      size_t first = base + f.offset + 4;
+      for (size_t i = 0; i < f.max_items; ++i) {
+        size_t slot = first + i * f.item_stride;
+        if (i >= cnt) {
+          add(slot, (f.max_items - i) * f.item_stride);
+          break;
+        }
+        if (f.has_used_flag && img[slot] == 0)
+          add(slot, f.item_stride);
+      }
+    }
+    if (map_->arena_offset) {
+      ArenaHeader ah;
+      memcpy(&ah, img + base + map_->arena_offset, sizeof(ah));
+      if (ah.top < map_->arena_size)
+        add(base + map_->arena_offset + sizeof(ArenaHeader) + ah.top,
+            map_->arena_size - ah.top);
+    }
+  }
+  std::sort(out.begin(), out.end(),
+            [](const SnapshotRange &a, const SnapshotRange &b) {
+              return a.offset < b.offset;
+            });
+  return out;
+}
+
+void LayoutEngine::write_snapshot(const std::string &path) const {
+  std::vector<SnapshotRange> unused;
+  if (snapshot_opts_.skip_unused)
+    unused = unused_ranges();
+  snapshot_write(path, image(), size_, map_->fingerprint, unused,
+                 snapshot_opts_);
+}
+
+void LayoutEngine::checkpoint(const std::string &snapshot_path) {
+  if (!base_ptr_)
+    throw std::runtime_error("checkpoint sem memória mapeada");
+  if (map_->grow_size)
+    throw std::runtime_error("snapshot não suporta arrays com chunk_items");
+  // Registros até aqui já estão refletidos no snapshot; reaplicá-los depois
+  // de um crash entre o rename e o truncate é idempotente.
+  sync_wal();
+  if (repl_) {
+    // Seguidores que se ressincronizarem por este arquivo seguem do ponto
+    // do ring publicado aqui
+    repl_->begin_snapshot(snapshot_path);
+    try {
+      write_snapshot(snapshot_path);
+    } catch (...) {
+      repl_->end_snapshot(false);
+      throw;
+    }
+    repl_->end_snapshot(true);
+  } else {
+    write_snapshot(snapshot_path);
+  }
+  if (wal_)
+    wal_->truncate();
+}
+
+bool LayoutEngine::restore_snapshot(const std::string &snapshot_path) {
+  if (!base_ptr_)
+    throw std::runtime_error("restore_snapshot sem memória mapeada");
+  require_writable("restore_snapshot");
+  // Cru ou comprimido; blocos descomprimidos direto no mapeamento
+  return snapshot_read(snapshot_path, image(), size_, map_->fingerprint,
+                       snapshot_opts_.threads, [&](const char *prefix) {
+                         LayoutHeader hdr;
+                         memcpy(&hdr, prefix, sizeof(hdr));
+                         validate_header(hdr, snapshot_path);
+                       });
+}
+
+size_t LayoutEngine::recover(const std::string &snapshot_path,
+                             const std::string &wal_path) {
+  if (!base_ptr_)
+    throw std::runtime_error("recover sem memória mapeada");
+  require_writable("recover");
+
+  restore_snapshot(snapshot_path);
+  size_t applied = WriteAheadLog::replay(wal_path, image(), size_);
+
+  // Consolida: novo snapshot e WAL vazio (descarta cauda corrompida)
+  write_snapshot(snapshot_path);
+  if (truncate(wal_path.c_str(), 0) < 0 && errno != ENOENT)
+    throw std::runtime_error("truncate(wal) failed: " + wal_path);
+  return applied;
+}
 
 // -------------------------------
-// INTERNAL INSERT / POP / GET
+// REPLICAÇÃO
 // -------------------------------
-void LayoutEngine::insert(const std::string &field_name, const void *item) {
-  auto const &fld = map_.fields[map_.field_index.at(field_name)];
-  if (fld.type != FieldType::Array)
-    throw std::runtime_error("insert só valids para array");
-  uint32_t *cnt =
-      reinterpret_cast<uint32_t *>((char *)base_ptr_ + fld.count_offset);
-  if (*cnt >= fld.max_items)
-    throw std::runtime_error("array cheio");
-  size_t base = fld.offset + 4 + (*cnt * fld.item_stride);
-  if (fld.has_used_flag) {
-    *((char *)base_ptr_ + base) = 1;
-    ++base;
-  }
-  memcpy((char *)base_ptr_ + base, item,
-         fld.item_stride - (fld.has_used_flag ? 1 : 0));
-  (*cnt)++;
+void LayoutEngine::enable_replication(const std::string &ring_path,
+                                      const ReplOptions &opts) {
+  require_writable("enable_replication");
+  // mesmos limites do WAL; em A/B a imagem alterna entre as cópias
+  if (map_->grow_size)
+    throw std::runtime_error("replicação não suporta arrays com chunk_items");
+  if (ctrl_)
+    throw std::runtime_error("replicação não suporta double_buffered");
+  if (!repl_)
+    repl_ = std::make_unique<ReplicationLog>();
+  repl_->open(ring_path, map_->fingerprint, size_, opts);
+  if (!opts.snapshot_path.empty())
+    checkpoint(opts.snapshot_path);
 }
 
-void LayoutEngine::pop(const std::string &f, size_t idx) {
-  auto const &fld = map_.fields[map_.field_index.at(f)];
-  if (fld.type != FieldType::Array)
-    throw std::runtime_error("pop só pra array");
-  uint32_t *cnt =
-      reinterpret_cast<uint32_t *>((char *)base_ptr_ + fld.count_offset);
-  if (idx >= *cnt)
-    throw std::runtime_error("out of bounds");
-  size_t base = fld.offset + 4 + idx * fld.item_stride;
-  if (fld.has_used_flag)
-    *((char *)base_ptr_ + base) = 0;
+void LayoutEngine::flush_replication() {
+  if (repl_)
+    repl_->flush();
 }
 
-void *LayoutEngine::get(const std::string &f, size_t idx) {
-  auto const &fld = map_.fields[map_.field_index.at(f)];
-  if (fld.type == FieldType::Array) {
-    uint32_t *cnt =
-        reinterpret_cast<uint32_t *>((char *)base_ptr_ + fld.count_offset);
-    if (idx >= *cnt)
-      return nullptr;
-    size_t base = fld.offset + 4 + idx * fld.item_stride;
-    if (fld.has_used_flag && *((char *)base_ptr_ + base) == 0)
-      return nullptr;
-    return (char *)base_ptr_ + base + (fld.has_used_flag ? 1 : 0);
-  } else {
-    if (idx > 0)
-      return nullptr;
-    return (char *)base_ptr_ + fld.offset;
-  }
+ReplLag LayoutEngine::replication_lag() const {
+  return repl_ ? repl_->lag() : ReplLag{};
+}
+
+void LayoutEngine::apply_delta(size_t offset, const void *data, size_t len) {
+  require_writable("apply_delta");
+  if (ctrl_ || map_->grow_size)
+    throw std::runtime_error("apply_delta: layout sem suporte a replicação");
+  if (offset > size_ || len > size_ - offset)
+    throw std::runtime_error("apply_delta fora da imagem");
+  memcpy(image() + offset, data, len);
 }
 
 // -------------------------------
 // GENERATE FFI HEADER
 // -------------------------------
+void LayoutEngine::set_codegen_options(const CodegenOptions &opts) {
+  codegen_opts_ = opts;
+}
+
 void LayoutEngine::generate_ffi_header(const std::string &out_path) {
   std::ofstream out(out_path);
   if (!out)
     throw std::runtime_error("Não foi possível abrir " + out_path);
 
   // 1) Guard e includes básicos
-  out << "#pragma once\n"
-         "#include <cstddef>\n"
-         "#include <cstdint>\n\n";
+  bool compact = codegen_opts_.compact;
+  bool arena = map_->arena_offset != 0;
+  bool strings = arena, arrays = false;
+  for (auto const &fld : map_->fields) {
+    strings |= fld.type == FieldType::String;
+    arrays |= fld.type == FieldType::Array;
+  }
+  out << "#pragma once\n";
+  if (compact)
+    out << "#include <cassert>\n";
+  out << "#include <cstddef>\n"
+         "#include <cstdint>\n";
+  if (compact)
+    out << "#include <cstring>\n";
+  if (arrays)
+    out << "#include <iterator>\n";
+  if (strings || compact)
+    out << "#include <string_view>\n";
+  if (compact)
+    out << "#include <type_traits>\n";
+  out << "\n";
 
   // 2) OFFSET_TOTAL_SIZE
   out << "// Tamanho total do buffer (gerado pelo LayoutEngine)\n"
          "constexpr std::size_t OFFSET_TOTAL_SIZE = "
-      << map_.total_size << ";\n\n";
+      << map_->total_size
+      << ";\n"
+         "// Tamanho do arquivo mapeado (== OFFSET_TOTAL_SIZE sem pool)\n"
+         "constexpr std::size_t BUFFER_SIZE = "
+      << layout_buffer_size(*map_) << ";\n\n";
+  bool grow = map_->grow_size != 0;
+  if (grow)
+    out << "// Arrays crescentes: chunks anexados a partir de GROW_OFFSET; o\n"
+           "// mapeamento cobre MAP_LENGTH (reserva inteira) desde o init\n"
+           "constexpr std::size_t GROW_OFFSET = "
+        << map_->grow_offset
+        << ";\n"
+           "constexpr std::size_t GROW_SIZE   = "
+        << map_->grow_size
+        << ";\n"
+           "constexpr std::size_t MAP_LENGTH  = BUFFER_SIZE + GROW_SIZE;\n"
+           "constexpr std::size_t GROW_CONTROL_OFFSET = GROW_OFFSET - 64;\n\n";
 
-  // 3) Geração de OFFSET_<campo> e STRIDE_<array>
-  out << "// Offsets e strides gerados\n";
-  for (auto const &fld : map_.fields) {
+  // 2.1) Header do buffer, validado em init_layout_buffer
+  out << "// Header no offset 0 do buffer (validado em init_layout_buffer)\n"
+         "constexpr std::uint32_t HEADER_MAGIC = 0x"
+      << std::hex << LAYOUT_HEADER_MAGIC << std::dec
+      << ";\n"
+         "constexpr std::uint16_t HEADER_VERSION = "
+      << LAYOUT_FORMAT_VERSION
+      << ";\n"
+         "constexpr std::size_t HEADER_SIZE = "
+      << map_->header_size
+      << ";\n"
+         "constexpr std::uint64_t LAYOUT_FINGERPRINT = 0x"
+      << std::hex << map_->fingerprint << std::dec << "ULL;\n\n";
+  out << "struct layout_header {\n"
+         "  std::uint32_t magic;\n"
+         "  std::uint16_t version;\n"
+         "  std::uint16_t header_size;\n"
+         "  std::uint64_t fingerprint;\n"
+         "  std::uint64_t total_size;\n"
+         "  std::uint32_t flags;\n"
+         "};\n"
+         "constexpr std::uint32_t HEADER_FLAG_SUPERSEDED = "
+      << LAYOUT_FLAG_SUPERSEDED << ";\n\n";
+
+  // 3) Geração de OFFSET_<campo> e STRIDE_<array> (no modo compacto os
+  // offsets ficam só na tabela de descritores)
+  if (!compact)
+    out << "// Offsets e strides gerados\n";
+  for (auto const &fld : map_->fields) {
+    if (compact)
+      break;
     switch (fld.type) {
     // campos simples
     case FieldType::Int32:
@@ -274,6 +1930,13 @@ void LayoutEngine::generate_ffi_header(const std::string &out_path) {
       }
       break;
 
+    // referência de 8 bytes para a arena
+    case FieldType::VarString:
+    case FieldType::Blob:
+      out << "constexpr std::size_t OFFSET_" << fld.name << " = " << fld.offset
+          << ";\n";
+      break;
+
     // arrays de objetos
     case FieldType::Array:
       out << "constexpr std::size_t OFFSET_" << fld.name
@@ -282,26 +1945,152 @@ void LayoutEngine::generate_ffi_header(const std::string &out_path) {
           << "_base  = " << (fld.offset + 4) << ";\n";
       out << "constexpr std::size_t STRIDE_" << fld.name << "     = "
           << fld.item_stride << ";\n";
+      out << "constexpr std::size_t MAX_ITEMS_" << fld.name << "  = "
+          << fld.max_items << ";\n";
+      if (fld.chunk_items) {
+        out << "constexpr std::size_t OFFSET_" << fld.name
+            << "_dir   = " << fld.offset + CHUNK_DIR_OFFSET << ";\n";
+        out << "constexpr std::size_t CHUNK_ITEMS_" << fld.name << " = "
+            << fld.chunk_items << ";\n";
+        out << "constexpr std::size_t CHUNK_BYTES_" << fld.name << " = "
+            << chunk_bytes(fld) << ";\n";
+      }
       for (auto const &ch : fld.children) {
         out << "constexpr std::size_t OFFSET_" << fld.name << "_" << ch.name
             << " = " << (ch.offset + (fld.has_used_flag ? 1 : 0)) << ";\n";
       }
       break;
 
+    // sub-objetos: offset absoluto de cada subcampo
+    case FieldType::Object:
+      for (auto const &ch : fld.children) {
+        out << "constexpr std::size_t OFFSET_" << fld.name << "_" << ch.name
+            << " = " << (fld.offset + ch.offset) << ";\n";
+      }
+      break;
+
     default:
       break;
     }
   }
   out << "\n";
 
+  // 3.1) Seção de estatísticas: índice de cada campo (subcampos apontam
+  // para o campo de topo)
+  if (map_->stats_slots) {
+    out << "// Estatísticas por campo (FieldStats de 64 bytes por slot/campo)\n"
+           "constexpr std::size_t STATS_OFFSET = "
+        << map_->stats_offset
+        << ";\n"
+           "constexpr std::size_t STATS_SLOTS  = "
+        << map_->stats_slots
+        << ";\n"
+           "constexpr std::size_t STATS_FIELDS = "
+        << map_->fields.size() << ";\n";
+    // compacto: o índice vem de field_desc::stats
+    for (size_t i = 0; i < map_->fields.size() && !compact; ++i) {
+      auto const &fld = map_->fields[i];
+      out << "constexpr std::size_t STATS_IDX_" << fld.name << " = " << i
+          << ";\n";
+      if (fld.type == FieldType::Object)
+        for (auto const &ch : fld.children)
+          out << "constexpr std::size_t STATS_IDX_" << fld.name << "_"
+              << ch.name << " = " << i << ";\n";
+    }
+    out << "\n";
+  }
+
+  // 3.2) Pool: registros de OFFSET_TOTAL_SIZE a cada INSTANCE_STRIDE
+  bool pool = map_->pool_instances != 0;
+  if (pool) {
+    out << "// Pool de instâncias (bitmap de ocupação após o header)\n"
+           "constexpr std::size_t POOL_INSTANCES      = "
+        << map_->pool_instances
+        << ";\n"
+           "constexpr std::size_t POOL_OFFSET         = "
+        << map_->pool_offset
+        << ";\n"
+           "constexpr std::size_t INSTANCE_STRIDE     = "
+        << map_->instance_stride
+        << ";\n"
+           "constexpr std::size_t POOL_CONTROL_OFFSET = "
+        << POOL_CONTROL_OFFSET
+        << ";\n"
+           "constexpr std::size_t POOL_BITMAP_OFFSET  = "
+        << POOL_BITMAP_OFFSET
+        << ";\n\n"
+           "struct pool_control {\n"
+           "  std::uint64_t instances;\n"
+           "  std::uint64_t stride;\n"
+           "  std::uint64_t used;\n"
+           "};\n\n";
+  }
+
+  // 3.3) Arena: referência = offset (32 bits baixos) | tamanho << 32
+  if (arena) {
+    out << "// Arena de varstring/blob (bump; compact_arena recupera espaço)\n"
+           "constexpr std::size_t ARENA_OFFSET      = "
+        << map_->arena_offset
+        << ";\n"
+           "constexpr std::size_t ARENA_DATA_OFFSET = "
+        << map_->arena_offset + sizeof(ArenaHeader)
+        << ";\n"
+           "constexpr std::size_t ARENA_CAPACITY    = "
+        << map_->arena_size
+        << ";\n"
+           "constexpr std::size_t ARENA_RESERVED    = "
+        << ARENA_RESERVED
+        << "; // NUL permanente: referência 0 = vazio\n\n"
+           "struct arena_header {\n"
+           "  std::uint64_t top;\n"
+           "  std::uint64_t live;\n"
+           "};\n\n";
+  }
+
   // 4) Começa bloc o extern "C"
   out << "extern \"C\" {\n\n";
 
   // 5) init
-  out << "void init_layout_buffer(const char* path);\n\n";
+  out << "void init_layout_buffer(const char* path);\n";
+  out << "// Anexa sem criar/redimensionar, PROT_READ (setters geram SIGSEGV);\n"
+         "// populate != 0 usa MAP_POPULATE\n"
+         "void init_layout_buffer_readonly(const char* path, int populate);\n";
+  out << "// != 0 quando o buffer foi trocado por migrate: chame init de novo\n"
+         "int  layout_superseded();\n\n";
+
+  // 5.1) Instâncias explícitas: um mapeamento por layout_ctx
+  out << "// Um buffer por contexto (ex.: um por instrumento). Os acessores sem\n"
+         "// prefixo operam sobre layout_default_ctx(), preenchido pelo init.\n"
+         "struct layout_ctx {\n"
+         "  void* base;\n"
+         "  layout_header* header; // header do arquivo (no pool, o do início)\n"
+      << (grow ? "  int   fd; // anexa chunks (-1 em somente leitura)\n" : "")
+      << "};\n"
+         "layout_ctx* layout_open(const char* path, int read_only, int populate);\n"
+         "void        layout_close(layout_ctx* ctx);\n"
+         "layout_ctx* layout_default_ctx();\n"
+         "int         ctx_layout_superseded(layout_ctx* ctx);\n\n";
+  if (pool)
+    out << "// Pool: layout_open/init devolvem a instância 0. Qualquer contexto do\n"
+           "// pool serve de `pool` abaixo (o arquivo é achado pelo header).\n"
+           "inline layout_ctx layout_pool_instance(layout_ctx* pool, std::size_t idx) {\n"
+           "  return layout_ctx{reinterpret_cast<char*>(pool->header) + POOL_OFFSET +\n"
+           "                    idx * INSTANCE_STRIDE, pool->header};\n"
+           "}\n"
+           "layout_ctx* layout_default_pool();\n"
+           "// índice da instância reservada (zerada) ou -1 com o pool cheio\n"
+           "long        layout_pool_claim(layout_ctx* pool);\n"
+           "void        layout_pool_release(layout_ctx* pool, std::size_t idx);\n\n";
 
-  // 6) Struct definitions
-  for (auto const &fld : map_.fields) {
+  // 6) Struct definitions (empacotadas, iguais ao layout no buffer). No
+  // modo compacto só para os wrappers nomeados (get_<arr>_item), e sem
+  // root_layout: o header não cresce com o número de campos além da tabela.
+  bool structs = !compact || codegen_opts_.named_wrappers;
+  if (structs)
+    out << "#pragma pack(push, 1)\n";
+  for (auto const &fld : map_->fields) {
+    if (!structs)
+      break;
     if (fld.type == FieldType::Object) {
       out << "struct " << fld.name << " {\n";
       for (auto const &ch : fld.children) {
@@ -329,8 +2118,12 @@ void LayoutEngine::generate_ffi_header(const std::string &out_path) {
   }
 
   // 7) root_layout
-  out << "struct root_layout {\n";
-  for (auto const &fld : map_.fields) {
+  if (!compact)
+    out << "struct root_layout {\n"
+           "  unsigned char _header[HEADER_SIZE];\n";
+  for (auto const &fld : map_->fields) {
+    if (compact)
+      break;
     switch (fld.type) {
     case FieldType::Int32:
     case FieldType::Int64:
@@ -343,92 +2136,242 @@ void LayoutEngine::generate_ffi_header(const std::string &out_path) {
       out << "  double " << fld.name << ";\n";
       break;
     case FieldType::String:
-      out << "  char   " << fld.name << "[" << fld.max_length << "];\n";
+      out << "  std::uint32_t " << fld.name << "_len;\n"
+          << "  char   " << fld.name << "[" << fld.max_length << "];\n";
       break;
     case FieldType::Object:
       out << "  struct " << fld.name << " " << fld.name << ";\n";
       break;
     case FieldType::Array:
+      if (fld.chunk_items) {
+        out << "  std::uint32_t " << fld.name << "_count;\n"
+            << "  std::uint32_t _" << fld.name << "_pad;\n"
+            << "  std::uint64_t " << fld.name << "_dir["
+            << fld.max_items / fld.chunk_items << "];\n";
+        break;
+      }
       out << "  struct " << fld.name << " " << fld.name << "[" << fld.max_items
           << "];\n";
       break;
+    case FieldType::VarString:
+    case FieldType::Blob:
+      out << "  std::uint64_t " << fld.name << ";\n";
+      break;
     default:
       break;
     }
   }
-  out << "};\n\n";
+  if (!compact)
+    out << "};\n";
+  if (structs)
+    out << "#pragma pack(pop)\n\n";
+
+  // 8) Assinaturas FFI: acessor global (contexto padrão) + ctx_<nome>
+  auto decl = [&](const std::string &ret, const std::string &fn,
+                  const std::string &params) {
+    out << ret << " " << fn << "(" << params << ");\n"
+        << ret << " ctx_" << fn << "(layout_ctx* ctx"
+        << (params.empty() ? "" : ", ") << params << ");\n";
+  };
+  auto scalar_type = [](FieldType t) -> std::string {
+    return t == FieldType::Int32     ? "int"
+           : t == FieldType::Float32 ? "float"
+                                     : "double";
+  };
+  for (auto const &fld : map_->fields) {
+    if (compact)
+      break; // acessores vêm da tabela de descritores (write_compact_header)
 
-  // 8) Assinaturas FFI
-  for (auto const &fld : map_.fields) {
     // simples
-    if (fld.type == FieldType::Int32) {
-      out << "int    get_" << fld.name
-          << "();\n"
-             "void   set_"
-          << fld.name << "(int value);\n\n";
-    }
-    if (fld.type == FieldType::Float32) {
-      out << "float  get_" << fld.name
-          << "();\n"
-             "void   set_"
-          << fld.name << "(float value);\n\n";
-    }
-    if (fld.type == FieldType::Float64) {
-      out << "double get_" << fld.name
-          << "();\n"
-             "void   set_"
-          << fld.name << "(double value);\n\n";
-    }
-    if (fld.type == FieldType::String) {
-      out << "const char* get_" << fld.name
-          << "();\n"
-             "void         set_"
-          << fld.name << "(const char* value);\n\n";
+    if (fld.type == FieldType::Int32 || fld.type == FieldType::Float32 ||
+        fld.type == FieldType::Float64) {
+      std::string tp = scalar_type(fld.type);
+      decl(tp, "get_" + fld.name, "");
+      decl("void", "set_" + fld.name, tp + " value");
+      out << "\n";
     }
 
     // sub-objetos
     if (fld.type == FieldType::Object) {
       for (auto const &ch : fld.children) {
         std::string nm = fld.name + "_" + ch.name;
-        if (ch.type == FieldType::Int32)
-          out << "int    get_" << nm << "(); void set_" << nm << "(int);\n";
-        else if (ch.type == FieldType::Float32)
-          out << "float  get_" << nm << "(); void set_" << nm << "(float);\n";
-        else if (ch.type == FieldType::Float64)
-          out << "double get_" << nm << "(); void set_" << nm << "(double);\n";
+        std::string tp = scalar_type(ch.type);
+        decl(tp, "get_" + nm, "");
+        decl("void", "set_" + nm, tp + " value");
       }
       out << "\n";
     }
 
     // arrays
     if (fld.type == FieldType::Array) {
-      out << "std::size_t get_" << fld.name
-          << "_count();\n"
-             "void        set_"
-          << fld.name << "_count(std::size_t count);\n\n";
+      decl("std::size_t", "get_" + fld.name + "_count", "");
+      decl("void", "set_" + fld.name + "_count", "std::size_t count");
+      out << "\n";
       for (auto const &ch : fld.children) {
         std::string nm = fld.name + "_" + ch.name;
-        std::string tp = (ch.type == FieldType::Int32     ? "int"
-                          : ch.type == FieldType::Float32 ? "float"
-                                                          : "double");
-        out << tp << " get_" << nm
-            << "(std::size_t index);\n"
-               "void set_"
-            << nm << "(std::size_t index, " << tp << " value);\n\n";
+        std::string tp = scalar_type(ch.type);
+        decl(tp, "get_" + nm, "std::size_t index");
+        decl("void", "set_" + nm, "std::size_t index, " + tp + " value");
+        out << "\n";
       }
-      out << "void        pop_" << fld.name
-          << "(std::size_t index);\n\n"
-             "struct "
-          << fld.name << " get_" << fld.name
-          << "_item(std::size_t index);\n\n"
-             "void        get_"
-          << fld.name << "_items(std::size_t start, std::size_t count, struct "
-          << fld.name << "* out_buffer);\n\n";
+      decl("void", "pop_" + fld.name, "std::size_t index");
+      decl("struct " + fld.name, "get_" + fld.name + "_item",
+           "std::size_t index");
+      decl("void", "get_" + fld.name + "_items",
+           "std::size_t start, std::size_t count, struct " + fld.name +
+               "* out_buffer");
+      out << "\n";
     }
   }
 
   // 9) fecha extern C
   out << "}\n";
+  if (compact)
+    write_compact_header(out);
+
+  // 10) Texto (linkage C++): string/varstring/blob como views sem cópia,
+  // válidas até o próximo set_ ou compact_arena no campo
+  if (strings && !compact) {
+    out << "\n// Campos de texto: views sem cópia, válidas até o próximo set_ ou\n"
+           "// compact_arena. string trunca em <campo>_MAX_LEN - 1 bytes.\n";
+    for (auto const &fld : map_->fields) {
+      if (fld.type != FieldType::String && fld.type != FieldType::VarString &&
+          fld.type != FieldType::Blob)
+        continue;
+      decl("std::string_view", "get_" + fld.name, "");
+      decl("void", "set_" + fld.name, "const char* data, std::size_t len");
+    }
+  }
+  if (arena)
+    out << "// Compactar exige ausência de leitores concorrentes\n"
+           "std::size_t compact_arena();\n"
+           "std::size_t ctx_compact_arena(layout_ctx* ctx);\n";
+
+  // 11) Itens vivos de cada array (linkage C++, inline): iterador forward
+  // sobre os slots com flag de uso, até o contador. O compacto usa o
+  // live_items<FieldId> genérico de write_compact_header.
+  for (auto const &fld : map_->fields) {
+    if (fld.type != FieldType::Array || compact)
+      continue;
+    std::string a = fld.name, it = a + "_iterator", s = "STRIDE_" + a;
+    bool chunked = fld.chunk_items != 0;
+    out << "\n// Itens vivos de " << a
+        << " (flag de uso != 0, índice < count) para range-for e\n"
+           "// <algorithm>: referências para o item no próprio buffer.\n"
+           "class "
+        << it
+        << " {\n"
+           "public:\n"
+           "  using iterator_category = std::forward_iterator_tag;\n"
+           "  using value_type        = struct "
+        << a
+        << ";\n"
+           "  using difference_type   = std::ptrdiff_t;\n"
+           "  using pointer           = struct "
+        << a
+        << "*;\n"
+           "  using reference         = struct "
+        << a << "&;\n\n  " << it << "() = default;\n";
+    if (chunked)
+      out << "  " << it
+          << "(char* base, std::size_t count) : base_(base), count_(count) { "
+             "skip(); }\n";
+    else
+      out << "  " << it
+          << "(char* first, char* end) : p_(first), end_(end) { skip(); }\n";
+    out << "  reference operator*() const { return *reinterpret_cast<pointer>(p_ + 1); }\n"
+           "  pointer operator->() const { return reinterpret_cast<pointer>(p_ + 1); }\n"
+           "  "
+        << it << "& operator++() { p_ += " << s
+        << "; skip(); return *this; }\n"
+           "  "
+        << it << " operator++(int) { " << it
+        << " t = *this; ++*this; return t; }\n"
+           "  bool operator==(const "
+        << it
+        << "& o) const { return p_ == o.p_; }\n"
+           "  bool operator!=(const "
+        << it
+        << "& o) const { return p_ != o.p_; }\n\n"
+           "private:\n"
+           "  void skip() {\n";
+    std::string scan =
+        "    for (; p_ < end_; p_ += " + s +
+        ")\n"
+        "      if (*p_) return;\n";
+    if (chunked) {
+      // reindenta o scan dentro do laço de chunks
+      std::string inner;
+      for (size_t i = 0, j; i < scan.size(); i = j + 1) {
+        j = scan.find('\n', i);
+        inner += "  " + scan.substr(i, j - i + 1);
+      }
+      out << "    for (;;) {\n"
+          << inner
+          << "      if (next_ >= count_) break;\n"
+             "      // próximo chunk: slots [next_, next_ + n); chunk não alocado não\n"
+             "      // tem itens\n"
+             "      auto* dir = reinterpret_cast<std::uint64_t*>(base_ + OFFSET_"
+          << a
+          << "_dir);\n"
+             "      std::uint64_t off = __atomic_load_n(&dir[next_ / CHUNK_ITEMS_"
+          << a
+          << "], __ATOMIC_ACQUIRE);\n"
+             "      std::size_t n = count_ - next_ < CHUNK_ITEMS_"
+          << a << " ? count_ - next_ : CHUNK_ITEMS_" << a
+          << ";\n"
+             "      next_ += n;\n"
+             "      if (off) { p_ = base_ + off; end_ = p_ + n * "
+          << s
+          << "; }\n"
+             "    }\n";
+    } else {
+      out << scan;
+    }
+    out << "    p_ = nullptr; // fim\n"
+           "  }\n\n"
+           "  char* p_ = nullptr;\n"
+           "  char* end_ = nullptr;\n";
+    if (chunked)
+      out << "  char* base_ = nullptr;\n"
+             "  std::size_t next_ = 0, count_ = 0;\n";
+    out << "};\n\n"
+           "struct "
+        << a
+        << "_live_range {\n"
+           "  char* base;\n"
+           "  // limitado a MAX_ITEMS: contador corrompido não passa do array\n"
+           "  std::size_t count() const {\n"
+           "    std::size_t n = __atomic_load_n(reinterpret_cast<std::uint32_t*>(base + OFFSET_"
+        << a
+        << "_count), __ATOMIC_ACQUIRE);\n"
+           "    return n < MAX_ITEMS_"
+        << a << " ? n : MAX_ITEMS_" << a
+        << ";\n"
+           "  }\n"
+           "  "
+        << it << " begin() const {\n";
+    if (chunked)
+      out << "    return " << it << "(base, count());\n";
+    else
+      out << "    char* first = base + OFFSET_" << a
+          << "_base;\n"
+             "    return "
+          << it << "(first, first + count() * " << s << ");\n";
+    out << "  }\n"
+           "  "
+        << it
+        << " end() const { return {}; }\n"
+           "};\n\n"
+           "inline "
+        << a << "_live_range ctx_" << a
+        << "_range(layout_ctx* ctx) {\n"
+           "  return {static_cast<char*>(ctx->base)};\n"
+           "}\n"
+           "inline "
+        << a << "_live_range " << a << "_range() { return ctx_" << a
+        << "_range(layout_default_ctx()); }\n";
+  }
   out.close();
 }
 
@@ -452,6 +2395,7 @@ void LayoutEngine::generate_ffi_cpp(const std::string &out_path) {
     throw std::runtime_error("Header não encontrado: " + header_path);
 
   std::ofstream out(out_path);
+  bool compact = codegen_opts_.compact;
   // includes top
   out << R"(#include <cstddef>
 #include <cstdint>
@@ -459,56 +2403,399 @@ void LayoutEngine::generate_ffi_cpp(const std::string &out_path) {
 #include <stdexcept>
 #include <fcntl.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
 #include <unistd.h>
-#include ")"
-      << hdr << R"("
+)";
+  if (map_->stats_slots)
+    out << "#include <sched.h>\n#include <time.h>\n";
+  if (map_->arena_offset)
+    out << "#include <algorithm>\n#include <vector>\n";
+  if (compact)
+    out << "#include <string>\n";
+  out << "#include \"" << hdr << "\"\n\n";
+
+  bool grow = map_->grow_size != 0;
+  std::string map_len = grow ? "MAP_LENGTH" : "BUFFER_SIZE";
+  out << "static layout_ctx default_ctx{nullptr, nullptr"
+      << (grow ? ", -1" : "") << "};\n\n";
+
+  // Contadores na seção STATS_OFFSET (mesmo formato de FieldStats)
+  if (map_->stats_slots)
+    out << R"(struct field_stats {
+  std::uint64_t inserts, pops, full_rejections, writes, max_occupancy, last_write_ns, _pad[2];
+};
+
+// CPU relida a cada )" << STATS_CPU_REFRESH << R"( atualizações (thread que migra muda de slot)
+static field_stats* stats_entry(char* base, std::size_t fi) {
+  static thread_local int cpu = 0;
+  static thread_local unsigned left = 0;
+  if (left-- == 0) { cpu = sched_getcpu(); if (cpu < 0) cpu = 0; left = )" << STATS_CPU_REFRESH - 1 << R"(; }
+  return reinterpret_cast<field_stats*>(base + STATS_OFFSET) +
+         (static_cast<std::size_t>(cpu) % STATS_SLOTS) * STATS_FIELDS + fi;
+}
+
+static std::uint64_t stats_now() {
+  timespec ts;
+  clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+  return static_cast<std::uint64_t>(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+}
+
+static void stats_write(char* base, std::size_t fi) {
+  auto* s = stats_entry(base, fi);
+  __atomic_fetch_add(&s->writes, 1, __ATOMIC_RELAXED);
+  __atomic_store_n(&s->last_write_ns, stats_now(), __ATOMIC_RELAXED);
+}
+
+// set_<arr>_count: crescimento conta como inserts
+static void stats_count(char* base, std::size_t fi, std::size_t old_c, std::size_t new_c) {
+  auto* s = stats_entry(base, fi);
+  if (new_c > old_c) {
+    __atomic_fetch_add(&s->inserts, new_c - old_c, __ATOMIC_RELAXED);
+    std::uint64_t cur = __atomic_load_n(&s->max_occupancy, __ATOMIC_RELAXED);
+    while (cur < new_c && !__atomic_compare_exchange_n(&s->max_occupancy, &cur, new_c, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {}
+  } else {
+    __atomic_fetch_add(&s->writes, 1, __ATOMIC_RELAXED);
+  }
+  __atomic_store_n(&s->last_write_ns, stats_now(), __ATOMIC_RELAXED);
+}
+
+static void stats_pop(char* base, std::size_t fi) {
+  auto* s = stats_entry(base, fi);
+  __atomic_fetch_add(&s->pops, 1, __ATOMIC_RELAXED);
+  __atomic_store_n(&s->last_write_ns, stats_now(), __ATOMIC_RELAXED);
+}
+
+)";
+  // string: [uint32 tamanho][bytes + NUL]; copia só o valor, tamanho por último
+  bool has_str = false;
+  for (auto const &fld : map_->fields)
+    has_str |= fld.type == FieldType::String;
+  if (has_str)
+    out << R"(static void str_set(char* base, std::size_t off, std::size_t max_len, const char* data, std::size_t len) {
+  std::size_t n = len < max_len ? len : max_len - 1;
+  char* dst = base + off + 4;
+  memcpy(dst, data, n);
+  dst[n] = 0;
+  __atomic_store_n(reinterpret_cast<std::uint32_t*>(base + off), static_cast<std::uint32_t>(n), __ATOMIC_RELEASE);
+}
 
 )";
+  // no modo compacto as leituras são inline no header
+  if (has_str && !compact)
+    out << R"(static std::string_view str_get(char* base, std::size_t off) {
+  return std::string_view(base + off + 4, __atomic_load_n(reinterpret_cast<std::uint32_t*>(base + off), __ATOMIC_ACQUIRE));
+}
 
-  // Constante de tamanho total
-  out << "constexpr std::size_t OFFSET_TOTAL_SIZE = " << map_.total_size
-      << ";\n\n";
-  out << "void* base_ptr = nullptr;\n\n";
+)";
+  // Arena: bump com CAS e publicação da referência num único store. O byte
+  // 0 é o NUL reservado: valor vazio grava referência 0 sem alocar.
+  if (map_->arena_offset)
+    out << R"(static void arena_set(char* base, std::size_t ref_off, const char* data, std::size_t len, std::size_t nul) {
+  auto* ah = reinterpret_cast<arena_header*>(base + ARENA_OFFSET);
+  std::uint64_t off = 0;
+  if (len) {
+    std::uint64_t top = __atomic_load_n(&ah->top, __ATOMIC_RELAXED);
+    do {
+      off = top > ARENA_RESERVED ? top : ARENA_RESERVED;
+      if (off + len + nul > ARENA_CAPACITY) throw std::runtime_error("arena cheia");
+    } while (!__atomic_compare_exchange_n(&ah->top, &top, off + len + nul, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+    char* dst = base + ARENA_DATA_OFFSET + off;
+    memcpy(dst, data, len);
+    if (nul) dst[len] = 0;
+  }
+  auto* ref = reinterpret_cast<std::uint64_t*>(base + ref_off);
+  std::uint64_t old = __atomic_exchange_n(ref, off | static_cast<std::uint64_t>(len) << 32, __ATOMIC_RELEASE);
+  __atomic_fetch_add(&ah->live, len - (old >> 32), __ATOMIC_RELAXED);
+}
 
-  // Função init
-  out << R"(extern "C" void init_layout_buffer(const char* path) {
-  int fd = open(path, O_RDWR);
-  if (fd < 0) throw std::runtime_error("open failed");
-  if (ftruncate(fd, OFFSET_TOTAL_SIZE) < 0) { close(fd); throw std::runtime_error("ftruncate"); }
-  base_ptr = mmap(nullptr, OFFSET_TOTAL_SIZE, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
-  if (base_ptr == MAP_FAILED) { close(fd); throw std::runtime_error("mmap"); }
-  close(fd);
+)";
+  if (map_->arena_offset && !compact)
+    out << R"(static std::string_view arena_get(char* base, std::size_t ref_off) {
+  std::uint64_t ref = __atomic_load_n(reinterpret_cast<std::uint64_t*>(base + ref_off), __ATOMIC_ACQUIRE);
+  return std::string_view(base + ARENA_DATA_OFFSET + (ref & 0xffffffffu), ref >> 32);
 }
 
 )";
+  bool st = map_->stats_slots != 0;
+  bool pool = map_->pool_instances != 0;
+  auto hook = [&](const std::string &call) {
+    return st ? " " + call + ";" : std::string();
+  };
 
-  // Declara offsets e strides
-  for (auto const &fld : map_.fields) {
-    if (fld.type != FieldType::Array && fld.type != FieldType::Object) {
-      out << "constexpr std::size_t OFFSET_" << fld.name << " = " << fld.offset
-          << ";\n";
-      if (fld.type == FieldType::String)
-        out << "constexpr std::size_t " << fld.name
-            << "_MAX_LEN = " << fld.max_length << ";\n";
+  // Arrays crescentes: slot via diretório de chunks; chunks novos são
+  // anexados com fallocate (nunca encolhe o arquivo) e publicados por CAS
+  if (grow) {
+    out << R"(static void grow_chunks(layout_ctx* ctx, std::size_t dir_off, std::size_t chunk_items, std::size_t chunk_bytes, std::size_t count) {
+  char* base = static_cast<char*>(ctx->base);
+  auto* dir = reinterpret_cast<std::uint64_t*>(base + dir_off);
+  auto* tail = reinterpret_cast<std::uint64_t*>(base + GROW_CONTROL_OFFSET);
+  for (std::size_t k = 0; k * chunk_items < count; ++k) {
+    if (__atomic_load_n(&dir[k], __ATOMIC_ACQUIRE)) continue;
+    std::uint64_t rel = __atomic_fetch_add(tail, chunk_bytes, __ATOMIC_RELAXED);
+    if (rel + chunk_bytes > GROW_SIZE) throw std::runtime_error("região de crescimento esgotada");
+    if (fallocate(ctx->fd, 0, GROW_OFFSET + rel, chunk_bytes) < 0) throw std::runtime_error("fallocate: chunk");
+    std::uint64_t expected = 0;
+    __atomic_compare_exchange_n(&dir[k], &expected, GROW_OFFSET + rel, false, __ATOMIC_RELEASE, __ATOMIC_ACQUIRE);
+  }
+}
+
+)";
+    for (auto const &fld : map_->fields)
+      if (fld.chunk_items && !compact)
+        out << "static char* slot_" << fld.name
+            << "(char* base, std::size_t i) {\n"
+               "  auto* dir = reinterpret_cast<std::uint64_t*>(base + OFFSET_"
+            << fld.name
+            << "_dir);\n"
+               "  std::uint64_t off = __atomic_load_n(&dir[i / CHUNK_ITEMS_"
+            << fld.name
+            << "], __ATOMIC_ACQUIRE);\n"
+               "  if (!off) throw std::runtime_error(\"chunk não alocado: "
+            << fld.name
+            << "\");\n"
+               "  return base + off + (i % CHUNK_ITEMS_"
+            << fld.name << ") * STRIDE_" << fld.name << ";\n}\n\n";
+  }
+
+  // Defaults: os mesmos trechos do template do engine
+  bool defaults = !map_->default_image.empty();
+  if (defaults) {
+    out << "// Valores iniciais (\"default\" do layout.json): trechos do registro\n"
+           "// copiados em buffers e instâncias novos\n"
+           "struct default_run { std::size_t offset, len; const char* bytes; };\n"
+           "static const default_run DEFAULT_RUNS[] = {\n";
+    char esc[5];
+    for (auto const &r : map_->default_image) {
+      out << "  {" << r.offset << ", " << r.bytes.size() << ", \"";
+      for (unsigned char c : r.bytes) {
+        snprintf(esc, sizeof(esc), "\\x%02x", c);
+        out << esc;
+      }
+      out << "\"},\n";
     }
-    if (fld.type == FieldType::Array) {
-      out << "constexpr std::size_t OFFSET_" << fld.name
-          << "_count = " << fld.count_offset << ";\n";
-      out << "constexpr std::size_t OFFSET_" << fld.name
-          << "_base = " << (fld.offset + 4) << ";\n";
-      out << "constexpr std::size_t STRIDE_" << fld.name << " = "
-          << fld.item_stride << ";\n";
-      for (auto const &ch : fld.children)
-        out << "constexpr std::size_t OFFSET_" << fld.name << "_" << ch.name
-            << " = " << (ch.offset + (fld.has_used_flag ? 1 : 0)) << ";\n";
+    out << "};\n\n"
+           "static void stamp_defaults(char* rec) {\n"
+           "  for (auto const& r : DEFAULT_RUNS) memcpy(rec + r.offset, r.bytes, r.len);\n"
+           "}\n\n";
+  }
+
+  // Mapeamento: valida tamanho e header em O(1) antes de expor o ponteiro
+  out << "static void* map_layout_file(const char* path, bool read_only, int "
+         "populate"
+      << (grow ? ", int* fd_out" : "") << R"() {
+  int fd = open(path, read_only ? O_RDONLY : O_RDWR);
+  if (fd < 0) throw std::runtime_error("open failed");
+  struct stat st;
+  if (fstat(fd, &st) < 0) { close(fd); throw std::runtime_error("fstat"); }
+  if ((st.st_size != 0 || read_only) && )"
+      << (grow ? "(static_cast<std::size_t>(st.st_size) < BUFFER_SIZE || "
+                 "static_cast<std::size_t>(st.st_size) > MAP_LENGTH)"
+               : "static_cast<std::size_t>(st.st_size) != BUFFER_SIZE")
+      << R"() {
+    close(fd);
+    throw std::runtime_error("buffer com tamanho incompatível com layout_ffi");
+  }
+  if (st.st_size == 0 && ftruncate(fd, BUFFER_SIZE) < 0) { close(fd); throw std::runtime_error("ftruncate"); }
+  int prot = read_only ? PROT_READ : PROT_READ | PROT_WRITE;
+  int flags = MAP_SHARED | (populate ? MAP_POPULATE : 0);
+  void* p = mmap(nullptr, )"
+      << map_len << R"(, prot, flags, fd, 0);
+  )"
+      << (grow ? "if (p != MAP_FAILED && !read_only) *fd_out = fd; else close(fd);"
+               : "close(fd);")
+      << R"(
+  if (p == MAP_FAILED) throw std::runtime_error("mmap");
+  auto* hdr = reinterpret_cast<layout_header*>(p);
+  if (hdr->magic == 0 && !read_only) {)"
+      << (!defaults ? ""
+          : pool    ? R"(
+    for (std::size_t i = 0; i < POOL_INSTANCES; ++i)
+      stamp_defaults(static_cast<char*>(p) + POOL_OFFSET + i * INSTANCE_STRIDE);)"
+                    : R"(
+    stamp_defaults(static_cast<char*>(p));)")
+      << R"(
+    hdr->version = HEADER_VERSION;
+    hdr->header_size = HEADER_SIZE;
+    hdr->fingerprint = LAYOUT_FINGERPRINT;
+    hdr->total_size = BUFFER_SIZE;)"
+      << (pool ? R"(
+    auto* pc = reinterpret_cast<pool_control*>((char*)p + POOL_CONTROL_OFFSET);
+    pc->instances = POOL_INSTANCES;
+    pc->stride = INSTANCE_STRIDE;)"
+               : "")
+      << R"(
+    hdr->magic = HEADER_MAGIC;
+  } else if (hdr->magic != HEADER_MAGIC || hdr->version != HEADER_VERSION ||
+             hdr->fingerprint != LAYOUT_FINGERPRINT ||
+             hdr->total_size != BUFFER_SIZE) {
+    munmap(p, )" << map_len << R"();)"
+      << (grow ? R"(
+    if (*fd_out >= 0) { close(*fd_out); *fd_out = -1; })" : "")
+      << R"(
+    throw std::runtime_error("layout incompatível com layout_ffi: fingerprint");
+  }
+  return p;
+}
+
+)";
+  if (pool)
+    out << R"(// Visão da instância 0: o início do arquivo (header, controle e bitmap)
+// nunca é exposto aos acessores
+static layout_ctx instance0(void* p) {
+  layout_ctx file{p, static_cast<layout_header*>(p)};
+  return layout_pool_instance(&file, 0);
+}
+
+static void attach_default(void* p) {
+  if (default_ctx.header) munmap(default_ctx.header, BUFFER_SIZE);
+  default_ctx = instance0(p);
+}
+
+extern "C" layout_ctx* layout_default_pool() { return &default_ctx; }
+
+// Primeiro bit livre do bitmap via CAS; seguro entre processos
+extern "C" long layout_pool_claim(layout_ctx* pool) {
+  char* base = reinterpret_cast<char*>(pool->header);
+  auto* bm = reinterpret_cast<std::uint64_t*>(base + POOL_BITMAP_OFFSET);
+  auto* pc = reinterpret_cast<pool_control*>(base + POOL_CONTROL_OFFSET);
+  for (std::size_t w = 0; w * 64 < POOL_INSTANCES; ++w) {
+    std::uint64_t valid = POOL_INSTANCES - w * 64 >= 64 ? ~0ULL : (1ULL << (POOL_INSTANCES - w * 64)) - 1;
+    std::uint64_t cur = __atomic_load_n(&bm[w], __ATOMIC_ACQUIRE);
+    while (~cur & valid) {
+      int bit = __builtin_ctzll(~cur & valid);
+      if (__atomic_compare_exchange_n(&bm[w], &cur, cur | (1ULL << bit), false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        std::size_t idx = w * 64 + bit;
+        __atomic_fetch_add(&pc->used, 1, __ATOMIC_RELAXED);
+        memset(base + POOL_OFFSET + idx * INSTANCE_STRIDE, 0, OFFSET_TOTAL_SIZE);)"
+        << (defaults ? R"(
+        stamp_defaults(base + POOL_OFFSET + idx * INSTANCE_STRIDE);)" : "")
+        << R"(
+        return static_cast<long>(idx);
+      }
     }
   }
-  out << "\n";
+  return -1;
+}
+
+extern "C" void layout_pool_release(layout_ctx* pool, std::size_t idx) {
+  if (idx >= POOL_INSTANCES) throw std::runtime_error("instância fora do pool");
+  char* base = reinterpret_cast<char*>(pool->header);
+  auto* bm = reinterpret_cast<std::uint64_t*>(base + POOL_BITMAP_OFFSET);
+  auto* pc = reinterpret_cast<pool_control*>(base + POOL_CONTROL_OFFSET);
+  std::uint64_t bit = 1ULL << (idx % 64);
+  if (!(__atomic_fetch_and(&bm[idx / 64], ~bit, __ATOMIC_ACQ_REL) & bit))
+    throw std::runtime_error("instância não alocada");
+  __atomic_fetch_sub(&pc->used, 1, __ATOMIC_RELAXED);
+}
+
+)";
+  else if (grow)
+    out << R"(static void attach_default(const char* path, bool read_only, int populate) {
+  int fd = -1;
+  void* p = map_layout_file(path, read_only, populate, &fd);
+  if (default_ctx.base) munmap(default_ctx.base, MAP_LENGTH);
+  if (default_ctx.fd >= 0) close(default_ctx.fd);
+  default_ctx = layout_ctx{p, static_cast<layout_header*>(p), fd};
+}
+
+)";
+  else
+    out << R"(static void attach_default(void* p) {
+  if (default_ctx.base) munmap(default_ctx.base, BUFFER_SIZE);
+  default_ctx = layout_ctx{p, static_cast<layout_header*>(p)};
+}
+
+)";
+  if (grow)
+    out << R"(extern "C" void init_layout_buffer(const char* path) {
+  attach_default(path, false, 0);
+}
+
+extern "C" void init_layout_buffer_readonly(const char* path, int populate) {
+  attach_default(path, true, populate);
+}
+
+extern "C" layout_ctx* layout_open(const char* path, int read_only, int populate) {
+  int fd = -1;
+  void* p = map_layout_file(path, read_only != 0, populate, &fd);
+  return new layout_ctx{p, static_cast<layout_header*>(p), fd};
+}
+
+extern "C" void layout_close(layout_ctx* ctx) {
+  if (!ctx) return;
+  munmap(ctx->base, MAP_LENGTH);
+  if (ctx->fd >= 0) close(ctx->fd);
+  delete ctx;
+}
+)";
+  else
+    out << R"(extern "C" void init_layout_buffer(const char* path) {
+  attach_default(map_layout_file(path, false, 0));
+}
+
+extern "C" void init_layout_buffer_readonly(const char* path, int populate) {
+  attach_default(map_layout_file(path, true, populate));
+}
+
+extern "C" layout_ctx* layout_open(const char* path, int read_only, int populate) {
+  void* p = map_layout_file(path, read_only != 0, populate);
+  )" << (pool ? "return new layout_ctx(instance0(p));"
+              : "return new layout_ctx{p, static_cast<layout_header*>(p)};")
+      << R"(
+}
+
+extern "C" void layout_close(layout_ctx* ctx) {
+  if (!ctx) return;
+  munmap(ctx->header, BUFFER_SIZE);
+  delete ctx;
+}
+)";
+  out << R"(
+extern "C" layout_ctx* layout_default_ctx() { return &default_ctx; }
+
+extern "C" int ctx_layout_superseded(layout_ctx* ctx) {
+  return (__atomic_load_n(&ctx->header->flags, __ATOMIC_ACQUIRE) & HEADER_FLAG_SUPERSEDED) != 0;
+}
+
+extern "C" int layout_superseded() { return ctx_layout_superseded(&default_ctx); }
+
+)";
+
+  // Emite ctx_<fn> com o corpo (que usa `base`) e o wrapper global sobre
+  // o contexto padrão
+  auto emit = [&](const std::string &ret, const std::string &fn,
+                  const std::string &params, const std::string &args,
+                  const std::string &body) {
+    out << ret << " ctx_" << fn << "(layout_ctx* ctx"
+        << (params.empty() ? "" : ", ") << params
+        << ") {\n  char* base = static_cast<char*>(ctx->base);\n"
+        << body << "}\n";
+    out << ret << " " << fn << "(" << params << ") { "
+        << (ret == "void" ? "" : "return ") << "ctx_" << fn << "(&default_ctx"
+        << (args.empty() ? "" : ", ") << args << "); }\n\n";
+  };
+  auto item_flag = [&](const std::string &arr) {
+    return std::to_string(
+        map_->fields[map_->field_index.at(arr)].has_used_flag ? 1 : 0);
+  };
+  // Endereço do slot `i` (flag incluída): direto ou via diretório de chunks
+  auto slot = [&](const std::string &arr, const std::string &i) {
+    if (map_->fields[map_->field_index.at(arr)].chunk_items)
+      return "slot_" + arr + "(base, " + i + ")";
+    return "base + OFFSET_" + arr + "_base + " + i + " * STRIDE_" + arr;
+  };
 
-  // Parse declarações do header
+  if (compact)
+    write_compact_cpp(out);
+
+  // Parse declarações do header (só as globais; ctx_ são derivadas). No
+  // modo compacto não há declarações por campo.
   std::vector<std::string> decls;
   std::string line;
-  while (std::getline(in, line)) {
+  while (!compact && std::getline(in, line)) {
+    if (line.find("ctx_") != std::string::npos ||
+        line.rfind("inline ", 0) == 0)
+      continue;
     if (line.find("get_") != std::string::npos ||
         line.find("set_") != std::string::npos ||
         line.find("pop_") != std::string::npos)
@@ -518,190 +2805,576 @@ void LayoutEngine::generate_ffi_cpp(const std::string &out_path) {
   // Implementa cada getter/setter/pop/get_item
   for (auto const &d : decls) {
     std::smatch m;
-    // int get_X();
-    if (std::regex_match(d, m, std::regex(R"(int get_(\w+)\(\);)"))) {
-      auto nm = m[1];
-      out << "int get_" << nm
-          << "() { return *reinterpret_cast<int*>((char*)base_ptr + OFFSET_"
-          << nm << "); }\n\n";
-    }
-    // void set_X(int value);
-    else if (std::regex_match(d, m,
-                              std::regex(R"(void set_(\w+)\(int value\);)"))) {
-      auto nm = m[1];
-      out << "void set_" << nm
-          << "(int v) { *reinterpret_cast<int*>((char*)base_ptr + OFFSET_" << nm
-          << ") = v; }\n\n";
-    }
-    // float get_X();
-    else if (std::regex_match(d, m, std::regex(R"(float get_(\w+)\(\);)"))) {
-      auto nm = m[1];
-      out << "float get_" << nm
-          << "() { return *reinterpret_cast<float*>((char*)base_ptr + OFFSET_"
-          << nm << "); }\n\n";
-    }
-    // void set_X(float value);
-    else if (std::regex_match(
-                 d, m, std::regex(R"(void set_(\w+)\(float value\);)"))) {
-      auto nm = m[1];
-      out << "void set_" << nm
-          << "(float v) { *reinterpret_cast<float*>((char*)base_ptr + OFFSET_"
-          << nm << ") = v; }\n\n";
-    }
-    // double get_X();
-    else if (std::regex_match(d, m, std::regex(R"(double get_(\w+)\(\);)"))) {
-      auto nm = m[1];
-      out << "double get_" << nm
-          << "() { return *reinterpret_cast<double*>((char*)base_ptr + OFFSET_"
-          << nm << "); }\n\n";
-    }
-    // void set_X(double value);
-    else if (std::regex_match(
-                 d, m, std::regex(R"(void set_(\w+)\(double value\);)"))) {
-      auto nm = m[1];
-      out << "void set_" << nm
-          << "(double v) { *reinterpret_cast<double*>((char*)base_ptr + OFFSET_"
-          << nm << ") = v; }\n\n";
-    }
-    // const char* get_X();
-    else if (std::regex_match(d, m,
-                              std::regex(R"(const char\* get_(\w+)\(\);)"))) {
-      auto nm = m[1];
-      out << "const char* get_" << nm
-          << "() { return reinterpret_cast<const char*>((char*)base_ptr + "
-             "OFFSET_"
-          << nm << "); }\n\n";
-    }
-    // void set_X(const char* value);
+    // std::size_t get_arr_count();
+    if (std::regex_match(
+            d, m, std::regex(R"(std::size_t\s+get_(\w+)_count\(\);)"))) {
+      std::string nm = m[1];
+      emit("std::size_t", "get_" + nm + "_count", "", "",
+           "  return *reinterpret_cast<uint32_t*>(base + OFFSET_" + nm +
+               "_count);\n");
+    }
+    // void set_arr_count(std::size_t count);
     else if (std::regex_match(
                  d, m,
-                 std::regex(R"(void set_(\w+)\(const char\* value\);)"))) {
-      auto nm = m[1];
-      out << "void set_" << nm
-          << "(const char* v) { strncpy((char*)base_ptr + OFFSET_" << nm
-          << ", v, " << nm << "_MAX_LEN); }\n\n";
+                 std::regex(R"(void\s+set_(\w+)_count\(std::size_t count\);)"))) {
+      std::string nm = m[1];
+      auto const &af = map_->fields[map_->field_index.at(nm)];
+      std::string body = "  if (c > MAX_ITEMS_" + nm +
+                         ") throw std::runtime_error(\"array cheio\");\n";
+      if (af.chunk_items)
+        body += "  grow_chunks(ctx, OFFSET_" + nm + "_dir, CHUNK_ITEMS_" + nm +
+                ", CHUNK_BYTES_" + nm + ", c);\n";
+      if (st || af.has_used_flag)
+        body += "  std::size_t old = *reinterpret_cast<uint32_t*>(base + "
+                "OFFSET_" + nm + "_count);\n";
+      // flag de uso: slots que entram no contador ficam vivos, os que saem
+      // ficam livres (antes do contador, para o iterador nunca ver lixo)
+      if (af.has_used_flag)
+        body += "  if (old > MAX_ITEMS_" + nm + ") old = MAX_ITEMS_" + nm +
+                ";\n"
+                "  for (std::size_t i = old; i < c; ++i) *(" + slot(nm, "i") +
+                ") = 1;\n"
+                "  for (std::size_t i = c; i < old; ++i) *(" + slot(nm, "i") +
+                ") = 0;\n";
+      body += "  *reinterpret_cast<uint32_t*>(base + OFFSET_" + nm +
+              "_count) = static_cast<uint32_t>(c);" +
+              hook("stats_count(base, STATS_IDX_" + nm + ", old, c)") + "\n";
+      emit("void", "set_" + nm + "_count", "std::size_t c", "c", body);
     }
-    // std::size_t get_arr_count();
+    // T get_X();  (int/float/double, campo de topo ou subcampo de objeto)
     else if (std::regex_match(
-                 d, m, std::regex(R"(std::size_t get_(\w+)_count\(\);)"))) {
-      auto nm = m[1];
-      out << "std::size_t get_" << nm
-          << "_count() { return *reinterpret_cast<uint32_t*>((char*)base_ptr + "
-             "OFFSET_"
-          << nm << "_count); }\n\n";
+                 d, m, std::regex(R"((int|float|double)\s+get_(\w+)\(\);)"))) {
+      std::string tp = m[1], nm = m[2];
+      emit(tp, "get_" + nm, "", "",
+           "  return *reinterpret_cast<" + tp + "*>(base + OFFSET_" + nm +
+               ");\n");
     }
-    // void set_arr_count(std::size_t count);
+    // void set_X(T value);
     else if (std::regex_match(
                  d, m,
-                 std::regex(R"(void set_(\w+)_count\(std::size_t count\);)"))) {
-      auto nm = m[1];
-      out << "void set_" << nm
-          << "_count(std::size_t c) { "
-             "*reinterpret_cast<uint32_t*>((char*)base_ptr + OFFSET_"
-          << nm << "_count) = static_cast<uint32_t>(c); }\n\n";
-    }
-    // float get_arr_field(std::size_t index);
+                 std::regex(R"(void\s+set_(\w+)\((int|float|double) value\);)"))) {
+      std::string nm = m[1], tp = m[2];
+      emit("void", "set_" + nm, tp + " v", "v",
+           "  *reinterpret_cast<" + tp + "*>(base + OFFSET_" + nm + ") = v;" +
+               hook("stats_write(base, STATS_IDX_" + nm + ")") + "\n");
+    }
+    // std::string_view get_X();  (string/varstring/blob)
+    else if (std::regex_match(
+                 d, m, std::regex(R"(std::string_view\s+get_(\w+)\(\);)"))) {
+      std::string nm = m[1];
+      bool inl = map_->fields[map_->field_index.at(nm)].type ==
+                 FieldType::String;
+      emit("std::string_view", "get_" + nm, "", "",
+           "  return " + std::string(inl ? "str_get" : "arena_get") +
+               "(base, OFFSET_" + nm + ");\n");
+    }
+    // void set_X(const char* data, std::size_t len);
     else if (std::regex_match(
                  d, m,
                  std::regex(
-                     R"(float get_(\w+)_(\w+)\(std::size_t index\);)"))) {
-      auto arr = m[1], fld_ch = m[2];
-      out << "float get_" << arr << "_" << fld_ch
-          << "(std::size_t i) { return "
-             "*reinterpret_cast<float*>((char*)base_ptr + OFFSET_"
-          << arr << "_base + i * STRIDE_" << arr << " + OFFSET_" << arr << "_"
-          << fld_ch << "); }\n\n";
-    }
-    // void set_arr_field(std::size_t index, float value);
-    else if (
-        std::regex_match(
-            d, m,
-            std::regex(
-                R"(void set_(\w+)_(\w+)\(std::size_t index, float value\);)"))) {
-      auto arr = m[1], fld_ch = m[2];
-      out << "void set_" << arr << "_" << fld_ch
-          << "(std::size_t i, float v) { "
-             "*reinterpret_cast<float*>((char*)base_ptr + OFFSET_"
-          << arr << "_base + i * STRIDE_" << arr << " + OFFSET_" << arr << "_"
-          << fld_ch << ") = v; }\n\n";
-    }
-    // double get_arr_field(std::size_t index);
+                     R"(void\s+set_(\w+)\(const char\* data, std::size_t len\);)"))) {
+      std::string nm = m[1];
+      FieldType t = map_->fields[map_->field_index.at(nm)].type;
+      std::string call =
+          t == FieldType::String
+              ? "str_set(base, OFFSET_" + nm + ", " + nm + "_MAX_LEN, data, len);"
+              : "arena_set(base, OFFSET_" + nm + ", data, len, " +
+                    (t == FieldType::VarString ? "1" : "0") + ");";
+      emit("void", "set_" + nm, "const char* data, std::size_t len",
+           "data, len",
+           "  " + call + hook("stats_write(base, STATS_IDX_" + nm + ")") +
+               "\n");
+    }
+    // T get_arr_field(std::size_t index);
     else if (std::regex_match(
                  d, m,
                  std::regex(
-                     R"(double get_(\w+)_(\w+)\(std::size_t index\);)"))) {
-      auto arr = m[1], fld_ch = m[2];
-      out << "double get_" << arr << "_" << fld_ch
-          << "(std::size_t i) { return "
-             "*reinterpret_cast<double*>((char*)base_ptr + OFFSET_"
-          << arr << "_base + i * STRIDE_" << arr << " + OFFSET_" << arr << "_"
-          << fld_ch << "); }\n\n";
-    }
-    // void set_arr_field(std::size_t index, double value);
-    else if (
-        std::regex_match(
-            d, m,
-            std::regex(
-                R"(void set_(\w+)_(\w+)\(std::size_t index, double value\);)"))) {
-      auto arr = m[1], fld_ch = m[2];
-      out << "void set_" << arr << "_" << fld_ch
-          << "(std::size_t i, double v) { "
-             "*reinterpret_cast<double*>((char*)base_ptr + OFFSET_"
-          << arr << "_base + i * STRIDE_" << arr << " + OFFSET_" << arr << "_"
-          << fld_ch << ") = v; }\n\n";
-    }
-    // int get_arr_field(std::size_t index);
+                     R"((int|float|double)\s+get_(\w+)_(\w+)\(std::size_t index\);)"))) {
+      std::string tp = m[1], arr = m[2], ch = m[3];
+      emit(tp, "get_" + arr + "_" + ch, "std::size_t i", "i",
+           "  return *reinterpret_cast<" + tp + "*>(" + slot(arr, "i") +
+               " + OFFSET_" + arr + "_" + ch + ");\n");
+    }
+    // void set_arr_field(std::size_t index, T value);
     else if (std::regex_match(
                  d, m,
-                 std::regex(R"(int get_(\w+)_(\w+)\(std::size_t index\);)"))) {
-      auto arr = m[1], fld_ch = m[2];
-      out << "int get_" << arr << "_" << fld_ch
-          << "(std::size_t i) { return *reinterpret_cast<int*>((char*)base_ptr "
-             "+ OFFSET_"
-          << arr << "_base + i * STRIDE_" << arr << " + OFFSET_" << arr << "_"
-          << fld_ch << "); }\n\n";
-    }
-    // void set_arr_field(std::size_t index, int value);
-    else if (
-        std::regex_match(
-            d, m,
-            std::regex(
-                R"(void set_(\w+)_(\w+)\(std::size_t index, int value\);)"))) {
-      auto arr = m[1], fld_ch = m[2];
-      out << "void set_" << arr << "_" << fld_ch
-          << "(std::size_t i, int v) { *reinterpret_cast<int*>((char*)base_ptr "
-             "+ OFFSET_"
-          << arr << "_base + i * STRIDE_" << arr << " + OFFSET_" << arr << "_"
-          << fld_ch << ") = v; }\n\n";
+                 std::regex(
+                     R"(void\s+set_(\w+)_(\w+)\(std::size_t index, (int|float|double) value\);)"))) {
+      std::string arr = m[1], ch = m[2], tp = m[3];
+      emit("void", "set_" + arr + "_" + ch, "std::size_t i, " + tp + " v",
+           "i, v",
+           "  *reinterpret_cast<" + tp + "*>(" + slot(arr, "i") +
+               " + OFFSET_" + arr + "_" + ch + ") = v;" + hook("stats_write(base, STATS_IDX_" + arr + ")") +
+               "\n");
     }
     // void pop_arr(std::size_t index);
     else if (std::regex_match(
-                 d, m, std::regex(R"(void pop_(\w+)\(std::size_t index\);)"))) {
-      auto arr = m[1];
-      out << "void pop_" << arr
-          << "(std::size_t i) { *((char*)base_ptr + OFFSET_" << arr
-          << "_base + i * STRIDE_" << arr << ") = 0; }\n\n";
+                 d, m, std::regex(R"(void\s+pop_(\w+)\(std::size_t index\);)"))) {
+      std::string arr = m[1];
+      emit("void", "pop_" + arr, "std::size_t i", "i",
+           "  *(" + slot(arr, "i") + ") = 0;" +
+               hook("stats_pop(base, STATS_IDX_" + arr + ")") + "\n");
     }
     // struct get_arr_item(std::size_t index);
     else if (std::regex_match(
                  d, m,
                  std::regex(
-                     R"(struct (\w+) get_(\w+)_item\(std::size_t index\);)"))) {
-      auto st = m[1], arr = m[2];
-      out << "struct " << st << " get_" << arr << "_item(std::size_t i) {\n";
-      out << "  struct " << st << " o;\n";
-      out << "  memcpy(&o, (char*)base_ptr + OFFSET_" << arr
-          << "_base + i * STRIDE_" << arr << " + "
-          << (map_.fields[map_.field_index[arr]].has_used_flag ? 1 : 0)
-          << ", sizeof(o));\n";
-      out << "  return o;\n";
-      out << "}\n\n";
+                     R"(struct (\w+)\s+get_(\w+)_item\(std::size_t index\);)"))) {
+      std::string st_name = m[1], arr = m[2];
+      emit("struct " + st_name, "get_" + arr + "_item", "std::size_t i", "i",
+           "  struct " + st_name + " o;\n  memcpy(&o, " + slot(arr, "i") +
+               " + " + item_flag(arr) + ", sizeof(o));\n  return o;\n");
+    }
+    // void get_arr_items(std::size_t start, std::size_t count, struct*);
+    else if (std::regex_match(
+                 d, m,
+                 std::regex(
+                     R"(void\s+get_(\w+)_items\(std::size_t start, std::size_t count, struct (\w+)\* out_buffer\);)"))) {
+      std::string arr = m[1], st_name = m[2];
+      emit("void", "get_" + arr + "_items",
+           "std::size_t start, std::size_t n, struct " + st_name + "* o",
+           "start, n, o",
+           "  for (std::size_t i = 0; i < n; ++i)\n    memcpy(&o[i], " +
+               slot(arr, "(start + i)") + " + " + item_flag(arr) +
+               ", sizeof(o[i]));\n");
     }
   }
 
+  // compact_arena: move os valores vivos para o início (ordem de offset)
+  if (map_->arena_offset) {
+    std::string refs;
+    for (auto const &fld : map_->fields)
+      if (fld.type == FieldType::VarString || fld.type == FieldType::Blob)
+        refs += (compact ? "{layout::field_info(layout::FieldId::" + fld.name +
+                               ").offset, "
+                         : "{OFFSET_" + fld.name + ", ") +
+                std::string(fld.type == FieldType::VarString ? "1" : "0") +
+                "}, ";
+    emit("std::size_t", "compact_arena", "", "",
+         "  struct live_ref { std::size_t off; std::size_t nul; };\n"
+         "  live_ref all[] = {" + refs + "};\n"
+         "  std::vector<live_ref> live;\n"
+         "  for (auto const& r : all)\n"
+         "    if (*reinterpret_cast<std::uint64_t*>(base + r.off) >> 32) live.push_back(r);\n"
+         "    else *reinterpret_cast<std::uint64_t*>(base + r.off) = 0;\n"
+         "  auto pos = [&](const live_ref& r) { return *reinterpret_cast<std::uint64_t*>(base + r.off) & 0xffffffffu; };\n"
+         "  std::sort(live.begin(), live.end(), [&](const live_ref& a, const live_ref& b) { return pos(a) < pos(b); });\n"
+         "  auto* ah = reinterpret_cast<arena_header*>(base + ARENA_OFFSET);\n"
+         "  char* data = base + ARENA_DATA_OFFSET;\n"
+         "  std::uint64_t dst = ARENA_RESERVED, bytes = 0;\n"
+         "  for (auto const& r : live) {\n"
+         "    auto* ref = reinterpret_cast<std::uint64_t*>(base + r.off);\n"
+         "    std::uint64_t off = *ref & 0xffffffffu, len = *ref >> 32;\n"
+         "    if (off != dst) memmove(data + dst, data + off, len + r.nul);\n"
+         "    __atomic_store_n(ref, dst | len << 32, __ATOMIC_RELEASE);\n"
+         "    dst += len + r.nul;\n"
+         "    bytes += len;\n"
+         "  }\n"
+         "  std::uint64_t top = std::max<std::uint64_t>(__atomic_load_n(&ah->top, __ATOMIC_RELAXED), dst);\n"
+         "  memset(data + dst, 0, top - dst);\n"
+         "  __atomic_store_n(&ah->top, dst, __ATOMIC_RELEASE);\n"
+         "  __atomic_store_n(&ah->live, bytes, __ATOMIC_RELAXED);\n"
+         "  return top - dst;\n");
+  }
+
   out.close();
 }
 
+// -------------------------------
+// GENERATE FFI: MODO COMPACTO
+// -------------------------------
+// Um descritor por campo (subcampos de objeto e de array inclusive) numa
+// tabela constexpr; get<T>/set<T> inline resolvem o endereço por ela. Com
+// FieldId constante o descritor é dobrado em tempo de compilação e o acesso
+// fica igual ao de um acessor nomeado, sem uma função por campo no .cpp.
+void LayoutEngine::write_compact_header(std::ostream &out) const {
+  bool st = map_->stats_slots != 0;
+  bool grow = map_->grow_size != 0;
+  bool arena = map_->arena_offset != 0;
+  static const char *kinds[] = {"Int32",  "Int64", "Float32",
+                                "Float64", "String", "Object",
+                                "Array",  "VarString", "Blob"};
+  auto kind = [](FieldType t) {
+    return std::string("field_kind::") + kinds[static_cast<int>(t)];
+  };
+
+  // Linhas da tabela na mesma ordem dos enumeradores de FieldId
+  std::vector<std::pair<std::string, std::string>> rows;
+  for (size_t i = 0; i < map_->fields.size(); ++i) {
+    auto const &fld = map_->fields[i];
+    std::string tail = ", " + std::to_string(i) + "}";
+    switch (fld.type) {
+    case FieldType::Array: {
+      size_t arr = rows.size();
+      size_t slots = fld.chunk_items ? fld.offset + CHUNK_DIR_OFFSET
+                                     : fld.offset + 4;
+      rows.push_back({fld.name, kind(fld.type) + ", " + std::to_string(slots) +
+                                    ", " + std::to_string(fld.item_stride) +
+                                    ", NO_ARRAY, " +
+                                    std::to_string(fld.count_offset) + ", " +
+                                    std::to_string(fld.chunk_items) + ", " +
+                                    std::to_string(fld.max_items) + tail});
+      for (auto const &ch : fld.children)
+        rows.push_back(
+            {fld.name + "_" + ch.name,
+             kind(ch.type) + ", " +
+                 std::to_string(ch.offset + (fld.has_used_flag ? 1 : 0)) +
+                 ", " + std::to_string(ch.size) + ", " + std::to_string(arr) +
+                 ", 0, 0, 0" + tail});
+      break;
+    }
+    case FieldType::Object:
+      rows.push_back({fld.name, kind(fld.type) + ", " +
+                                    std::to_string(fld.offset) + ", " +
+                                    std::to_string(fld.size) +
+                                    ", NO_ARRAY, 0, 0, 0" + tail});
+      for (auto const &ch : fld.children)
+        rows.push_back({fld.name + "_" + ch.name,
+                        kind(ch.type) + ", " +
+                            std::to_string(fld.offset + ch.offset) + ", " +
+                            std::to_string(ch.size) + ", NO_ARRAY, 0, 0, 0" +
+                            tail});
+      break;
+    default:
+      rows.push_back(
+          {fld.name, kind(fld.type) + ", " + std::to_string(fld.offset) +
+                         ", " +
+                         std::to_string(fld.type == FieldType::String
+                                            ? fld.max_length
+                                            : fld.size) +
+                         ", NO_ARRAY, 0, 0, 0" + tail});
+      break;
+    }
+  }
+
+  out << "\n// Modo compacto: um descritor por campo numa tabela constexpr e\n"
+         "// acessores inline get/set<FieldId>, tudo em `namespace layout`. O\n"
+         "// tipo do valor vem do tipo do campo (field_t): um argumento de outro\n"
+         "// tipo é convertido ou não compila, nunca gravado pela metade.\n"
+         "namespace layout {\n\n"
+         "enum class FieldId : std::uint32_t {\n";
+  for (auto const &r : rows)
+    out << "  " << r.first << ",\n";
+  out << "};\n"
+         "constexpr std::size_t FIELD_COUNT = "
+      << rows.size()
+      << ";\n\n"
+         "enum class field_kind : std::uint8_t {\n"
+         "  Int32, Int64, Float32, Float64, String, Object, Array, VarString, Blob\n"
+         "};\n"
+         "constexpr std::uint32_t NO_ARRAY = 0xffffffffu;\n\n"
+         "struct field_desc {\n"
+         "  const char*   name;\n"
+         "  field_kind    kind;\n"
+         "  std::uint32_t offset;       // absoluto; subcampo de array: no slot; array: slots ou diretório\n"
+         "  std::uint32_t size;         // bytes do valor; string: max_length; array: stride do slot\n"
+         "  std::uint32_t array;        // subcampo de array: FieldId do array\n"
+         "  std::uint32_t count_offset; // array\n"
+         "  std::uint32_t chunk_items;  // array em chunks (0 = fixo)\n"
+         "  std::uint32_t max_items;    // array\n"
+         "  std::uint32_t stats;        // campo de topo (seção de estatísticas)\n"
+         "};\n\n"
+         "constexpr field_desc FIELDS[FIELD_COUNT] = {\n";
+  for (auto const &r : rows)
+    out << "  {\"" << r.first << "\", " << r.second << ",\n";
+  out << "};\n\n"
+         "constexpr const field_desc& field_info(FieldId id) {\n"
+         "  return FIELDS[static_cast<std::uint32_t>(id)];\n"
+         "}\n\n"
+         "// Tipo do valor de cada kind (objeto e array não têm valor próprio)\n"
+         "template <field_kind K> struct field_value { using type = void; };\n"
+         "template <> struct field_value<field_kind::Int32> { using type = std::int32_t; };\n"
+         "template <> struct field_value<field_kind::Int64> { using type = std::int64_t; };\n"
+         "template <> struct field_value<field_kind::Float32> { using type = float; };\n"
+         "template <> struct field_value<field_kind::Float64> { using type = double; };\n"
+         "template <> struct field_value<field_kind::String> { using type = std::string_view; };\n"
+         "template <> struct field_value<field_kind::VarString> { using type = std::string_view; };\n"
+         "template <> struct field_value<field_kind::Blob> { using type = std::string_view; };\n"
+         "template <FieldId id>\n"
+         "using field_t = typename field_value<field_info(id).kind>::type;\n\n";
+
+  // Fora de linha (layout_ffi.cpp): crescimento, arena e estatísticas
+  out << "// Fora de linha: texto (string/arena), contador de array (aloca chunks)\n";
+  if (grow)
+    out << "[[noreturn]] void layout_chunk_missing(FieldId arr);\n";
+  out << "void layout_set_text(layout_ctx* ctx, FieldId id, const char* data, "
+         "std::size_t len);\n"
+         "void ctx_set_count(layout_ctx* ctx, FieldId arr, std::size_t count);\n";
+  if (st)
+    out << "void layout_stats_write(layout_ctx* ctx, std::size_t fi);\n"
+           "void layout_stats_pop(layout_ctx* ctx, std::size_t fi);\n";
+
+  out << "\n// Slot `i` do array (flag de uso incluída)\n"
+         "inline char* layout_slot(layout_ctx* ctx, FieldId arr, std::size_t i) {\n"
+         "  field_desc const& a = field_info(arr);\n"
+         "  char* base = static_cast<char*>(ctx->base);\n";
+  if (grow)
+    out << "  if (a.chunk_items) {\n"
+           "    auto* dir = reinterpret_cast<std::uint64_t*>(base + a.offset);\n"
+           "    std::uint64_t off = __atomic_load_n(&dir[i / a.chunk_items], __ATOMIC_ACQUIRE);\n"
+           "    if (!off) layout_chunk_missing(arr);\n"
+           "    return base + off + (i % a.chunk_items) * a.size;\n"
+           "  }\n";
+  out << "  return base + a.offset + i * a.size;\n"
+         "}\n\n"
+         "inline char* layout_field_ptr(layout_ctx* ctx, FieldId id, std::size_t index) {\n"
+         "  field_desc const& f = field_info(id);\n"
+         "  if (f.array == NO_ARRAY) return static_cast<char*>(ctx->base) + f.offset;\n"
+         "  return layout_slot(ctx, static_cast<FieldId>(f.array), index) + f.offset;\n"
+         "}\n\n"
+         "// Escalar ou subcampo (de objeto, ou de array no item `index`) por\n"
+         "// valor; string/varstring/blob como std::string_view sem cópia\n"
+         "template <FieldId id>\n"
+         "inline field_t<id> ctx_get(layout_ctx* ctx, std::size_t index = 0) {\n"
+         "  using T = field_t<id>;\n"
+         "  static_assert(!std::is_void<T>::value, \"get<FieldId>: objeto/array não têm valor; use os subcampos\");\n"
+         "  if constexpr (std::is_same<T, std::string_view>::value) {\n"
+         "    char* p = static_cast<char*>(ctx->base) + field_info(id).offset;\n";
+  if (arena)
+    out << "    if constexpr (field_info(id).kind != field_kind::String) {\n"
+           "      std::uint64_t ref = __atomic_load_n(reinterpret_cast<std::uint64_t*>(p), __ATOMIC_ACQUIRE);\n"
+           "      return std::string_view(static_cast<char*>(ctx->base) + ARENA_DATA_OFFSET + (ref & 0xffffffffu), ref >> 32);\n"
+           "    } else {\n"
+           "      return std::string_view(p + 4, __atomic_load_n(reinterpret_cast<std::uint32_t*>(p), __ATOMIC_ACQUIRE));\n"
+           "    }\n";
+  else
+    out << "    return std::string_view(p + 4, __atomic_load_n(reinterpret_cast<std::uint32_t*>(p), __ATOMIC_ACQUIRE));\n";
+  out << "  } else {\n"
+         "    static_assert(sizeof(T) == field_info(id).size, \"get<FieldId>: tamanho do campo\");\n"
+         "    T v;\n"
+         "    std::memcpy(&v, layout_field_ptr(ctx, id, index), sizeof(T));\n"
+         "    return v;\n"
+         "  }\n"
+         "}\n\n"
+         "template <FieldId id>\n"
+         "inline void ctx_set(layout_ctx* ctx, field_t<id> v, std::size_t index = 0) {\n"
+         "  using T = field_t<id>;\n"
+         "  if constexpr (std::is_same<T, std::string_view>::value) {\n"
+         "    layout_set_text(ctx, id, v.data(), v.size());\n"
+         "  } else {\n"
+         "    static_assert(sizeof(T) == field_info(id).size, \"set<FieldId>: tamanho do campo\");\n"
+         "    std::memcpy(layout_field_ptr(ctx, id, index), &v, sizeof(T));\n"
+      << (st ? "    layout_stats_write(ctx, field_info(id).stats);\n" : "")
+      << "  }\n"
+         "}\n\n"
+         "inline std::size_t ctx_get_count(layout_ctx* ctx, FieldId arr) {\n"
+         "  return *reinterpret_cast<std::uint32_t*>(static_cast<char*>(ctx->base) + field_info(arr).count_offset);\n"
+         "}\n\n"
+         "inline void ctx_pop_item(layout_ctx* ctx, FieldId arr, std::size_t i) {\n"
+         "  *layout_slot(ctx, arr, i) = 0;\n"
+      << (st ? "  layout_stats_pop(ctx, field_info(arr).stats);\n" : "")
+      << "}\n\n"
+         "// Item inteiro numa struct do chamador com o layout do slot\n"
+         "template <FieldId arr, typename T>\n"
+         "inline T ctx_get_item(layout_ctx* ctx, std::size_t i) {\n"
+         "  static_assert(field_info(arr).kind == field_kind::Array, \"get_item<FieldId>: campo não é array\");\n"
+         "  static_assert(sizeof(T) + 1 == field_info(arr).size, \"get_item<FieldId, T>: T não confere com o item\");\n"
+         "  T o;\n"
+         "  std::memcpy(&o, layout_slot(ctx, arr, i) + 1, sizeof(T));\n"
+         "  return o;\n"
+         "}\n\n"
+         "// Itens vivos de um array (flag de uso != 0, índice < count): range-for\n"
+         "// sobre os índices, para usar com get<FieldId>(índice)\n"
+         "template <FieldId arr>\n"
+         "class live_iterator {\n"
+         "public:\n"
+         "  using iterator_category = std::forward_iterator_tag;\n"
+         "  using value_type        = std::size_t;\n"
+         "  using difference_type   = std::ptrdiff_t;\n"
+         "  using pointer           = const std::size_t*;\n"
+         "  using reference         = std::size_t;\n\n"
+         "  live_iterator() = default;\n"
+         "  live_iterator(layout_ctx* ctx, std::size_t n) : ctx_(ctx), n_(n) { skip(); }\n"
+         "  std::size_t operator*() const { return i_; }\n"
+         "  live_iterator& operator++() { ++i_; skip(); return *this; }\n"
+         "  live_iterator operator++(int) { live_iterator t = *this; ++*this; return t; }\n"
+         "  // fim = índice no contador lido pelo begin()\n"
+         "  bool operator==(const live_iterator& o) const {\n"
+         "    return (i_ >= n_ && o.i_ >= o.n_) || (i_ == o.i_ && i_ < n_ && o.i_ < o.n_);\n"
+         "  }\n"
+         "  bool operator!=(const live_iterator& o) const { return !(*this == o); }\n\n"
+         "private:\n"
+         "  void skip() { while (i_ < n_ && !*layout_slot(ctx_, arr, i_)) ++i_; }\n\n"
+         "  layout_ctx* ctx_ = nullptr;\n"
+         "  std::size_t i_ = 0, n_ = 0;\n"
+         "};\n\n"
+         "template <FieldId arr>\n"
+         "struct live_range {\n"
+         "  static_assert(field_info(arr).kind == field_kind::Array, \"live_items<FieldId>: campo não é array\");\n"
+         "  layout_ctx* ctx;\n"
+         "  // limitado a max_items: contador corrompido não passa do array\n"
+         "  std::size_t count() const {\n"
+         "    std::size_t n = __atomic_load_n(reinterpret_cast<std::uint32_t*>(static_cast<char*>(ctx->base) + field_info(arr).count_offset), __ATOMIC_ACQUIRE);\n"
+         "    return n < field_info(arr).max_items ? n : field_info(arr).max_items;\n"
+         "  }\n"
+         "  live_iterator<arr> begin() const { return live_iterator<arr>(ctx, count()); }\n"
+         "  live_iterator<arr> end() const { return {}; }\n"
+         "};\n\n"
+         "template <FieldId arr>\n"
+         "inline live_range<arr> ctx_live_items(layout_ctx* ctx) { return {ctx}; }\n\n"
+         "// Mesmos acessores sobre layout_default_ctx()\n"
+         "template <FieldId id>\n"
+         "inline field_t<id> get(std::size_t index = 0) { return ctx_get<id>(layout_default_ctx(), index); }\n"
+         "template <FieldId id>\n"
+         "inline void set(field_t<id> v, std::size_t index = 0) { ctx_set<id>(layout_default_ctx(), v, index); }\n"
+         "inline std::size_t get_count(FieldId arr) { return ctx_get_count(layout_default_ctx(), arr); }\n"
+         "inline void set_count(FieldId arr, std::size_t count) { ctx_set_count(layout_default_ctx(), arr, count); }\n"
+         "inline void pop_item(FieldId arr, std::size_t i) { ctx_pop_item(layout_default_ctx(), arr, i); }\n"
+         "template <FieldId arr, typename T>\n"
+         "inline T get_item(std::size_t i) { return ctx_get_item<arr, T>(layout_default_ctx(), i); }\n"
+         "template <FieldId arr>\n"
+         "inline live_range<arr> live_items() { return {layout_default_ctx()}; }\n\n"
+         "} // namespace layout\n";
+
+  if (!codegen_opts_.named_wrappers)
+    return;
+
+  // Wrappers nomeados opcionais: a mesma API do modo padrão, inline
+  auto wrap = [&](const std::string &ret, const std::string &fn,
+                  const std::string &params, const std::string &args,
+                  const std::string &call) {
+    std::string r = ret == "void" ? "" : "return ";
+    out << "inline " << ret << " ctx_" << fn << "(layout_ctx* ctx"
+        << (params.empty() ? "" : ", ") << params << ") { " << r << call
+        << "; }\n"
+        << "inline " << ret << " " << fn << "(" << params << ") { " << r
+        << "ctx_" << fn << "(layout_default_ctx()"
+        << (args.empty() ? "" : ", ") << args << "); }\n";
+  };
+  auto scalar_type = [](FieldType t) -> std::string {
+    return t == FieldType::Int32     ? "int"
+           : t == FieldType::Int64   ? "std::int64_t"
+           : t == FieldType::Float32 ? "float"
+                                     : "double";
+  };
+  auto scalar = [&](const std::string &nm, FieldType t) {
+    std::string tp = scalar_type(t), id = "layout::FieldId::" + nm;
+    wrap(tp, "get_" + nm, "", "", "layout::ctx_get<" + id + ">(ctx)");
+    wrap("void", "set_" + nm, tp + " v", "v",
+         "layout::ctx_set<" + id + ">(ctx, v)");
+  };
+  out << "\n// Wrappers nomeados (mesmos nomes do modo padrão)\n";
+  for (auto const &fld : map_->fields) {
+    std::string id = "layout::FieldId::" + fld.name;
+    switch (fld.type) {
+    case FieldType::Int32:
+    case FieldType::Int64:
+    case FieldType::Float32:
+    case FieldType::Float64:
+      scalar(fld.name, fld.type);
+      break;
+    case FieldType::Object:
+      for (auto const &ch : fld.children)
+        scalar(fld.name + "_" + ch.name, ch.type);
+      break;
+    case FieldType::String:
+    case FieldType::VarString:
+    case FieldType::Blob:
+      wrap("std::string_view", "get_" + fld.name, "", "",
+           "layout::ctx_get<" + id + ">(ctx)");
+      wrap("void", "set_" + fld.name, "const char* data, std::size_t len",
+           "data, len",
+           "layout::layout_set_text(ctx, " + id + ", data, len)");
+      break;
+    case FieldType::Array: {
+      std::string a = fld.name, item = "struct " + a;
+      wrap("std::size_t", "get_" + a + "_count", "", "",
+           "layout::ctx_get_count(ctx, " + id + ")");
+      wrap("void", "set_" + a + "_count", "std::size_t c", "c",
+           "layout::ctx_set_count(ctx, " + id + ", c)");
+      for (auto const &ch : fld.children) {
+        std::string nm = a + "_" + ch.name, tp = scalar_type(ch.type);
+        wrap(tp, "get_" + nm, "std::size_t i", "i",
+             "layout::ctx_get<layout::FieldId::" + nm + ">(ctx, i)");
+        wrap("void", "set_" + nm, "std::size_t i, " + tp + " v", "i, v",
+             "layout::ctx_set<layout::FieldId::" + nm + ">(ctx, v, i)");
+      }
+      wrap("void", "pop_" + a, "std::size_t i", "i",
+           "layout::ctx_pop_item(ctx, " + id + ", i)");
+      wrap(item, "get_" + a + "_item", "std::size_t i", "i",
+           "layout::ctx_get_item<" + id + ", " + item + ">(ctx, i)");
+      out << "inline void ctx_get_" << a
+          << "_items(layout_ctx* ctx, std::size_t start, std::size_t n, "
+          << item
+          << "* o) {\n"
+             "  for (std::size_t i = 0; i < n; ++i) o[i] = layout::ctx_get_item<"
+          << id << ", " << item
+          << ">(ctx, start + i);\n"
+             "}\n"
+             "inline void get_"
+          << a << "_items(std::size_t start, std::size_t n, " << item
+          << "* o) { ctx_get_" << a
+          << "_items(layout_default_ctx(), start, n, o); }\n";
+      break;
+    }
+    default:
+      break;
+    }
+  }
+}
+
+void LayoutEngine::write_compact_cpp(std::ostream &out) const {
+  bool st = map_->stats_slots != 0;
+  bool grow = map_->grow_size != 0;
+  bool has_str = false;
+  for (auto const &fld : map_->fields)
+    has_str |= fld.type == FieldType::String;
+
+  out << "namespace layout {\n\n";
+  if (grow)
+    out << R"(void layout_chunk_missing(FieldId arr) {
+  throw std::runtime_error(std::string("chunk não alocado: ") + field_info(arr).name);
+}
+
+)";
+  bool text = has_str || map_->arena_offset;
+  out << "void layout_set_text(layout_ctx* ctx, FieldId id, const char* data, "
+         "std::size_t len) {\n";
+  if (text || st)
+    out << "  char* base = static_cast<char*>(ctx->base);\n";
+  if (!text)
+    out << "  (void)ctx; (void)data; (void)len; // layout sem campos de texto\n";
+  out << R"(  field_desc const& f = field_info(id);
+  switch (f.kind) {
+)";
+  if (has_str)
+    out << "  case field_kind::String: str_set(base, f.offset, f.size, data, "
+           "len); break;\n";
+  if (map_->arena_offset)
+    out << "  case field_kind::VarString:\n"
+           "  case field_kind::Blob: arena_set(base, f.offset, data, len, f.kind "
+           "== field_kind::VarString); break;\n";
+  out << R"(  default: throw std::runtime_error(std::string("campo não é texto: ") + f.name);
+  }
+)" << (st ? "  stats_write(base, f.stats);\n" : "")
+      << R"(}
+
+void ctx_set_count(layout_ctx* ctx, FieldId arr, std::size_t c) {
+  char* base = static_cast<char*>(ctx->base);
+  field_desc const& a = field_info(arr);
+  if (a.kind != field_kind::Array) throw std::runtime_error(std::string("campo não é array: ") + a.name);
+)";
+  out << "  if (c > a.max_items) throw std::runtime_error(\"array cheio\");\n";
+  if (grow)
+    out << R"(  if (a.chunk_items)
+    grow_chunks(ctx, a.offset, a.chunk_items, (a.chunk_items * a.size + 4095) & ~std::size_t(4095), c);
+)";
+  auto *cnt = "reinterpret_cast<std::uint32_t*>(base + a.count_offset)";
+  // flag de uso: [old, c) ficam vivos, [c, old) livres, antes do contador
+  out << "  std::size_t old = *" << cnt << ";\n"
+         "  if (old > a.max_items) old = a.max_items;\n"
+         "  for (std::size_t i = old; i < c; ++i) *layout_slot(ctx, arr, i) = 1;\n"
+         "  for (std::size_t i = c; i < old; ++i) *layout_slot(ctx, arr, i) = 0;\n"
+         "  *" << cnt << " = static_cast<std::uint32_t>(c);\n"
+      << (st ? "  stats_count(base, a.stats, old, c);\n" : "") << "}\n\n";
+  if (st)
+    out << R"(void layout_stats_write(layout_ctx* ctx, std::size_t fi) { stats_write(static_cast<char*>(ctx->base), fi); }
+void layout_stats_pop(layout_ctx* ctx, std::size_t fi) { stats_pop(static_cast<char*>(ctx->base), fi); }
+
+)";
+  out << "} // namespace layout\n\n";
+}
+
 void LayoutEngine::validate_and_format(const std::string &header_path,
                                        const std::string &cpp_path) {
   // 1) verifica se os arquivos existem
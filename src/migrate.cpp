@@ -0,0 +1,238 @@
+#include "migrate.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+#include <cstdio>
+#include <sys/mman.h>
+
+static const char *type_name(FieldType t) {
+  switch (t) {
+  case FieldType::Int32:
+    return "int32";
+  case FieldType::Int64:
+    return "int64";
+  case FieldType::Float32:
+    return "float32";
+  case FieldType::Float64:
+    return "float64";
+  case FieldType::String:
+    return "string";
+  case FieldType::Object:
+    return "object";
+  case FieldType::Array:
+    return "object[]";
+  case FieldType::VarString:
+    return "varstring";
+  case FieldType::Blob:
+    return "blob";
+  }
+  return "?";
+}
+
+// -------------------------------
+// PLAN
+// -------------------------------
+// Passo para um campo escalar/string; src/dst relativos ao bloco
+static CopyStep scalar_step(const std::string &path, const FieldLayout &from,
+                            const FieldLayout &to, size_t src, size_t dst) {
+  CopyStep st;
+  st.src_offset = src;
+  st.dst_offset = dst;
+  st.len = from.size;
+  if (from.type == to.type) {
+    if (from.type == FieldType::String && to.size < from.size)
+      throw std::runtime_error("migração insegura: string " + path +
+                               " encolheria de " + std::to_string(from.size) +
+                               " para " + std::to_string(to.size));
+    return st;
+  }
+  if (from.type == FieldType::Int32 && to.type == FieldType::Int64)
+    st.conv = CopyConv::Int32ToInt64;
+  else if (from.type == FieldType::Float32 && to.type == FieldType::Float64)
+    st.conv = CopyConv::Float32ToFloat64;
+  else if (from.type == FieldType::Int32 && to.type == FieldType::Float64)
+    st.conv = CopyConv::Int32ToFloat64;
+  else
+    throw std::runtime_error(std::string("migração insegura: ") + path + " " +
+                             type_name(from.type) + " -> " +
+                             type_name(to.type));
+  return st;
+}
+
+// Casa os filhos de um object/object[] por nome
+static void plan_children(const std::string &path, const FieldLayout &from,
+                          const FieldLayout &to, size_t src_base,
+                          size_t dst_base, std::vector<CopyStep> &steps,
+                          MigrationPlan &plan) {
+  for (auto const &ch : to.children) {
+    auto it = from.field_index.find(ch.name);
+    if (it == from.field_index.end()) {
+      plan.added.push_back(path + "." + ch.name);
+      continue;
+    }
+    auto const &old = from.children[it->second];
+    steps.push_back(scalar_step(path + "." + ch.name, old, ch,
+                                src_base + old.offset, dst_base + ch.offset));
+  }
+  for (auto const &ch : from.children)
+    if (!to.field_index.count(ch.name))
+      plan.dropped.push_back(path + "." + ch.name);
+}
+
+MigrationPlan plan_migration(const LayoutMap &from, const LayoutMap &to) {
+  MigrationPlan plan;
+  for (auto const &fld : to.fields) {
+    auto it = from.field_index.find(fld.name);
+    if (it == from.field_index.end()) {
+      plan.added.push_back(fld.name);
+      continue;
+    }
+    auto const &old = from.fields[it->second];
+    if ((old.type == FieldType::Object || old.type == FieldType::Array ||
+         fld.type == FieldType::Object || fld.type == FieldType::Array) &&
+        old.type != fld.type)
+      throw std::runtime_error(std::string("migração insegura: ") + fld.name +
+                               " " + type_name(old.type) + " -> " +
+                               type_name(fld.type));
+
+    CopyBlock blk;
+    blk.field = fld.name;
+    if (fld.type == FieldType::Object) {
+      plan_children(fld.name, old, fld, old.offset, fld.offset, blk.steps,
+                    plan);
+    } else if (fld.type == FieldType::Array) {
+      size_t src_flag = old.has_used_flag ? 1 : 0;
+      size_t dst_flag = fld.has_used_flag ? 1 : 0;
+      blk.repeat = std::min(old.max_items, fld.max_items);
+      blk.src_stride = old.item_stride;
+      blk.dst_stride = fld.item_stride;
+      blk.has_count = true;
+      blk.src_count_offset = old.count_offset;
+      blk.dst_count_offset = fld.count_offset;
+      blk.dst_max_items = fld.max_items;
+      size_t src_base = old.offset + 4, dst_base = fld.offset + 4;
+      if (src_flag && dst_flag)
+        blk.steps.push_back({CopyConv::Raw, src_base, dst_base, 1});
+      plan_children(fld.name, old, fld, src_base + src_flag,
+                    dst_base + dst_flag, blk.steps, plan);
+    } else {
+      blk.steps.push_back(
+          scalar_step(fld.name, old, fld, old.offset, fld.offset));
+    }
+    std::sort(blk.steps.begin(), blk.steps.end(),
+              [](const CopyStep &a, const CopyStep &b) {
+                return a.src_offset < b.src_offset;
+              });
+    if (!blk.steps.empty() || blk.has_count)
+      plan.blocks.push_back(std::move(blk));
+  }
+  for (auto const &fld : from.fields)
+    if (!to.field_index.count(fld.name))
+      plan.dropped.push_back(fld.name);
+
+  // Leitura sequencial da origem
+  std::sort(plan.blocks.begin(), plan.blocks.end(),
+            [](const CopyBlock &a, const CopyBlock &b) {
+              size_t sa = a.has_count ? a.src_count_offset
+                                      : a.steps.front().src_offset;
+              size_t sb = b.has_count ? b.src_count_offset
+                                      : b.steps.front().src_offset;
+              return sa < sb;
+            });
+  return plan;
+}
+
+// -------------------------------
+// APPLY
+// -------------------------------
+static void apply_step(const CopyStep &st, const char *src, char *dst) {
+  switch (st.conv) {
+  case CopyConv::Raw:
+    memcpy(dst + st.dst_offset, src + st.src_offset, st.len);
+    break;
+  case CopyConv::Int32ToInt64: {
+    int32_t v;
+    memcpy(&v, src + st.src_offset, sizeof(v));
+    int64_t w = v;
+    memcpy(dst + st.dst_offset, &w, sizeof(w));
+    break;
+  }
+  case CopyConv::Float32ToFloat64: {
+    float v;
+    memcpy(&v, src + st.src_offset, sizeof(v));
+    double w = v;
+    memcpy(dst + st.dst_offset, &w, sizeof(w));
+    break;
+  }
+  case CopyConv::Int32ToFloat64: {
+    int32_t v;
+    memcpy(&v, src + st.src_offset, sizeof(v));
+    double w = v;
+    memcpy(dst + st.dst_offset, &w, sizeof(w));
+    break;
+  }
+  }
+}
+
+void apply_migration(const MigrationPlan &plan, const void *src_ptr,
+                     void *dst_ptr) {
+  auto src = static_cast<const char *>(src_ptr);
+  auto dst = static_cast<char *>(dst_ptr);
+  for (auto const &blk : plan.blocks) {
+    size_t repeat = blk.repeat;
+    if (blk.has_count) {
+      uint32_t cnt;
+      memcpy(&cnt, src + blk.src_count_offset, sizeof(cnt));
+      if (cnt > blk.dst_max_items)
+        throw std::runtime_error("migração perderia itens de " + blk.field +
+                                 ": " + std::to_string(cnt) + " > max_items " +
+                                 std::to_string(blk.dst_max_items));
+      memcpy(dst + blk.dst_count_offset, &cnt, sizeof(cnt));
+      repeat = cnt; // slots além do contador nunca foram escritos
+    }
+    for (size_t i = 0; i < repeat; ++i) {
+      const char *s = src + i * blk.src_stride;
+      char *d = dst + i * blk.dst_stride;
+      for (auto const &st : blk.steps)
+        apply_step(st, s, d);
+    }
+  }
+}
+
+// -------------------------------
+// MIGRATE BACKING FILE
+// -------------------------------
+MigrationPlan migrate_backing_file(LayoutEngine &from, LayoutEngine &to,
+                                   const std::string &backing_path) {
+  if (from.get_layout().pool_instances || to.get_layout().pool_instances)
+    throw std::runtime_error("migrate não suporta layouts com pool");
+  // referências apontam para a arena do buffer antigo
+  if (from.get_layout().arena_offset || to.get_layout().arena_offset)
+    throw std::runtime_error("migrate não suporta campos varstring/blob");
+  // itens ficam nos chunks, fora do buffer base copiado pelo plano
+  if (from.get_layout().grow_size || to.get_layout().grow_size)
+    throw std::runtime_error("migrate não suporta arrays com chunk_items");
+  auto plan = plan_migration(from.get_layout(), to.get_layout());
+
+  // Valida o header do buffer vivo contra o layout antigo. Sem O_CREAT:
+  // um caminho inexistente ou sem header não vira um buffer novo migrado
+  MapOptions live;
+  live.attach_existing = true;
+  from.allocate_memory_from_file(backing_path, live);
+
+  std::string tmp = backing_path + ".migrate";
+  std::remove(tmp.c_str());
+  to.allocate_memory_from_file(tmp);
+  apply_migration(plan, from.mmap_base(), to.mmap_base());
+  if (msync(to.mmap_base(), to.mmap_size(), MS_SYNC) < 0)
+    throw std::runtime_error("msync(migrate)");
+
+  // Troca atômica: novos attaches já enxergam o buffer novo
+  if (std::rename(tmp.c_str(), backing_path.c_str()) < 0)
+    throw std::runtime_error("rename(migrate) failed: " + backing_path);
+  from.mark_superseded();
+  return plan;
+}
@@ -0,0 +1,192 @@
+#include "numa.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// Constantes de <linux/mempolicy.h>
+constexpr int MPOL_DEFAULT_ = 0;
+constexpr int MPOL_PREFERRED_ = 1;
+constexpr int MPOL_BIND_ = 2;
+constexpr int MPOL_INTERLEAVE_ = 3;
+constexpr unsigned MPOL_MF_MOVE_ = 1u << 1;
+
+static int policy_mode(NumaPolicy policy) {
+  return policy == NumaPolicy::Bind        ? MPOL_BIND_
+         : policy == NumaPolicy::Preferred ? MPOL_PREFERRED_
+                                           : MPOL_INTERLEAVE_;
+}
+
+// Máscara no formato do kernel; Preferred usa só o primeiro nó
+static unsigned long policy_mask(NumaPolicy policy, uint64_t node_mask) {
+  if (!node_mask)
+    throw std::runtime_error("política NUMA sem nós na máscara");
+  unsigned long mask = node_mask;
+  if (policy == NumaPolicy::Preferred)
+    mask &= -mask;
+  return mask;
+}
+
+static size_t page_size() {
+  static const size_t ps = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  return ps;
+}
+
+void numa_apply(void *addr, size_t len, NumaPolicy policy, uint64_t node_mask) {
+  if (policy == NumaPolicy::Default)
+    return;
+  unsigned long mask = policy_mask(policy, node_mask);
+  size_t ps = page_size();
+  uintptr_t start = (reinterpret_cast<uintptr_t>(addr) + ps - 1) & ~(ps - 1);
+  uintptr_t end = (reinterpret_cast<uintptr_t>(addr) + len) & ~(ps - 1);
+  if (end <= start)
+    return;
+
+  // maxnode conta um bit a mais (mesma convenção da libnuma)
+  if (syscall(SYS_mbind, start, end - start, policy_mode(policy), &mask,
+              sizeof(mask) * 8 + 1, MPOL_MF_MOVE_) < 0)
+    throw std::runtime_error("mbind falhou (nó inexistente?)");
+}
+
+NumaThreadPolicy::NumaThreadPolicy(NumaPolicy policy, uint64_t node_mask) {
+  if (policy == NumaPolicy::Default)
+    return;
+  unsigned long mask = policy_mask(policy, node_mask);
+  if (syscall(SYS_set_mempolicy, policy_mode(policy), &mask,
+              sizeof(mask) * 8 + 1) < 0)
+    throw std::runtime_error("set_mempolicy falhou (nó inexistente?)");
+  active_ = true;
+}
+
+NumaThreadPolicy::~NumaThreadPolicy() {
+  if (active_)
+    syscall(SYS_set_mempolicy, MPOL_DEFAULT_, nullptr, 0);
+}
+
+std::vector<int> numa_node_cpus(int node) {
+  std::ifstream in("/sys/devices/system/node/node" + std::to_string(node) +
+                   "/cpulist");
+  if (!in)
+    throw std::runtime_error("nó NUMA inexistente: " + std::to_string(node));
+  // formato "0-3,8-11"
+  std::vector<int> cpus;
+  std::string range;
+  while (std::getline(in, range, ',')) {
+    if (range.empty() || range == "\n")
+      continue;
+    size_t dash = range.find('-');
+    int lo = std::stoi(range.substr(0, dash));
+    int hi = dash == std::string::npos ? lo : std::stoi(range.substr(dash + 1));
+    for (int c = lo; c <= hi; ++c)
+      cpus.push_back(c);
+  }
+  return cpus;
+}
+
+static void pin_to_cpus(const std::vector<int> &cpus) {
+  if (cpus.empty())
+    return;
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (int c : cpus)
+    CPU_SET(c, &set);
+  pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+static void touch_pages(char *p, size_t len, bool writable) {
+  size_t ps = page_size();
+  for (size_t off = 0; off < len; off += ps) {
+    if (writable)
+      __atomic_fetch_add(p + off, 0, __ATOMIC_RELAXED);
+    else
+      (void)*static_cast<volatile char *>(p + off);
+  }
+}
+
+void numa_prefault(void *addr, size_t len, int node, bool writable) {
+  std::vector<int> cpus;
+  if (node >= 0)
+    cpus = numa_node_cpus(node);
+  std::thread t([&] {
+    pin_to_cpus(cpus);
+    touch_pages(static_cast<char *>(addr), len, writable);
+  });
+  t.join();
+}
+
+unsigned prefault_parallel(void *addr, size_t len, unsigned threads,
+                           uint64_t node_mask, bool writable, bool zero) {
+  size_t ps = page_size();
+  size_t pages = (len + ps - 1) / ps;
+  if (pages == 0)
+    return 0;
+  if (threads == 0)
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  threads = static_cast<unsigned>(std::min<size_t>(threads, pages));
+
+  // Nós da máscara, em ordem; worker i vai para nodes[i % n]
+  std::vector<std::vector<int>> node_cpus;
+  for (int n = 0; n < 64; ++n)
+    if (node_mask >> n & 1)
+      node_cpus.push_back(numa_node_cpus(n));
+
+  size_t per = (pages + threads - 1) / threads * ps;
+  char *base = static_cast<char *>(addr);
+  std::vector<std::thread> pool;
+  for (unsigned i = 0; i < threads; ++i) {
+    size_t from = i * per;
+    if (from >= len)
+      break;
+    size_t n = std::min(per, len - from);
+    pool.emplace_back([&, i, from, n] {
+      if (!node_cpus.empty())
+        pin_to_cpus(node_cpus[i % node_cpus.size()]);
+      if (zero)
+        memset(base + from, 0, n);
+      else
+        touch_pages(base + from, n, writable);
+    });
+  }
+  for (auto &t : pool)
+    t.join();
+  return static_cast<unsigned>(pool.size());
+}
+
+NumaPlacement numa_placement(const void *addr, size_t len) {
+  NumaPlacement out;
+  size_t ps = page_size();
+  uintptr_t start = reinterpret_cast<uintptr_t>(addr) & ~(ps - 1);
+  size_t pages = (reinterpret_cast<uintptr_t>(addr) + len - start + ps - 1) / ps;
+
+  // move_pages com nodes == nullptr só consulta o nó de cada página
+  constexpr size_t batch = 4096;
+  std::vector<void *> ptrs(batch);
+  std::vector<int> status(batch);
+  for (size_t first = 0; first < pages; first += batch) {
+    size_t n = std::min(batch, pages - first);
+    for (size_t i = 0; i < n; ++i)
+      ptrs[i] = reinterpret_cast<void *>(start + (first + i) * ps);
+    if (syscall(SYS_move_pages, 0, n, ptrs.data(), nullptr, status.data(),
+                0) < 0)
+      throw std::runtime_error("move_pages falhou");
+    for (size_t i = 0; i < n; ++i) {
+      if (status[i] < 0) {
+        ++out.not_present;
+        continue;
+      }
+      size_t node = static_cast<size_t>(status[i]);
+      if (out.pages_per_node.size() <= node)
+        out.pages_per_node.resize(node + 1);
+      ++out.pages_per_node[node];
+    }
+  }
+  return out;
+}
@@ -0,0 +1,140 @@
+#include "parallel.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+static uint64_t pack(uint64_t lo, uint64_t hi) { return lo << 32 | hi; }
+
+WorkStealingPool::WorkStealingPool(unsigned threads) {
+  if (threads == 0)
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  n_ = threads;
+  queues_.reset(new Queue[n_]);
+  for (unsigned i = 1; i < n_; ++i)
+    workers_.emplace_back([this, i] { loop(i); });
+}
+
+WorkStealingPool::~WorkStealingPool() {
+  {
+    std::lock_guard<std::mutex> lk(m_);
+    stop_ = true;
+  }
+  start_cv_.notify_all();
+  for (auto &t : workers_)
+    t.join();
+}
+
+unsigned WorkStealingPool::threads() const { return n_; }
+
+uint64_t WorkStealingPool::steals() const {
+  return steals_.load(std::memory_order_relaxed);
+}
+
+// Workers auxiliares: esperam uma nova rodada, trabalham e avisam o fim
+void WorkStealingPool::loop(unsigned self) {
+  uint64_t seen = 0;
+  for (;;) {
+    {
+      std::unique_lock<std::mutex> lk(m_);
+      start_cv_.wait(lk, [&] { return stop_ || generation_ != seen; });
+      if (stop_)
+        return;
+      seen = generation_;
+    }
+    work(self);
+    std::lock_guard<std::mutex> lk(m_);
+    if (--running_ == 0)
+      done_cv_.notify_one();
+  }
+}
+
+void WorkStealingPool::run(size_t tasks,
+                           const std::function<void(size_t)> &fn) {
+  if (tasks == 0)
+    return;
+  if (tasks > UINT32_MAX)
+    throw std::runtime_error("tarefas demais para o pool");
+  if (n_ == 1 || tasks == 1) {
+    for (size_t t = 0; t < tasks; ++t)
+      fn(t);
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lk(m_);
+    // faixas contíguas: cada worker começa por slots vizinhos
+    for (unsigned w = 0; w < n_; ++w)
+      queues_[w].range.store(pack(tasks * w / n_, tasks * (w + 1) / n_),
+                             std::memory_order_relaxed);
+    fn_ = &fn;
+    error_ = nullptr;
+    failed_.store(false, std::memory_order_relaxed);
+    running_ = n_ - 1;
+    ++generation_;
+  }
+  start_cv_.notify_all();
+  work(0);
+  std::unique_lock<std::mutex> lk(m_);
+  done_cv_.wait(lk, [&] { return running_ == 0; });
+  fn_ = nullptr;
+  if (error_)
+    std::rethrow_exception(error_);
+}
+
+void WorkStealingPool::work(unsigned self) {
+  size_t task;
+  for (;;) {
+    while (take(self, task)) {
+      if (failed_.load(std::memory_order_relaxed))
+        continue; // só drena
+      try {
+        (*fn_)(task);
+      } catch (...) {
+        std::lock_guard<std::mutex> lk(m_);
+        if (!error_)
+          error_ = std::current_exception();
+        failed_.store(true, std::memory_order_relaxed);
+      }
+    }
+    if (!steal(self))
+      return;
+  }
+}
+
+// Dono consome pelo início da faixa
+bool WorkStealingPool::take(unsigned self, size_t &task) {
+  auto &q = queues_[self].range;
+  uint64_t r = q.load(std::memory_order_acquire);
+  for (;;) {
+    uint64_t lo = r >> 32, hi = r & 0xffffffffu;
+    if (lo >= hi)
+      return false;
+    if (q.compare_exchange_weak(r, pack(lo + 1, hi), std::memory_order_acq_rel,
+                                std::memory_order_acquire)) {
+      task = lo;
+      return true;
+    }
+  }
+}
+
+// Rouba a metade de cima da primeira faixa não vazia (a partir do vizinho) e
+// a instala na própria fila; false quando todas estão vazias. Tarefas em
+// execução noutros workers não impedem o fim: quem as pegou as termina.
+bool WorkStealingPool::steal(unsigned self) {
+  for (unsigned k = 1; k < n_; ++k) {
+    auto &q = queues_[(self + k) % n_].range;
+    uint64_t r = q.load(std::memory_order_acquire);
+    for (;;) {
+      uint64_t lo = r >> 32, hi = r & 0xffffffffu;
+      if (lo >= hi)
+        break;
+      uint64_t mid = lo + (hi - lo) / 2;
+      if (q.compare_exchange_weak(r, pack(lo, mid), std::memory_order_acq_rel,
+                                  std::memory_order_acquire)) {
+        queues_[self].range.store(pack(mid, hi), std::memory_order_release);
+        steals_.fetch_add(1, std::memory_order_relaxed);
+        return true;
+      }
+    }
+  }
+  return false;
+}
@@ -0,0 +1,408 @@
+#include "replication.hpp"
+#include "layout_engine.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+static uint64_t now_ns() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+static size_t align8(size_t n) { return (n + 7) & ~size_t(7); }
+
+ReplLag repl_lag(const ReplRingHeader &hdr) {
+  ReplLag l;
+  uint64_t head = __atomic_load_n(&hdr.head, __ATOMIC_ACQUIRE);
+  uint64_t seq = __atomic_load_n(&hdr.seq, __ATOMIC_RELAXED);
+  uint64_t pub = __atomic_load_n(&hdr.publish_ns, __ATOMIC_RELAXED);
+  uint64_t applied = __atomic_load_n(&hdr.applied, __ATOMIC_ACQUIRE);
+  uint64_t aseq = __atomic_load_n(&hdr.applied_seq, __ATOMIC_RELAXED);
+  uint64_t ans = __atomic_load_n(&hdr.applied_ns, __ATOMIC_RELAXED);
+  l.bytes = head > applied ? head - applied : 0;
+  l.batches = seq > aseq ? seq - aseq : 0;
+  l.ns = l.batches && pub > ans ? pub - ans : 0;
+  l.resyncs = __atomic_load_n(&hdr.resyncs, __ATOMIC_RELAXED);
+  return l;
+}
+
+// -------------------------------
+// ESCRITOR
+// -------------------------------
+ReplicationLog::~ReplicationLog() {
+  try {
+    close();
+  } catch (...) {
+  }
+}
+
+void ReplicationLog::open(const std::string &ring_path, uint64_t fingerprint,
+                          size_t image_size, const ReplOptions &opts) {
+  close();
+  size_t cap = 4096;
+  while (cap < opts.ring_bytes)
+    cap <<= 1;
+  if (opts.batch_bytes * 4 > cap)
+    throw std::runtime_error("replicação: ring_bytes deve ser >= 4 * batch_bytes");
+
+  // Recriado a cada open, mas o arquivo só cresce: um seguidor ainda
+  // mapeado no tamanho antigo continua lendo memória válida até remapear
+  int fd = ::open(ring_path.c_str(), O_RDWR | O_CREAT, 0600);
+  if (fd < 0)
+    throw std::runtime_error("open(ring) failed: " + ring_path);
+  off_t cur = lseek(fd, 0, SEEK_END);
+  size_t len = std::max(static_cast<size_t>(cur < 0 ? 0 : cur),
+                        REPL_RING_HEADER_SIZE + cap);
+  if (static_cast<size_t>(cur) < len &&
+      ftruncate(fd, static_cast<off_t>(len)) < 0) {
+    ::close(fd);
+    throw std::runtime_error("ftruncate(ring) failed: " + ring_path);
+  }
+  void *p = mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (p == MAP_FAILED)
+    throw std::runtime_error("mmap(ring) failed: " + ring_path);
+
+  hdr_ = static_cast<ReplRingHeader *>(p);
+  data_ = static_cast<char *>(p) + REPL_RING_HEADER_SIZE;
+  capacity_ = cap;
+  map_len_ = len;
+  // magic zerado primeiro: seguidores recusam o ring até o fim da recriação
+  uint64_t gen = hdr_->generation + 1;
+  __atomic_store_n(&hdr_->magic, 0, __ATOMIC_RELEASE);
+  memset(static_cast<void *>(hdr_), 0, sizeof(ReplRingHeader));
+  __atomic_store_n(&hdr_->generation, gen, __ATOMIC_RELEASE);
+  hdr_->version = REPL_RING_VERSION;
+  hdr_->capacity = cap;
+  hdr_->fingerprint = fingerprint;
+  hdr_->image_size = image_size;
+  // magic por último: seguidor que abre antes disso recusa o ring
+  __atomic_store_n(&hdr_->magic, REPL_RING_MAGIC, __ATOMIC_RELEASE);
+
+  opts_ = opts;
+  pending_.reserve(opts_.batch_bytes * 2);
+  head_ = seq_ = 0;
+  stop_ = false;
+  if (opts_.flush_interval_ms > 0)
+    flusher_ = std::thread(&ReplicationLog::flusher_loop, this);
+}
+
+void ReplicationLog::close() {
+  if (!hdr_)
+    return;
+  {
+    std::lock_guard<std::mutex> lk(mtx_);
+    stop_ = true;
+  }
+  cv_.notify_all();
+  if (flusher_.joinable())
+    flusher_.join();
+  flush();
+  munmap(hdr_, map_len_);
+  hdr_ = nullptr;
+  data_ = nullptr;
+  pending_.clear();
+  committed_ = 0;
+  committed_records_ = open_records_ = 0;
+}
+
+void ReplicationLog::append(WalOp op, uint16_t field, size_t offset,
+                            const void *data, size_t len) {
+  ReplRecordHeader h{offset, len, field, static_cast<uint8_t>(op)};
+  std::lock_guard<std::mutex> lk(mtx_);
+  auto *hp = reinterpret_cast<const char *>(&h);
+  pending_.insert(pending_.end(), hp, hp + sizeof(h));
+  auto *dp = static_cast<const char *>(data);
+  pending_.insert(pending_.end(), dp, dp + len);
+  ++open_records_;
+}
+
+void ReplicationLog::commit() {
+  std::lock_guard<std::mutex> lk(mtx_);
+  size_t op_bytes = pending_.size() - committed_;
+  if (align8(sizeof(ReplBatchHeader) + op_bytes) > capacity_ / 2) {
+    // Operação maior que o ring: descarta e pula mais de uma volta, o que
+    // leva o seguidor a se ressincronizar no próximo checkpoint
+    pending_.resize(committed_);
+    open_records_ = 0;
+    publish_locked();
+    head_ += capacity_ + 8;
+    __atomic_store_n(&hdr_->reserve, head_, __ATOMIC_RELAXED);
+    __atomic_store_n(&hdr_->head, head_, __ATOMIC_RELEASE);
+    return;
+  }
+  if (align8(sizeof(ReplBatchHeader) + pending_.size()) > capacity_ / 2)
+    publish_locked(); // lote anterior sem esta operação
+  committed_ = pending_.size();
+  committed_records_ += open_records_;
+  open_records_ = 0;
+  if (opts_.flush_interval_ms == 0 || committed_ >= opts_.batch_bytes)
+    publish_locked();
+}
+
+void ReplicationLog::flush() {
+  std::lock_guard<std::mutex> lk(mtx_);
+  publish_locked();
+}
+
+void ReplicationLog::publish_locked() {
+  if (!hdr_ || committed_ == 0)
+    return;
+  size_t len = align8(sizeof(ReplBatchHeader) + committed_);
+
+  uint64_t pos = head_;
+  size_t p = pos & (capacity_ - 1);
+  size_t pad = capacity_ - p < len ? capacity_ - p : 0;
+  uint64_t end = pos + pad + len;
+
+  // Seqlock: reserve antes dos dados invalida o trecho que será sobrescrito
+  __atomic_store_n(&hdr_->reserve, end, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  if (pad) {
+    uint32_t marker = REPL_WRAP_MARKER;
+    memcpy(data_ + p, &marker, sizeof(marker));
+    p = 0;
+  }
+  ReplBatchHeader bh{static_cast<uint32_t>(len), committed_records_, ++seq_,
+                     now_ns()};
+  memcpy(data_ + p, &bh, sizeof(bh));
+  memcpy(data_ + p + sizeof(bh), pending_.data(), committed_);
+  memset(data_ + p + sizeof(bh) + committed_, 0,
+         len - sizeof(bh) - committed_);
+
+  head_ = end;
+  __atomic_store_n(&hdr_->seq, seq_, __ATOMIC_RELAXED);
+  __atomic_store_n(&hdr_->publish_ns, bh.publish_ns, __ATOMIC_RELAXED);
+  __atomic_store_n(&hdr_->head, end, __ATOMIC_RELEASE);
+
+  pending_.erase(pending_.begin(), pending_.begin() + committed_);
+  committed_ = 0;
+  committed_records_ = 0;
+}
+
+void ReplicationLog::flusher_loop() {
+  std::unique_lock<std::mutex> lk(mtx_);
+  while (!stop_) {
+    cv_.wait_for(lk, std::chrono::milliseconds(opts_.flush_interval_ms));
+    publish_locked();
+  }
+}
+
+void ReplicationLog::begin_snapshot(const std::string &path) {
+  if (path.size() >= sizeof(hdr_->snapshot_path))
+    throw std::runtime_error("replicação: caminho de snapshot longo demais");
+  std::lock_guard<std::mutex> lk(mtx_);
+  publish_locked();
+  prev_snapshot_head_ = __atomic_load_n(&hdr_->snapshot_head, __ATOMIC_RELAXED);
+  prev_snapshot_path_ = hdr_->snapshot_path;
+  __atomic_fetch_add(&hdr_->snapshot_gen, 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  __atomic_store_n(&hdr_->snapshot_head, head_, __ATOMIC_RELAXED);
+  memset(hdr_->snapshot_path, 0, sizeof(hdr_->snapshot_path));
+  memcpy(hdr_->snapshot_path, path.data(), path.size());
+}
+
+void ReplicationLog::end_snapshot(bool ok) {
+  std::lock_guard<std::mutex> lk(mtx_);
+  if (!ok) {
+    __atomic_store_n(&hdr_->snapshot_head, prev_snapshot_head_,
+                     __ATOMIC_RELAXED);
+    memset(hdr_->snapshot_path, 0, sizeof(hdr_->snapshot_path));
+    memcpy(hdr_->snapshot_path, prev_snapshot_path_.data(),
+           prev_snapshot_path_.size());
+  }
+  __atomic_fetch_add(&hdr_->snapshot_gen, 1, __ATOMIC_RELEASE);
+}
+
+ReplLag ReplicationLog::lag() const {
+  return hdr_ ? repl_lag(*hdr_) : ReplLag{};
+}
+
+// -------------------------------
+// SEGUIDOR
+// -------------------------------
+ReplicaFollower::ReplicaFollower(LayoutEngine &replica,
+                                 const std::string &ring_path,
+                                 const FollowerOptions &opts)
+    : engine_(replica), opts_(opts), ring_path_(ring_path) {
+  if (!map_ring())
+    throw std::runtime_error("ring de replicação inválido: " + ring_path);
+}
+
+// (Re)mapeia o ring inteiro e valida o cabeçalho. false enquanto o escritor
+// o recria (magic zerado); nesse caso o mapeamento anterior é mantido.
+bool ReplicaFollower::map_ring() {
+  int fd = ::open(ring_path_.c_str(), O_RDWR);
+  if (fd < 0)
+    throw std::runtime_error("open(ring) failed: " + ring_path_);
+  off_t len = lseek(fd, 0, SEEK_END);
+  if (len < static_cast<off_t>(REPL_RING_HEADER_SIZE)) {
+    ::close(fd);
+    throw std::runtime_error("ring de replicação truncado: " + ring_path_);
+  }
+  void *p = mmap(nullptr, static_cast<size_t>(len), PROT_READ | PROT_WRITE,
+                 MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (p == MAP_FAILED)
+    throw std::runtime_error("mmap(ring) failed: " + ring_path_);
+  auto *hdr = static_cast<ReplRingHeader *>(p);
+
+  std::string err;
+  if (__atomic_load_n(&hdr->magic, __ATOMIC_ACQUIRE) != REPL_RING_MAGIC) {
+    munmap(p, static_cast<size_t>(len));
+    return false;
+  }
+  if (hdr->version != REPL_RING_VERSION ||
+      hdr->capacity + REPL_RING_HEADER_SIZE > static_cast<size_t>(len))
+    err = "ring de replicação inválido: " + ring_path_;
+  else if (hdr->fingerprint != engine_.get_layout().fingerprint)
+    err = "ring de replicação de outro layout: " + ring_path_;
+  if (!err.empty()) {
+    munmap(p, static_cast<size_t>(len));
+    throw std::runtime_error(err);
+  }
+  if (hdr_)
+    munmap(hdr_, map_len_);
+  hdr_ = hdr;
+  data_ = static_cast<const char *>(p) + REPL_RING_HEADER_SIZE;
+  map_len_ = static_cast<size_t>(len);
+  capacity_ = hdr_->capacity;
+  generation_ = __atomic_load_n(&hdr_->generation, __ATOMIC_ACQUIRE);
+  buf_.reserve(capacity_ / 2);
+  return true;
+}
+
+ReplicaFollower::~ReplicaFollower() {
+  if (hdr_)
+    munmap(hdr_, map_len_);
+}
+
+// Trecho a partir de pos não foi (nem está sendo) sobrescrito pelo escritor
+bool ReplicaFollower::intact(uint64_t pos) const {
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  return __atomic_load_n(&hdr_->reserve, __ATOMIC_RELAXED) <= pos + capacity_;
+}
+
+bool ReplicaFollower::resync() {
+  for (int attempt = 0; attempt < 100; ++attempt) {
+    uint64_t gen = __atomic_load_n(&hdr_->snapshot_gen, __ATOMIC_ACQUIRE);
+    if (gen == 0)
+      return false; // escritor ainda sem checkpoint
+    if (gen & 1) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      continue;
+    }
+    uint64_t head = __atomic_load_n(&hdr_->snapshot_head, __ATOMIC_RELAXED);
+    std::string path = opts_.snapshot_path;
+    if (path.empty())
+      path.assign(hdr_->snapshot_path,
+                  strnlen(hdr_->snapshot_path, sizeof(hdr_->snapshot_path)));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&hdr_->snapshot_gen, __ATOMIC_RELAXED) != gen)
+      continue;
+    // Snapshot também mais de uma volta atrás: espera o próximo checkpoint
+    if (__atomic_load_n(&hdr_->head, __ATOMIC_ACQUIRE) - head > capacity_)
+      return false;
+
+    engine_.restore_snapshot(path);
+
+    // Outro checkpoint durante a leitura: o arquivo pode ser o novo
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&hdr_->snapshot_gen, __ATOMIC_RELAXED) != gen)
+      continue;
+    pos_ = head;
+    snapshot_gen_ = gen;
+    last_resync_ns_ = now_ns();
+    synced_ = true;
+    __atomic_fetch_add(&hdr_->resyncs, 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&hdr_->applied, pos_, __ATOMIC_RELEASE);
+    return true;
+  }
+  return false;
+}
+
+void ReplicaFollower::apply(const char *batch, size_t len) {
+  ReplBatchHeader bh;
+  memcpy(&bh, batch, sizeof(bh));
+  size_t off = sizeof(bh);
+  for (uint32_t r = 0; r < bh.records; ++r) {
+    ReplRecordHeader rh;
+    if (off + sizeof(rh) > len)
+      throw std::runtime_error("replicação: lote corrompido");
+    memcpy(&rh, batch + off, sizeof(rh));
+    off += sizeof(rh);
+    if (rh.len > len - off)
+      throw std::runtime_error("replicação: lote corrompido");
+    engine_.apply_delta(rh.offset, batch + off, rh.len);
+    off += rh.len;
+  }
+  __atomic_store_n(&hdr_->applied_seq, bh.seq, __ATOMIC_RELAXED);
+  __atomic_store_n(&hdr_->applied_ns, bh.publish_ns, __ATOMIC_RELAXED);
+}
+
+size_t ReplicaFollower::poll(size_t max_batches) {
+  // Escritor reabriu o ring (capacidade pode ter mudado): remapeia e
+  // recomeça pelo snapshot
+  if (__atomic_load_n(&hdr_->generation, __ATOMIC_ACQUIRE) != generation_) {
+    if (!map_ring())
+      return 0;
+    synced_ = false;
+  }
+  if (synced_ && opts_.resync_interval_ms > 0 &&
+      now_ns() - last_resync_ns_ >= opts_.resync_interval_ms * 1000000ull &&
+      __atomic_load_n(&hdr_->snapshot_gen, __ATOMIC_ACQUIRE) != snapshot_gen_)
+    synced_ = false;
+  if (!synced_ && !resync())
+    return 0;
+
+  size_t applied = 0;
+  while (applied < max_batches) {
+    uint64_t head = __atomic_load_n(&hdr_->head, __ATOMIC_ACQUIRE);
+    if (head == pos_)
+      break;
+    // Ring recriado ou mais de uma volta atrás: só o snapshot recupera
+    if (head < pos_ || head - pos_ > capacity_) {
+      synced_ = false;
+      if (!resync())
+        break;
+      continue;
+    }
+    size_t p = pos_ & (capacity_ - 1);
+    uint32_t len;
+    memcpy(&len, data_ + p, sizeof(len));
+    if (!intact(pos_)) {
+      synced_ = false;
+      if (!resync())
+        break;
+      continue;
+    }
+    if (len == REPL_WRAP_MARKER) {
+      pos_ += capacity_ - p;
+      continue;
+    }
+    if (len < sizeof(ReplBatchHeader) || len > capacity_ - p || len % 8)
+      throw std::runtime_error("replicação: lote corrompido");
+    buf_.assign(data_ + p, data_ + p + len);
+    if (!intact(pos_)) {
+      synced_ = false;
+      if (!resync())
+        break;
+      continue;
+    }
+    apply(buf_.data(), len);
+    pos_ += len;
+    __atomic_store_n(&hdr_->applied, pos_, __ATOMIC_RELEASE);
+    ++applied;
+  }
+  return applied;
+}
+
+ReplLag ReplicaFollower::lag() const { return repl_lag(*hdr_); }
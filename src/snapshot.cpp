@@ -0,0 +1,412 @@
+#include "snapshot.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <exception>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// -------------------------------
+// LZ DE BLOCO
+// -------------------------------
+// Sequência: token (4 bits literais | 4 bits match - 4), extensões de 255,
+// literais, offset LE de 16 bits. A última sequência só tem literais.
+namespace {
+
+constexpr size_t MIN_MATCH = 4;
+constexpr size_t LAST_LITERALS = 5; // fim do bloco sempre em literais
+constexpr size_t MF_LIMIT = 12;     // nenhum match começa nos últimos bytes
+constexpr int HASH_BITS = 16;
+constexpr size_t MAX_OFFSET = 65535;
+
+uint32_t read32(const uint8_t *p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+uint8_t *put_length(uint8_t *op, size_t len) {
+  for (; len >= 255; len -= 255)
+    *op++ = 255;
+  *op++ = static_cast<uint8_t>(len);
+  return op;
+}
+
+uint8_t *put_sequence(uint8_t *op, const uint8_t *lit, size_t lit_len,
+                      size_t match_len, size_t offset) {
+  uint8_t *token = op++;
+  *token = static_cast<uint8_t>(std::min<size_t>(lit_len, 15) << 4);
+  if (lit_len >= 15)
+    op = put_length(op, lit_len - 15);
+  memcpy(op, lit, lit_len);
+  op += lit_len;
+  if (match_len == 0)
+    return op;
+  *op++ = static_cast<uint8_t>(offset);
+  *op++ = static_cast<uint8_t>(offset >> 8);
+  size_t ml = match_len - MIN_MATCH;
+  *token |= static_cast<uint8_t>(std::min<size_t>(ml, 15));
+  if (ml >= 15)
+    op = put_length(op, ml - 15);
+  return op;
+}
+
+} // namespace
+
+size_t lz_compress_bound(size_t n) { return n + n / 255 + 16; }
+
+size_t lz_compress(const char *src_, size_t n, char *dst_) {
+  auto *src = reinterpret_cast<const uint8_t *>(src_);
+  auto *op = reinterpret_cast<uint8_t *>(dst_);
+  const uint8_t *ip = src, *anchor = src, *end = src + n;
+
+  if (n > MF_LIMIT) {
+    // tabela por thread: compressores paralelos não compartilham estado
+    thread_local std::vector<uint32_t> table(size_t(1) << HASH_BITS);
+    std::fill(table.begin(), table.end(), 0);
+    const uint8_t *mf_limit = end - MF_LIMIT;
+    const uint8_t *match_limit = end - LAST_LITERALS;
+    while (ip < mf_limit) {
+      uint32_t seq = read32(ip);
+      uint32_t h = (seq * 2654435761u) >> (32 - HASH_BITS);
+      const uint8_t *ref = src + table[h];
+      table[h] = static_cast<uint32_t>(ip - src);
+      if (ref >= ip || static_cast<size_t>(ip - ref) > MAX_OFFSET ||
+          read32(ref) != seq) {
+        // dados pouco compressíveis: passo cresce com a distância do anchor
+        ip += 1 + ((ip - anchor) >> 6);
+        continue;
+      }
+      const uint8_t *mp = ip + MIN_MATCH, *rp = ref + MIN_MATCH;
+      while (mp < match_limit && *mp == *rp) {
+        ++mp;
+        ++rp;
+      }
+      op = put_sequence(op, anchor, ip - anchor, mp - ip, ip - ref);
+      ip = anchor = mp;
+    }
+  }
+  op = put_sequence(op, anchor, end - anchor, 0, 0);
+  return op - reinterpret_cast<uint8_t *>(dst_);
+}
+
+void lz_decompress(const char *src_, size_t n, char *dst_, size_t out_len) {
+  auto *ip = reinterpret_cast<const uint8_t *>(src_);
+  auto *iend = ip + n;
+  auto *dst = reinterpret_cast<uint8_t *>(dst_);
+  uint8_t *op = dst, *oend = dst + out_len;
+  auto corrupt = [] {
+    throw std::runtime_error("snapshot: bloco LZ corrompido");
+  };
+  auto get_length = [&](size_t len) {
+    uint8_t b;
+    do {
+      if (ip >= iend)
+        corrupt();
+      b = *ip++;
+      len += b;
+    } while (b == 255);
+    return len;
+  };
+
+  while (ip < iend) {
+    uint8_t token = *ip++;
+    size_t lit = token >> 4;
+    if (lit == 15)
+      lit = get_length(lit);
+    if (lit > static_cast<size_t>(iend - ip) ||
+        lit > static_cast<size_t>(oend - op))
+      corrupt();
+    memcpy(op, ip, lit);
+    op += lit;
+    ip += lit;
+    if (ip == iend)
+      break; // última sequência: só literais
+    if (iend - ip < 2)
+      corrupt();
+    size_t offset = ip[0] | size_t(ip[1]) << 8;
+    ip += 2;
+    if (offset == 0 || offset > static_cast<size_t>(op - dst))
+      corrupt();
+    size_t len = token & 15;
+    if (len == 15)
+      len = get_length(len);
+    len += MIN_MATCH;
+    if (len > static_cast<size_t>(oend - op))
+      corrupt();
+    const uint8_t *m = op - offset;
+    if (offset == 1) {
+      memset(op, *m, len);
+      op += len;
+      continue;
+    }
+    // sobreposição: copia em trechos de no máximo `offset` bytes
+    while (len > 0) {
+      size_t k = std::min(len, offset);
+      memcpy(op, m, k);
+      op += k;
+      m += k;
+      len -= k;
+    }
+  }
+  if (op != oend)
+    corrupt();
+}
+
+// -------------------------------
+// ARQUIVO
+// -------------------------------
+namespace {
+
+struct Piece {
+  const char *data;
+  size_t len;
+};
+
+void write_atomic(const std::string &path, const std::vector<Piece> &pieces) {
+  std::string tmp = path + ".tmp";
+  int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+  if (fd < 0)
+    throw std::runtime_error("open(snapshot) failed: " + tmp);
+  for (auto const &pc : pieces) {
+    const char *p = pc.data;
+    size_t left = pc.len;
+    while (left > 0) {
+      ssize_t w = write(fd, p, left);
+      if (w < 0) {
+        close(fd);
+        throw std::runtime_error("write(snapshot) failed: " + tmp);
+      }
+      p += w;
+      left -= static_cast<size_t>(w);
+    }
+  }
+  if (fsync(fd) < 0) {
+    close(fd);
+    throw std::runtime_error("fsync(snapshot) failed: " + tmp);
+  }
+  close(fd);
+  if (rename(tmp.c_str(), path.c_str()) < 0)
+    throw std::runtime_error("rename(snapshot) failed: " + path);
+
+  // fsync do diretório para tornar o rename durável
+  auto sep = path.find_last_of('/');
+  std::string dir = sep == std::string::npos ? "." : path.substr(0, sep + 1);
+  int dfd = open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+  if (dfd >= 0) {
+    fsync(dfd);
+    close(dfd);
+  }
+}
+
+// fn(i) para i em [0, count), distribuído dinamicamente entre as threads
+template <typename Fn> void parallel_blocks(size_t count, unsigned threads, Fn fn) {
+  if (threads == 0)
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  threads = static_cast<unsigned>(std::min<size_t>(threads, count));
+  std::atomic<size_t> next{0};
+  std::exception_ptr err;
+  std::mutex err_mtx;
+  auto work = [&] {
+    try {
+      for (size_t i; (i = next.fetch_add(1)) < count;)
+        fn(i);
+    } catch (...) {
+      std::lock_guard<std::mutex> lk(err_mtx);
+      if (!err)
+        err = std::current_exception();
+      next = count;
+    }
+  };
+  std::vector<std::thread> pool;
+  for (unsigned t = 1; t < threads; ++t)
+    pool.emplace_back(work);
+  work();
+  for (auto &t : pool)
+    t.join();
+  if (err)
+    std::rethrow_exception(err);
+}
+
+bool all_zero(const char *p, size_t n) {
+  return n == 0 || (p[0] == 0 && memcmp(p, p + 1, n - 1) == 0);
+}
+
+} // namespace
+
+// -------------------------------
+// ESCRITA
+// -------------------------------
+void snapshot_write(const std::string &path, const char *image, size_t size,
+                    uint64_t fingerprint,
+                    const std::vector<SnapshotRange> &unused,
+                    const SnapshotOptions &opts) {
+  if (!opts.compress && !opts.skip_unused) {
+    write_atomic(path, {{image, size}});
+    return;
+  }
+  size_t bs = std::max<size_t>(opts.block_bytes, 4096);
+  size_t blocks = (size + bs - 1) / bs;
+
+  struct Out {
+    SnapshotBlockKind kind = SnapshotBlockKind::Stored;
+    const char *data = nullptr;
+    size_t len = 0;
+    std::vector<char> buf;
+  };
+  std::vector<Out> out(blocks);
+  parallel_blocks(blocks, opts.threads, [&](size_t b) {
+    size_t off = b * bs, len = std::min(bs, size - off);
+    const char *src = image + off;
+    Out &o = out[b];
+
+    // Trechos livres que cruzam o bloco viram zeros numa cópia
+    std::vector<char> masked;
+    if (opts.skip_unused) {
+      auto it = std::lower_bound(
+          unused.begin(), unused.end(), off,
+          [](const SnapshotRange &r, size_t v) { return r.offset + r.len <= v; });
+      for (; it != unused.end() && it->offset < off + len; ++it) {
+        if (masked.empty()) {
+          masked.assign(src, src + len);
+          src = masked.data();
+        }
+        size_t lo = std::max(it->offset, off), hi = std::min(it->offset + it->len, off + len);
+        memset(masked.data() + (lo - off), 0, hi - lo);
+      }
+    }
+    if (all_zero(src, len)) {
+      o.kind = SnapshotBlockKind::Zero;
+      return;
+    }
+    if (opts.compress) {
+      o.buf.resize(lz_compress_bound(len));
+      size_t c = lz_compress(src, len, o.buf.data());
+      if (c < len) {
+        o.buf.resize(c);
+        o.kind = SnapshotBlockKind::Lz;
+        o.data = o.buf.data();
+        o.len = c;
+        return;
+      }
+      o.buf.clear();
+    }
+    if (!masked.empty())
+      o.buf.swap(masked);
+    o.kind = SnapshotBlockKind::Stored;
+    o.data = o.buf.empty() ? src : o.buf.data();
+    o.len = len;
+  });
+
+  SnapshotFileHeader hdr{SNAPSHOT_MAGIC, SNAPSHOT_VERSION, fingerprint,
+                         size,           bs,               blocks};
+  std::vector<SnapshotBlock> table(blocks);
+  uint64_t pos = sizeof(hdr) + blocks * sizeof(SnapshotBlock);
+  std::vector<Piece> pieces{{reinterpret_cast<const char *>(&hdr), sizeof(hdr)},
+                            {reinterpret_cast<const char *>(table.data()),
+                             blocks * sizeof(SnapshotBlock)}};
+  for (size_t b = 0; b < blocks; ++b) {
+    table[b] = {pos, static_cast<uint32_t>(out[b].len),
+                static_cast<uint32_t>(out[b].kind)};
+    if (out[b].len)
+      pieces.push_back({out[b].data, out[b].len});
+    pos += out[b].len;
+  }
+  write_atomic(path, pieces);
+}
+
+// -------------------------------
+// LEITURA
+// -------------------------------
+bool snapshot_read(const std::string &path, char *image, size_t size,
+                   uint64_t fingerprint, unsigned threads,
+                   const std::function<void(const char *)> &validate) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    if (errno == ENOENT)
+      return false;
+    throw std::runtime_error("open(snapshot) failed: " + path);
+  }
+  struct stat st;
+  if (fstat(fd, &st) < 0) {
+    close(fd);
+    throw std::runtime_error("fstat(snapshot) failed: " + path);
+  }
+  size_t file_len = static_cast<size_t>(st.st_size);
+  void *m = file_len ? mmap(nullptr, file_len, PROT_READ, MAP_PRIVATE, fd, 0)
+                     : MAP_FAILED;
+  close(fd);
+  if (m == MAP_FAILED)
+    throw std::runtime_error("snapshot com tamanho incompatível: " + path);
+  struct Unmap {
+    void *p;
+    size_t n;
+    ~Unmap() { munmap(p, n); }
+  } unmap{m, file_len};
+  auto *file = static_cast<const char *>(m);
+
+  SnapshotFileHeader hdr{};
+  if (file_len >= sizeof(hdr))
+    memcpy(&hdr, file, sizeof(hdr));
+  if (hdr.magic != SNAPSHOT_MAGIC) {
+    // imagem crua
+    if (file_len != size)
+      throw std::runtime_error("snapshot com tamanho incompatível: " + path);
+    validate(file);
+    memcpy(image, file, size);
+    return true;
+  }
+
+  if (hdr.version != SNAPSHOT_VERSION)
+    throw std::runtime_error("snapshot: versão não suportada: " + path);
+  if (hdr.fingerprint != fingerprint)
+    throw std::runtime_error("snapshot de outro layout: " + path);
+  if (hdr.image_size != size)
+    throw std::runtime_error("snapshot com tamanho incompatível: " + path);
+  size_t bs = hdr.block_bytes;
+  if (bs == 0 || hdr.blocks != (size + bs - 1) / bs ||
+      sizeof(hdr) + hdr.blocks * sizeof(SnapshotBlock) > file_len)
+    throw std::runtime_error("snapshot: tabela de blocos inválida: " + path);
+  std::vector<SnapshotBlock> table(hdr.blocks);
+  memcpy(table.data(), file + sizeof(hdr), hdr.blocks * sizeof(SnapshotBlock));
+  for (auto const &b : table)
+    if (b.file_offset > file_len || b.stored_len > file_len - b.file_offset ||
+        b.kind > static_cast<uint32_t>(SnapshotBlockKind::Zero))
+      throw std::runtime_error("snapshot: tabela de blocos inválida: " + path);
+
+  auto decode = [&](size_t b, char *dst) {
+    size_t len = std::min(bs, size - b * bs);
+    const char *src = file + table[b].file_offset;
+    switch (static_cast<SnapshotBlockKind>(table[b].kind)) {
+    case SnapshotBlockKind::Zero:
+      memset(dst, 0, len);
+      break;
+    case SnapshotBlockKind::Stored:
+      if (table[b].stored_len != len)
+        throw std::runtime_error("snapshot: bloco cru com tamanho inválido");
+      memcpy(dst, src, len);
+      break;
+    case SnapshotBlockKind::Lz:
+      lz_decompress(src, table[b].stored_len, dst, len);
+      break;
+    }
+  };
+
+  // Header validado antes de tocar no mapeamento
+  std::vector<char> first(std::min(bs, size));
+  decode(0, first.data());
+  validate(first.data());
+  memcpy(image, first.data(), first.size());
+  if (hdr.blocks > 1)
+    parallel_blocks(hdr.blocks - 1, threads,
+                    [&](size_t i) { decode(i + 1, image + (i + 1) * bs); });
+  return true;
+}
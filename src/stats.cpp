@@ -0,0 +1,81 @@
+#include "stats.hpp"
+#include "layout_engine.hpp"
+
+#include <sched.h>
+#include <time.h>
+
+size_t stats_slot(size_t slots) {
+  // sched_getcpu relido a cada STATS_CPU_REFRESH chamadas: a thread que
+  // migra de CPU passa a contar no slot da CPU nova
+  static thread_local int cpu = 0;
+  static thread_local unsigned left = 0;
+  if (left-- == 0) {
+    cpu = sched_getcpu();
+    if (cpu < 0)
+      cpu = 0;
+    left = STATS_CPU_REFRESH - 1;
+  }
+  return static_cast<size_t>(cpu) % slots;
+}
+
+uint64_t stats_now_ns() {
+  timespec ts;
+  clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+  return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+}
+
+FieldStats *stats_entry(const LayoutMap &map, void *base, size_t field_idx) {
+  size_t slot = stats_slot(map.stats_slots);
+  return reinterpret_cast<FieldStats *>(static_cast<char *>(base) +
+                                        map.stats_offset) +
+         slot * map.fields.size() + field_idx;
+}
+
+static void atomic_max(uint64_t *p, uint64_t v) {
+  uint64_t cur = __atomic_load_n(p, __ATOMIC_RELAXED);
+  while (cur < v && !__atomic_compare_exchange_n(p, &cur, v, true,
+                                                 __ATOMIC_RELAXED,
+                                                 __ATOMIC_RELAXED))
+    ;
+}
+
+void stats_on_insert(FieldStats *s, uint64_t occupancy) {
+  __atomic_fetch_add(&s->inserts, 1, __ATOMIC_RELAXED);
+  atomic_max(&s->max_occupancy, occupancy);
+  __atomic_store_n(&s->last_write_ns, stats_now_ns(), __ATOMIC_RELAXED);
+}
+
+void stats_on_pop(FieldStats *s) {
+  __atomic_fetch_add(&s->pops, 1, __ATOMIC_RELAXED);
+  __atomic_store_n(&s->last_write_ns, stats_now_ns(), __ATOMIC_RELAXED);
+}
+
+void stats_on_full(FieldStats *s) {
+  __atomic_fetch_add(&s->full_rejections, 1, __ATOMIC_RELAXED);
+}
+
+void stats_on_write(FieldStats *s) {
+  __atomic_fetch_add(&s->writes, 1, __ATOMIC_RELAXED);
+  __atomic_store_n(&s->last_write_ns, stats_now_ns(), __ATOMIC_RELAXED);
+}
+
+FieldStats stats_aggregate(const LayoutMap &map, const void *base,
+                           size_t field_idx) {
+  FieldStats out{};
+  auto *all = reinterpret_cast<const FieldStats *>(
+      static_cast<const char *>(base) + map.stats_offset);
+  for (size_t slot = 0; slot < map.stats_slots; ++slot) {
+    auto const &s = all[slot * map.fields.size() + field_idx];
+    out.inserts += __atomic_load_n(&s.inserts, __ATOMIC_RELAXED);
+    out.pops += __atomic_load_n(&s.pops, __ATOMIC_RELAXED);
+    out.full_rejections += __atomic_load_n(&s.full_rejections, __ATOMIC_RELAXED);
+    out.writes += __atomic_load_n(&s.writes, __ATOMIC_RELAXED);
+    uint64_t occ = __atomic_load_n(&s.max_occupancy, __ATOMIC_RELAXED);
+    uint64_t ts = __atomic_load_n(&s.last_write_ns, __ATOMIC_RELAXED);
+    if (occ > out.max_occupancy)
+      out.max_occupancy = occ;
+    if (ts > out.last_write_ns)
+      out.last_write_ns = ts;
+  }
+  return out;
+}
@@ -0,0 +1,231 @@
+#include "wal.hpp"
+
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+// -------------------------------
+// CRC32 (IEEE, tabela gerada na primeira chamada)
+// -------------------------------
+static uint32_t crc32_update(uint32_t crc, const void *data, size_t len) {
+  static const struct Table {
+    uint32_t v[256];
+    Table() {
+      for (uint32_t i = 0; i < 256; ++i) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; ++k)
+          c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+        v[i] = c;
+      }
+    }
+  } table;
+  auto p = static_cast<const uint8_t *>(data);
+  crc = ~crc;
+  for (size_t i = 0; i < len; ++i)
+    crc = table.v[(crc ^ p[i]) & 0xFF] ^ (crc >> 8);
+  return ~crc;
+}
+
+static uint32_t record_crc(const WalRecordHeader &h, const void *payload) {
+  uint32_t crc = crc32_update(0, &h.len, sizeof(h) - sizeof(h.crc));
+  return crc32_update(crc, payload, h.len);
+}
+
+static void write_all(int fd, const char *p, size_t n) {
+  while (n > 0) {
+    ssize_t w = ::write(fd, p, n);
+    if (w < 0)
+      throw std::runtime_error("write(wal) failed");
+    p += w;
+    n -= static_cast<size_t>(w);
+  }
+}
+
+// -------------------------------
+// OPEN / CLOSE
+// -------------------------------
+WriteAheadLog::~WriteAheadLog() {
+  try {
+    close();
+  } catch (...) {
+  }
+}
+
+void WriteAheadLog::open(const std::string &path, const WalOptions &opts) {
+  close();
+  fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0600);
+  if (fd_ < 0)
+    throw std::runtime_error("open(wal) failed: " + path);
+  opts_ = opts;
+  pending_.reserve(opts_.batch_bytes);
+  stop_ = false;
+  if (opts_.fsync_interval_ms > 0)
+    flusher_ = std::thread(&WriteAheadLog::flusher_loop, this);
+}
+
+void WriteAheadLog::close() {
+  if (fd_ < 0)
+    return;
+  {
+    std::lock_guard<std::mutex> lk(mtx_);
+    stop_ = true;
+  }
+  cv_.notify_all();
+  if (flusher_.joinable())
+    flusher_.join();
+  sync();
+  ::close(fd_);
+  fd_ = -1;
+}
+
+// -------------------------------
+// APPEND / COMMIT
+// -------------------------------
+void WriteAheadLog::append(WalOp op, size_t offset, const void *data,
+                           size_t len) {
+  if (fd_ < 0)
+    return;
+  WalRecordHeader h;
+  h.len = len;
+  h.offset = offset;
+  h.op = static_cast<uint8_t>(op);
+  h.crc = record_crc(h, data);
+
+  std::lock_guard<std::mutex> lk(mtx_);
+  auto hp = reinterpret_cast<const char *>(&h);
+  pending_.insert(pending_.end(), hp, hp + sizeof(h));
+  if (len) {
+    auto dp = static_cast<const char *>(data);
+    pending_.insert(pending_.end(), dp, dp + len);
+  }
+  if (pending_.size() >= opts_.batch_bytes)
+    write_pending_locked();
+}
+
+void WriteAheadLog::commit() {
+  if (fd_ < 0)
+    return;
+  // Um flush em lote pode cortar a operação no meio; o replay só aplica o
+  // que vier antes de um marcador
+  append(WalOp::Commit, 0, nullptr, 0);
+  // Sem intervalo configurado o commit é síncrono
+  if (opts_.fsync_interval_ms == 0)
+    sync();
+}
+
+void WriteAheadLog::sync() {
+  if (fd_ < 0)
+    return;
+  std::lock_guard<std::mutex> lk(mtx_);
+  write_pending_locked();
+  if (dirty_) {
+    if (fdatasync(fd_) < 0)
+      throw std::runtime_error("fdatasync(wal) failed");
+    dirty_ = false;
+  }
+}
+
+void WriteAheadLog::truncate() {
+  if (fd_ < 0)
+    return;
+  std::lock_guard<std::mutex> lk(mtx_);
+  pending_.clear();
+  if (ftruncate(fd_, 0) < 0)
+    throw std::runtime_error("ftruncate(wal) failed");
+  if (fdatasync(fd_) < 0)
+    throw std::runtime_error("fdatasync(wal) failed");
+  dirty_ = false;
+}
+
+void WriteAheadLog::write_pending_locked() {
+  if (pending_.empty())
+    return;
+  // Arquivo vazio (novo, truncado pelo checkpoint ou pelo recover): o
+  // cabeçalho vai antes do primeiro lote
+  if (lseek(fd_, 0, SEEK_END) == 0) {
+    WalFileHeader fh{WAL_MAGIC, WAL_VERSION};
+    write_all(fd_, reinterpret_cast<const char *>(&fh), sizeof(fh));
+  }
+  write_all(fd_, pending_.data(), pending_.size());
+  pending_.clear();
+  dirty_ = true;
+}
+
+// Group commit: um único fdatasync cobre todos os registros do intervalo
+void WriteAheadLog::flusher_loop() {
+  auto interval = std::chrono::milliseconds(opts_.fsync_interval_ms);
+  std::unique_lock<std::mutex> lk(mtx_);
+  while (!stop_) {
+    cv_.wait_for(lk, interval, [this] { return stop_; });
+    if (stop_)
+      break;
+    try {
+      write_pending_locked();
+      if (dirty_ && fdatasync(fd_) == 0)
+        dirty_ = false;
+    } catch (...) {
+      // o próximo sync() explícito reporta o erro
+    }
+  }
+}
+
+// -------------------------------
+// REPLAY
+// -------------------------------
+size_t WriteAheadLog::replay(const std::string &path, void *base,
+                             size_t size) {
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return 0; // sem WAL, nada a reaplicar
+
+  std::vector<char> buf;
+  char chunk[64 * 1024];
+  ssize_t r;
+  while ((r = ::read(fd, chunk, sizeof(chunk))) > 0)
+    buf.insert(buf.end(), chunk, chunk + r);
+  ::close(fd);
+  if (r < 0)
+    throw std::runtime_error("read(wal) failed: " + path);
+
+  // Arquivo cortado antes do fim do cabeçalho: nenhum registro gravado
+  if (buf.size() < sizeof(WalFileHeader))
+    return 0;
+  WalFileHeader fh;
+  memcpy(&fh, buf.data(), sizeof(fh));
+  if (fh.magic != WAL_MAGIC)
+    throw std::runtime_error("WAL sem cabeçalho válido: " + path);
+  if (fh.version != WAL_VERSION)
+    throw std::runtime_error("versão de WAL não suportada: " + path);
+
+  // Registros da operação em curso (início no arquivo), aplicados no Commit
+  std::vector<size_t> op;
+  size_t pos = sizeof(fh), applied = 0;
+  while (pos + sizeof(WalRecordHeader) <= buf.size()) {
+    WalRecordHeader h;
+    memcpy(&h, buf.data() + pos, sizeof(h));
+    const char *payload = buf.data() + pos + sizeof(h);
+    if (h.len > buf.size() - pos - sizeof(h))
+      break; // registro truncado
+    if (record_crc(h, payload) != h.crc)
+      break; // cauda corrompida
+    if (h.op == static_cast<uint8_t>(WalOp::Commit)) {
+      for (size_t at : op) {
+        WalRecordHeader rh;
+        memcpy(&rh, buf.data() + at, sizeof(rh));
+        memcpy(static_cast<char *>(base) + rh.offset,
+               buf.data() + at + sizeof(rh), rh.len);
+      }
+      applied += op.size();
+      op.clear();
+    } else {
+      if (h.len > size || h.offset > size - h.len)
+        throw std::runtime_error("WAL fora dos limites do buffer: " + path);
+      op.push_back(pos);
+    }
+    pos += sizeof(h) + h.len;
+  }
+  return applied; // operação sem Commit no fim do log é descartada
+}